@@ -0,0 +1,207 @@
+/**
+ * CPU and Memory Usage Tracker - sampler benchmark
+ * 
+ * Drives the sampler tick by tick against a /proc tree, normally one made
+ * by proc_fixture, and reports tick latency percentiles, /proc syscalls
+ * per process and heap allocations per tick. Syscalls and allocations are
+ * counted by wrapping the libc calls at link time (ld --wrap).
+ */
+
+ #include <fcntl.h>
+ #include <stdarg.h>
+ #include <stdatomic.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ #include <dirent.h>
+ #include <unistd.h>
+ 
+ #include "../sampler.h"
+ 
+ #define BENCH_DEFAULT_TICKS 50
+ 
+ /* Calls counted during one tick */
+ typedef struct {
+     unsigned long opens;
+     unsigned long reads;
+     unsigned long closes;
+     unsigned long dirents;
+     unsigned long allocations;
+ } TickCounts;
+ 
+ /* Global variables; the scan workers bump these concurrently */
+ static atomic_ulong open_calls;
+ static atomic_ulong read_calls;
+ static atomic_ulong close_calls;
+ static atomic_ulong dirent_calls;
+ static atomic_ulong allocation_calls;
+ 
+ /* The real libc entry points, resolved by the linker */
+ int __real_openat(int dirfd, const char *path, int flags, ...);
+ ssize_t __real_read(int fd, void *buf, size_t count);
+ ssize_t __real_pread(int fd, void *buf, size_t count, off_t offset);
+ int __real_close(int fd);
+ struct dirent *__real_readdir(DIR *dir);
+ void *__real_malloc(size_t size);
+ void *__real_calloc(size_t count, size_t size);
+ void *__real_realloc(void *ptr, size_t size);
+ 
+ /* Function prototypes */
+ static void take_counts(TickCounts *counts);
+ static int compare_ull(const void *a, const void *b);
+ static double percentile_ms(const unsigned long long *sorted, int count, double fraction);
+ 
+ /* Counting wrappers */
+ int __wrap_openat(int dirfd, const char *path, int flags, ...) {
+     mode_t mode = 0;
+     if (flags & O_CREAT) {
+         va_list args;
+         va_start(args, flags);
+         mode = va_arg(args, mode_t);
+         va_end(args);
+     }
+     atomic_fetch_add_explicit(&open_calls, 1, memory_order_relaxed);
+     return __real_openat(dirfd, path, flags, mode);
+ }
+ 
+ ssize_t __wrap_read(int fd, void *buf, size_t count) {
+     atomic_fetch_add_explicit(&read_calls, 1, memory_order_relaxed);
+     return __real_read(fd, buf, count);
+ }
+ 
+ ssize_t __wrap_pread(int fd, void *buf, size_t count, off_t offset) {
+     atomic_fetch_add_explicit(&read_calls, 1, memory_order_relaxed);
+     return __real_pread(fd, buf, count, offset);
+ }
+ 
+ int __wrap_close(int fd) {
+     atomic_fetch_add_explicit(&close_calls, 1, memory_order_relaxed);
+     return __real_close(fd);
+ }
+ 
+ struct dirent *__wrap_readdir(DIR *dir) {
+     atomic_fetch_add_explicit(&dirent_calls, 1, memory_order_relaxed);
+     return __real_readdir(dir);
+ }
+ 
+ void *__wrap_malloc(size_t size) {
+     atomic_fetch_add_explicit(&allocation_calls, 1, memory_order_relaxed);
+     return __real_malloc(size);
+ }
+ 
+ void *__wrap_calloc(size_t count, size_t size) {
+     atomic_fetch_add_explicit(&allocation_calls, 1, memory_order_relaxed);
+     return __real_calloc(count, size);
+ }
+ 
+ void *__wrap_realloc(void *ptr, size_t size) {
+     atomic_fetch_add_explicit(&allocation_calls, 1, memory_order_relaxed);
+     return __real_realloc(ptr, size);
+ }
+ 
+ /* Read and reset the counters */
+ static void take_counts(TickCounts *counts) {
+     counts->opens = atomic_exchange(&open_calls, 0);
+     counts->reads = atomic_exchange(&read_calls, 0);
+     counts->closes = atomic_exchange(&close_calls, 0);
+     counts->dirents = atomic_exchange(&dirent_calls, 0);
+     counts->allocations = atomic_exchange(&allocation_calls, 0);
+ }
+ 
+ /* Order latencies ascending */
+ static int compare_ull(const void *a, const void *b) {
+     unsigned long long x = *(const unsigned long long*)a;
+     unsigned long long y = *(const unsigned long long*)b;
+     return (x > y) - (x < y);
+ }
+ 
+ /* Nearest-rank percentile of sorted nanosecond latencies, in milliseconds */
+ static double percentile_ms(const unsigned long long *sorted, int count, double fraction) {
+     int rank = (int)(fraction * count + 0.999999);
+     if (rank < 1) {
+         rank = 1;
+     }
+     if (rank > count) {
+         rank = count;
+     }
+     return sorted[rank - 1] / 1e6;
+ }
+ 
+ /* Main function */
+ int main(int argc, char *argv[]) {
+     const char *proc_root = NULL;
+     int ticks = BENCH_DEFAULT_TICKS;
+     char root_option[4096];
+     
+     for (int i = 1; i < argc; i++) {
+         if (strncmp(argv[i], "--ticks=", 8) == 0) {
+             ticks = atoi(argv[i] + 8);
+         } else if (argv[i][0] != '-' && proc_root == NULL) {
+             proc_root = argv[i];
+         } else if (!parse_sampler_option(argv[i])) {
+             fprintf(stderr, "Unknown option: %s\n", argv[i]);
+             return 2;
+         }
+     }
+     if (proc_root == NULL || ticks < 2) {
+         fprintf(stderr, "Usage: %s PROC_ROOT [--ticks=N] [sampler options]\n", argv[0]);
+         return 2;
+     }
+     snprintf(root_option, sizeof(root_option), "--proc-root=%s", proc_root);
+     parse_sampler_option(root_option);
+     if (!sampler_init()) {
+         return 1;
+     }
+     
+     unsigned long long *latencies = malloc(ticks * sizeof(unsigned long long));
+     TickCounts first, counts, total;
+     memset(&total, 0, sizeof(total));
+     int rows = 0;
+     
+     // The first tick sizes every buffer, so it is reported apart from the steady state
+     take_counts(&counts);
+     for (int i = 0; i < ticks; i++) {
+         struct timespec start, end;
+         clock_gettime(CLOCK_MONOTONIC, &start);
+         sampler_tick();
+         clock_gettime(CLOCK_MONOTONIC, &end);
+         take_counts(&counts);
+         latencies[i] = (unsigned long long)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+                        (unsigned long long)(end.tv_nsec - start.tv_nsec);
+         
+         if (i == 0) {
+             first = counts;
+             Snapshot *snapshot = snapshot_acquire();
+             if (snapshot != NULL) {
+                 rows = snapshot->list.count;
+                 snapshot_release(snapshot);
+             }
+             continue;
+         }
+         total.opens += counts.opens;
+         total.reads += counts.reads;
+         total.closes += counts.closes;
+         total.dirents += counts.dirents;
+         total.allocations += counts.allocations;
+     }
+     stop_sampler();
+     free_snapshots();
+     
+     int steady = ticks - 1;
+     double per_row = rows > 0 ? (double)steady * rows : 1;
+     unsigned long long first_latency = latencies[0];
+     qsort(latencies + 1, steady, sizeof(unsigned long long), compare_ull);
+     
+     printf("%s: %d processes, %d ticks\n", proc_root, rows, steady);
+     printf("  latency   p50 %.3f ms  p90 %.3f ms  p99 %.3f ms  max %.3f ms  (first tick %.3f ms)\n",
+            percentile_ms(latencies + 1, steady, 0.50), percentile_ms(latencies + 1, steady, 0.90),
+            percentile_ms(latencies + 1, steady, 0.99), latencies[steady] / 1e6, first_latency / 1e6);
+     printf("  syscalls  %.2f per process  (openat %.2f, read %.2f, close %.2f), %.0f dirents per tick\n",
+            (total.opens + total.reads + total.closes) / per_row, total.opens / per_row,
+            total.reads / per_row, total.closes / per_row, (double)total.dirents / steady);
+     printf("  allocs    %.1f per tick  (first tick %lu)\n", (double)total.allocations / steady, first.allocations);
+     
+     free(latencies);
+     return 0;
+ }
@@ -0,0 +1,227 @@
+/**
+ * CPU and Memory Usage Tracker - /proc fixture generator
+ * 
+ * Writes a fake /proc tree with a given number of processes for the
+ * sampler benchmark. Files follow the kernel's formats closely enough
+ * for the sampler's parsers, including names with spaces and parentheses.
+ */
+
+ #include <errno.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <sys/stat.h>
+ #include <sys/types.h>
+ 
+ #define FIXTURE_CPUS 8
+ #define FIXTURE_MEM_KB 16777216ULL  // 16 GiB
+ 
+ /* Command names, including the awkward ones comm can hold */
+ static const char *fixture_names[] = {
+     "systemd", "kthreadd", "bash", "sshd", "Xorg", "pulseaudio", "gnome-shell",
+     "Web Content", "Isolated Web Co", "(sd-pam)", "kworker/3:1-events", "a) (b",
+     "tmux: server", "python3", "node", "my)name", "((", "rcu_sched", "cc1", "Privileged Cont"
+ };
+ 
+ /* Global variables */
+ static unsigned long long rng_state = 0x9E3779B97F4A7C15ULL;
+ 
+ /* Function prototypes */
+ static unsigned long long next_random(void);
+ static int write_file(const char *path, const char *contents);
+ static int write_process(const char *root, int pid, int ppid);
+ static int write_system_files(const char *root);
+ 
+ /* xorshift64*, so fixtures are reproducible */
+ static unsigned long long next_random(void) {
+     rng_state ^= rng_state >> 12;
+     rng_state ^= rng_state << 25;
+     rng_state ^= rng_state >> 27;
+     return rng_state * 0x2545F4914F6CDD1DULL;
+ }
+ 
+ /* Create or replace a file with the given contents */
+ static int write_file(const char *path, const char *contents) {
+     FILE *file = fopen(path, "w");
+     if (file == NULL) {
+         perror(path);
+         return 0;
+     }
+     fputs(contents, file);
+     return fclose(file) == 0;
+ }
+ 
+ /* Write <root>/<pid>/{stat,statm,comm,status,io,cgroup,smaps_rollup} */
+ static int write_process(const char *root, int pid, int ppid) {
+     char path[4096];
+     char buf[2048];
+     const char *name = fixture_names[next_random() % (sizeof(fixture_names) / sizeof(fixture_names[0]))];
+     unsigned long long utime = next_random() % 100000;
+     unsigned long long stime = next_random() % 20000;
+     unsigned long long starttime = 100 + next_random() % 10000000;
+     unsigned long long rss_pages = next_random() % 4 == 0 ? 0 : 50 + next_random() % 200000;  // Kernel threads have none
+     unsigned long long vsize_pages = rss_pages * 4 + next_random() % 100000;
+     unsigned long long threads = 1 + next_random() % 16;
+     
+     snprintf(path, sizeof(path), "%s/%d", root, pid);
+     if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+         perror(path);
+         return 0;
+     }
+     
+     snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+     snprintf(buf, sizeof(buf),
+              "%d (%s) S %d %d %d 0 -1 4194560 %llu 0 %llu 0 %llu %llu 0 0 20 0 %llu 0 %llu %llu %llu "
+              "18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 %d 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+              pid, name, ppid, pid, pid, next_random() % 100000, next_random() % 100, utime, stime,
+              threads, starttime, vsize_pages * 4096, rss_pages, (int)(next_random() % FIXTURE_CPUS));
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     snprintf(path, sizeof(path), "%s/%d/statm", root, pid);
+     snprintf(buf, sizeof(buf), "%llu %llu %llu 1 0 %llu 0\n", vsize_pages, rss_pages, rss_pages / 3, rss_pages / 2);
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     snprintf(path, sizeof(path), "%s/%d/comm", root, pid);
+     snprintf(buf, sizeof(buf), "%s\n", name);
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     snprintf(path, sizeof(path), "%s/%d/status", root, pid);
+     snprintf(buf, sizeof(buf),
+              "Name:\t%s\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t%d\nNgid:\t0\nPid:\t%d\nPPid:\t%d\n"
+              "TracerPid:\t0\nUid:\t1000\t1000\t1000\t1000\nGid:\t1000\t1000\t1000\t1000\n"
+              "VmSize:\t%llu kB\nVmRSS:\t%llu kB\nThreads:\t%llu\n"
+              "voluntary_ctxt_switches:\t%llu\nnonvoluntary_ctxt_switches:\t%llu\n",
+              name, pid, pid, ppid, vsize_pages * 4, rss_pages * 4, threads,
+              next_random() % 1000000, next_random() % 10000);
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     unsigned long long read_bytes = next_random() % 1000000 * 4096;
+     unsigned long long write_bytes = next_random() % 100000 * 4096;
+     snprintf(path, sizeof(path), "%s/%d/io", root, pid);
+     snprintf(buf, sizeof(buf),
+              "rchar: %llu\nwchar: %llu\nsyscr: %llu\nsyscw: %llu\nread_bytes: %llu\nwrite_bytes: %llu\n"
+              "cancelled_write_bytes: 0\n",
+              read_bytes * 2, write_bytes, read_bytes / 512, write_bytes / 1024, read_bytes, write_bytes);
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     // Kernel threads stay in the root cgroup; the others are spread over services and their sessions
+     snprintf(path, sizeof(path), "%s/%d/cgroup", root, pid);
+     if (rss_pages == 0) {
+         snprintf(buf, sizeof(buf), "0::/\n");
+     } else if (next_random() % 2 == 0) {
+         snprintf(buf, sizeof(buf), "0::/system.slice/service-%d.service\n", (int)(next_random() % 32));
+     } else {
+         snprintf(buf, sizeof(buf), "0::/user.slice/user-1000.slice/session-%d.scope\n", (int)(next_random() % 8));
+     }
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     // A third of the resident memory is shared file pages, the rest private anonymous memory
+     unsigned long long rss_kb = rss_pages * 4;
+     unsigned long long shared_kb = rss_kb / 3;
+     snprintf(path, sizeof(path), "%s/%d/smaps_rollup", root, pid);
+     snprintf(buf, sizeof(buf),
+              "00400000-7ffc0000 ---p 00000000 00:00 0                          [rollup]\n"
+              "Rss:            %8llu kB\nPss:            %8llu kB\nPss_Anon:       %8llu kB\n"
+              "Pss_File:       %8llu kB\nPss_Shmem:             0 kB\nShared_Clean:   %8llu kB\n"
+              "Shared_Dirty:          0 kB\nPrivate_Clean:         0 kB\nPrivate_Dirty:  %8llu kB\n"
+              "Referenced:     %8llu kB\nAnonymous:      %8llu kB\nLazyFree:              0 kB\n"
+              "AnonHugePages:         0 kB\nShmemPmdMapped:        0 kB\nFilePmdMapped:         0 kB\n"
+              "Shared_Hugetlb:        0 kB\nPrivate_Hugetlb:       0 kB\nSwap:           %8llu kB\n"
+              "SwapPss:        %8llu kB\nLocked:                0 kB\n",
+              rss_kb, rss_kb - shared_kb + shared_kb / 4, rss_kb - shared_kb, shared_kb / 4, shared_kb,
+              rss_kb - shared_kb, rss_kb, rss_kb - shared_kb, rss_kb / 8, rss_kb / 8);
+     return rss_pages == 0 || write_file(path, buf);
+ }
+ 
+ /* Write the system-wide files the sampler reads: stat, meminfo and sys/kernel/pid_max */
+ static int write_system_files(const char *root) {
+     char path[4096];
+     char buf[4096];
+     size_t used = 0;
+     unsigned long long total[4] = { 0, 0, 0, 0 };
+     unsigned long long cpus[FIXTURE_CPUS][4];
+     
+     for (int cpu = 0; cpu < FIXTURE_CPUS; cpu++) {
+         for (int field = 0; field < 4; field++) {
+             cpus[cpu][field] = next_random() % 10000000;
+             total[field] += cpus[cpu][field];
+         }
+     }
+     used += (size_t)snprintf(buf + used, sizeof(buf) - used, "cpu  %llu %llu %llu %llu 0 0 0 0 0 0\n",
+                              total[0], total[1], total[2], total[3]);
+     for (int cpu = 0; cpu < FIXTURE_CPUS; cpu++) {
+         used += (size_t)snprintf(buf + used, sizeof(buf) - used, "cpu%d %llu %llu %llu %llu 0 0 0 0 0 0\n",
+                                  cpu, cpus[cpu][0], cpus[cpu][1], cpus[cpu][2], cpus[cpu][3]);
+     }
+     snprintf(buf + used, sizeof(buf) - used, "intr 0\nctxt 0\nbtime 1700000000\nprocesses 0\n");
+     snprintf(path, sizeof(path), "%s/stat", root);
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     snprintf(path, sizeof(path), "%s/meminfo", root);
+     snprintf(buf, sizeof(buf), "MemTotal:       %llu kB\nMemFree:        %llu kB\nMemAvailable:   %llu kB\n",
+              FIXTURE_MEM_KB, FIXTURE_MEM_KB / 4, FIXTURE_MEM_KB / 2);
+     if (!write_file(path, buf)) {
+         return 0;
+     }
+     
+     snprintf(path, sizeof(path), "%s/sys", root);
+     mkdir(path, 0755);
+     snprintf(path, sizeof(path), "%s/sys/kernel", root);
+     mkdir(path, 0755);
+     snprintf(path, sizeof(path), "%s/sys/kernel/pid_max", root);
+     return write_file(path, "4194304\n");
+ }
+ 
+ /* Main function */
+ int main(int argc, char *argv[]) {
+     if (argc < 3) {
+         fprintf(stderr, "Usage: %s DIR PROCESSES [SEED]\n", argv[0]);
+         return 2;
+     }
+     const char *root = argv[1];
+     int processes = atoi(argv[2]);
+     if (argc > 3) {
+         rng_state ^= strtoull(argv[3], NULL, 10);
+     }
+     
+     if (mkdir(root, 0755) != 0 && errno != EEXIST) {
+         perror(root);
+         return 1;
+     }
+     if (!write_system_files(root)) {
+         return 1;
+     }
+     
+     // PIDs ascend with small random gaps, like a system that has been up a while;
+     // every parent is an earlier process, so the fixture forms one tree under PID 1
+     int *pids = malloc((processes > 0 ? processes : 1) * sizeof(int));
+     if (pids == NULL) {
+         return 1;
+     }
+     int pid = 1;
+     for (int i = 0; i < processes; i++) {
+         int ppid = i == 0 ? 0 : pids[next_random() % (unsigned long long)i];
+         if (!write_process(root, pid, ppid)) {
+             free(pids);
+             return 1;
+         }
+         pids[i] = pid;
+         pid += 1 + (int)(next_random() % 8);
+     }
+     free(pids);
+     return 0;
+ }
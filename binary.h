@@ -0,0 +1,38 @@
+/**
+ * CPU and Memory Usage Tracker - binary snapshot format
+ * 
+ * Fixed-width records in native byte order, written by the headless
+ * collector's --format=binary and served by the metrics server's
+ * /snapshot. Every snapshot is one header followed by its rows.
+ */
+
+ #ifndef BINARY_H
+ #define BINARY_H
+ 
+ #include <stdint.h>
+ 
+ #define BINARY_MAGIC "CMTS"
+ #define BINARY_VERSION 1
+ #define BINARY_ROW_EXITED 0x1
+ #define BINARY_NAME_SIZE 32
+ 
+ /* Header written before the rows of every snapshot */
+ typedef struct {
+     char magic[4];                   // BINARY_MAGIC
+     uint32_t version;                // BINARY_VERSION
+     uint64_t sequence;
+     uint64_t timestamp_ns;           // Wall-clock time of the publish
+     uint32_t row_count;              // Live rows, then exited_count exited rows follow
+     uint32_t exited_count;
+ } BinaryHeader;
+ 
+ /* One fixed-width row */
+ typedef struct {
+     int32_t pid;
+     uint32_t flags;                  // BINARY_ROW_EXITED
+     float cpu_usage;
+     float memory_usage;
+     char name[BINARY_NAME_SIZE];     // Truncated and NUL-padded
+ } BinaryRow;
+ 
+ #endif /* BINARY_H */
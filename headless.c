@@ -0,0 +1,532 @@
+/**
+ * CPU and Memory Usage Tracker - headless collector
+ * 
+ * Runs the sampling core without a GUI and streams every snapshot to a
+ * file or stdout, as NDJSON or as fixed-width binary records.
+ */
+
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <pthread.h>
+ #include <signal.h>
+ #include <stdint.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ #include <unistd.h>
+ 
+ #ifdef _WIN32
+ #include <io.h>
+ #else
+ #include <sys/uio.h>
+ #endif
+ 
+ #include "binary.h"
+ #include "sampler.h"
+ 
+ #define OUTPUT_CHUNK_SIZE 65536  // Bytes per output buffer chunk
+ #define OUTPUT_MAX_CHUNKS 16     // Chunks gathered into one writev()
+ #define NDJSON_ROW_MAX 2048      // Upper bound of one NDJSON line, with a fully escaped name
+ 
+ #ifdef _WIN32
+ struct iovec {
+     void *iov_base;
+     size_t iov_len;
+ };
+ #endif
+ 
+ /* Output formats */
+ typedef enum {
+     FORMAT_NDJSON,
+     FORMAT_BINARY
+ } OutputFormat;
+ 
+ /*
+  * Output buffered in fixed chunks. Rows are formatted straight into the
+  * chunks and a whole snapshot normally goes out in a single writev().
+  */
+ typedef struct {
+     int fd;
+     char *chunks[OUTPUT_MAX_CHUNKS];
+     struct iovec iov[OUTPUT_MAX_CHUNKS];
+     int current;                     // Chunk being filled
+     size_t used;                     // Bytes used in the current chunk
+     int failed;                      // A write failed, stop collecting
+ } Output;
+ 
+ /* Global variables */
+ static OutputFormat output_format = FORMAT_NDJSON;
+ static const char *output_path = NULL;    // NULL writes to stdout
+ static unsigned long max_snapshots = 0;   // 0 runs until interrupted
+ static volatile sig_atomic_t stop_requested = 0;
+ static pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
+ static pthread_cond_t publish_cond = PTHREAD_COND_INITIALIZER;
+ static int snapshot_pending = 0;          // Protected by publish_lock
+ 
+ /* Function prototypes */
+ static int parse_args(int argc, char *argv[]);
+ static void on_signal(int signum);
+ static void on_snapshot_published(void *data);
+ static void output_init(Output *out, int fd);
+ static void output_free(Output *out);
+ static char *output_reserve(Output *out, size_t size);
+ static void output_flush(Output *out);
+ static void write_ndjson(Output *out, const Snapshot *snapshot);
+ static void write_binary(Output *out, const Snapshot *snapshot);
+ static void run_collector(Output *out);
+ #ifdef _WIN32
+ static ssize_t writev(int fd, const struct iovec *iov, int count);
+ #endif
+ 
+ int main(int argc, char *argv[]) {
+     if (!parse_args(argc, argv)) {
+         return 1;
+     }
+     
+     /* Open the output */
+     int fd = STDOUT_FILENO;
+     if (output_path != NULL) {
+         fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+         if (fd < 0) {
+             fprintf(stderr, "Cannot open %s: %s\n", output_path, strerror(errno));
+             return 1;
+         }
+     }
+ #ifdef _WIN32
+     _setmode(fd, _O_BINARY);
+ #else
+     signal(SIGPIPE, SIG_IGN);  // A closed reader shows up as a failed write instead
+ #endif
+     signal(SIGINT, on_signal);
+     signal(SIGTERM, on_signal);
+     
+     Output out;
+     output_init(&out, fd);
+     
+     if (!start_sampler(on_snapshot_published, NULL)) {
+         output_free(&out);
+         return 1;
+     }
+     run_collector(&out);
+     
+     /* Cleanup */
+     stop_sampler();
+     output_flush(&out);
+     output_free(&out);
+     free_snapshots();
+     if (output_path != NULL) {
+         close(fd);
+     }
+     
+     return out.failed ? 1 : 0;
+ }
+ 
+ /* Parse the collector and sampler options; returns 0 on a bad option */
+ static int parse_args(int argc, char *argv[]) {
+     for (int i = 1; i < argc; i++) {
+         // --headless: accepted so the GUI command line can be reused as is
+         if (strcmp(argv[i], "--headless") == 0) {
+             continue;
+         }
+         // --format=ndjson|binary: record format
+         if (strcmp(argv[i], "--format=ndjson") == 0) {
+             output_format = FORMAT_NDJSON;
+             continue;
+         }
+         if (strcmp(argv[i], "--format=binary") == 0) {
+             output_format = FORMAT_BINARY;
+             continue;
+         }
+         // --output=PATH: write to a file instead of stdout
+         if (strncmp(argv[i], "--output=", 9) == 0) {
+             output_path = argv[i] + 9;
+             continue;
+         }
+         // --count=N: stop after N snapshots
+         if (strncmp(argv[i], "--count=", 8) == 0) {
+             max_snapshots = strtoul(argv[i] + 8, NULL, 10);
+             continue;
+         }
+         // --interval=MS: sampling interval
+         if (strncmp(argv[i], "--interval=", 11) == 0 && atoi(argv[i] + 11) > 0) {
+             update_interval_ms = atoi(argv[i] + 11);
+             continue;
+         }
+         if (parse_sampler_option(argv[i])) {
+             continue;
+         }
+         fprintf(stderr, "Unknown option: %s\n", argv[i]);
+         return 0;
+     }
+     return 1;
+ }
+ 
+ /* SIGINT/SIGTERM handler */
+ static void on_signal(int signum) {
+     (void)signum;  // Unused parameter
+     
+     stop_requested = 1;
+ }
+ 
+ /* Sampler publish hook; wakes the collector loop */
+ static void on_snapshot_published(void *data) {
+     (void)data;  // Unused parameter
+     
+     pthread_mutex_lock(&publish_lock);
+     snapshot_pending = 1;
+     pthread_cond_signal(&publish_cond);
+     pthread_mutex_unlock(&publish_lock);
+ }
+ 
+ /* Allocate the output chunks */
+ static void output_init(Output *out, int fd) {
+     out->fd = fd;
+     for (int i = 0; i < OUTPUT_MAX_CHUNKS; i++) {
+         out->chunks[i] = NULL;
+     }
+     out->chunks[0] = malloc(OUTPUT_CHUNK_SIZE);
+     out->current = 0;
+     out->used = 0;
+     out->failed = out->chunks[0] == NULL;
+ }
+ 
+ /* Free the output chunks */
+ static void output_free(Output *out) {
+     for (int i = 0; i < OUTPUT_MAX_CHUNKS; i++) {
+         free(out->chunks[i]);
+         out->chunks[i] = NULL;
+     }
+ }
+ 
+ /*
+  * Return room for up to size bytes (at most OUTPUT_CHUNK_SIZE) at the end of
+  * the output, moving on to the next chunk or flushing them all when the current
+  * one is too full. The caller advances out->used by what it actually wrote.
+  * Returns NULL once the output has failed.
+  */
+ static char *output_reserve(Output *out, size_t size) {
+     if (out->failed) {
+         return NULL;
+     }
+     
+     if (out->used + size > OUTPUT_CHUNK_SIZE) {
+         out->iov[out->current].iov_base = out->chunks[out->current];
+         out->iov[out->current].iov_len = out->used;
+         out->current++;
+         out->used = 0;
+         
+         if (out->current == OUTPUT_MAX_CHUNKS) {
+             out->current--;
+             out->used = out->iov[out->current].iov_len;
+             output_flush(out);
+             if (out->failed) {
+                 return NULL;
+             }
+         } else if (out->chunks[out->current] == NULL) {
+             out->chunks[out->current] = malloc(OUTPUT_CHUNK_SIZE);
+             if (out->chunks[out->current] == NULL) {
+                 out->failed = 1;
+                 return NULL;
+             }
+         }
+     }
+     
+     return out->chunks[out->current] + out->used;
+ }
+ 
+ /* Write out every filled chunk with as few writev() calls as possible */
+ static void output_flush(Output *out) {
+     if (out->failed) {
+         return;
+     }
+     
+     out->iov[out->current].iov_base = out->chunks[out->current];
+     out->iov[out->current].iov_len = out->used;
+     
+     struct iovec *iov = out->iov;
+     int count = out->current + 1;
+     while (count > 0) {
+         if (iov->iov_len == 0) {
+             iov++;
+             count--;
+             continue;
+         }
+         
+         ssize_t written = writev(out->fd, iov, count);
+         if (written < 0) {
+             if (errno == EINTR) {
+                 continue;
+             }
+             fprintf(stderr, "Write failed: %s\n", strerror(errno));
+             out->failed = 1;
+             return;
+         }
+         
+         /* Skip what went out; a short write resumes inside a chunk */
+         while (count > 0 && (size_t)written >= iov->iov_len) {
+             written -= iov->iov_len;
+             iov++;
+             count--;
+         }
+         if (count > 0) {
+             iov->iov_base = (char*)iov->iov_base + written;
+             iov->iov_len -= written;
+         }
+     }
+     
+     out->current = 0;
+     out->used = 0;
+ }
+ 
+ /* Append an unsigned decimal; returns the end of the written text */
+ static char *format_ull(char *p, unsigned long long value) {
+     char digits[20];
+     int n = 0;
+     do {
+         digits[n++] = (char)('0' + value % 10);
+         value /= 10;
+     } while (value > 0);
+     while (n > 0) {
+         *p++ = digits[--n];
+     }
+     return p;
+ }
+ 
+ /* Append a non-negative value with two decimals */
+ static char *format_fixed2(char *p, double value) {
+     unsigned long long hundredths = value > 0 ? (unsigned long long)(value * 100.0 + 0.5) : 0;
+     p = format_ull(p, hundredths / 100);
+     *p++ = '.';
+     *p++ = (char)('0' + hundredths / 10 % 10);
+     *p++ = (char)('0' + hundredths % 10);
+     return p;
+ }
+ 
+ /* Append a quoted JSON string */
+ static char *format_json_string(char *p, const char *s) {
+     static const char hex[] = "0123456789abcdef";
+     
+     *p++ = '"';
+     for (; *s != '\0'; s++) {
+         unsigned char c = (unsigned char)*s;
+         if (c == '"' || c == '\\') {
+             *p++ = '\\';
+             *p++ = (char)c;
+         } else if (c < 0x20) {
+             memcpy(p, "\\u00", 4);
+             p[4] = hex[c >> 4];
+             p[5] = hex[c & 0xf];
+             p += 6;
+         } else {
+             *p++ = (char)c;
+         }
+     }
+     *p++ = '"';
+     return p;
+ }
+ 
+ /* Append one NDJSON line per row */
+ static void write_ndjson_rows(Output *out, const Snapshot *snapshot, const ProcessList *list, int exited) {
+     for (int i = 0; i < list->count; i++) {
+         const char *cgroup = NULL;
+         size_t reserve = NDJSON_ROW_MAX;
+         if (list->cgroup[i] >= 0) {
+             cgroup = snapshot->cgroups.paths + snapshot->cgroups.cgroups[list->cgroup[i]].path;
+             reserve += 6 * strlen(cgroup) + 16;  // Fully escaped
+         }
+         char *start = output_reserve(out, reserve);
+         if (start == NULL) {
+             return;
+         }
+         
+         char *p = start;
+         memcpy(p, "{\"seq\":", 7);
+         p = format_ull(p + 7, snapshot->sequence);
+         memcpy(p, ",\"ts\":", 6);
+         p = format_ull(p + 6, snapshot->timestamp_ns / 1000000ULL);
+         memcpy(p, ",\"pid\":", 7);
+         p = format_ull(p + 7, (unsigned long long)list->pid[i]);
+         memcpy(p, ",\"name\":", 8);
+         p = format_json_string(p + 8, list->name[i]);
+         if (list->ppid[i] > 0) {
+             memcpy(p, ",\"ppid\":", 8);
+             p = format_ull(p + 8, (unsigned long long)list->ppid[i]);
+         }
+         if (cgroup != NULL) {
+             memcpy(p, ",\"cgroup\":", 10);
+             p = format_json_string(p + 10, cgroup);
+         }
+         memcpy(p, ",\"cpu\":", 7);
+         p = format_fixed2(p + 7, list->cpu_usage[i]);
+         memcpy(p, ",\"mem\":", 7);
+         p = format_fixed2(p + 7, list->memory_usage[i]);
+         if (list->smaps[i] >= 0) {
+             // Sizes in kB, only for the processes whose smaps_rollup was read
+             const SmapsInfo *smaps = &list->smaps_info[list->smaps[i]];
+             memcpy(p, ",\"pss\":", 7);
+             p = format_ull(p + 7, smaps->pss_kb);
+             memcpy(p, ",\"uss\":", 7);
+             p = format_ull(p + 7, smaps->uss_kb);
+             memcpy(p, ",\"swap\":", 8);
+             p = format_ull(p + 8, smaps->swap_kb);
+             memcpy(p, ",\"anon\":", 8);
+             p = format_ull(p + 8, smaps->anon_kb);
+             memcpy(p, ",\"file\":", 8);
+             p = format_ull(p + 8, smaps->file_kb);
+         }
+         if (list->read_rate != NULL && list->read_rate[i] >= 0) {
+             // Per second, only with --rates and once the counters were read twice
+             memcpy(p, ",\"read_bps\":", 12);
+             p = format_ull(p + 12, (unsigned long long)(list->read_rate[i] + 0.5f));
+             memcpy(p, ",\"write_bps\":", 13);
+             p = format_ull(p + 13, (unsigned long long)(list->write_rate[i] + 0.5f));
+         }
+         if (list->voluntary_switch_rate != NULL && list->voluntary_switch_rate[i] >= 0) {
+             memcpy(p, ",\"vcsw\":", 8);
+             p = format_fixed2(p + 8, list->voluntary_switch_rate[i]);
+             memcpy(p, ",\"ivcsw\":", 9);
+             p = format_fixed2(p + 9, list->involuntary_switch_rate[i]);
+         }
+         if (list->major_fault_rate != NULL && list->major_fault_rate[i] >= 0) {
+             memcpy(p, ",\"majflt\":", 10);
+             p = format_fixed2(p + 10, list->major_fault_rate[i]);
+         }
+         if (exited) {
+             memcpy(p, ",\"exited\":true", 14);
+             p += 14;
+         }
+         *p++ = '}';
+         *p++ = '\n';
+         
+         out->used += (size_t)(p - start);
+     }
+ }
+ 
+ /* Rows to write: those selected by --sort, --filter, --user and --top, or all of them */
+ static const ProcessList *snapshot_rows(const Snapshot *snapshot) {
+     return snapshot->has_view ? &snapshot->view : &snapshot->list;
+ }
+ 
+ /* Write a snapshot as NDJSON, one object per process */
+ static void write_ndjson(Output *out, const Snapshot *snapshot) {
+     write_ndjson_rows(out, snapshot, snapshot_rows(snapshot), 0);
+     write_ndjson_rows(out, snapshot, &snapshot->exited, 1);
+ }
+ 
+ /* Append fixed-width binary rows */
+ static void write_binary_rows(Output *out, const ProcessList *list, uint32_t flags) {
+     for (int i = 0; i < list->count; i++) {
+         BinaryRow *row = (BinaryRow*)output_reserve(out, sizeof(BinaryRow));
+         if (row == NULL) {
+             return;
+         }
+         
+         memset(row, 0, sizeof(BinaryRow));
+         row->pid = list->pid[i];
+         row->flags = flags;
+         row->cpu_usage = (float)list->cpu_usage[i];
+         row->memory_usage = (float)list->memory_usage[i];
+         size_t name_len = strlen(list->name[i]);
+         memcpy(row->name, list->name[i], name_len < BINARY_NAME_SIZE ? name_len : BINARY_NAME_SIZE - 1);
+         
+         out->used += sizeof(BinaryRow);
+     }
+ }
+ 
+ /* Write a snapshot as a binary header followed by its rows */
+ static void write_binary(Output *out, const Snapshot *snapshot) {
+     BinaryHeader *header = (BinaryHeader*)output_reserve(out, sizeof(BinaryHeader));
+     if (header == NULL) {
+         return;
+     }
+     
+     memset(header, 0, sizeof(BinaryHeader));
+     memcpy(header->magic, BINARY_MAGIC, 4);
+     header->version = BINARY_VERSION;
+     header->sequence = snapshot->sequence;
+     header->timestamp_ns = snapshot->timestamp_ns;
+     header->row_count = (uint32_t)snapshot_rows(snapshot)->count;
+     header->exited_count = (uint32_t)snapshot->exited.count;
+     out->used += sizeof(BinaryHeader);
+     
+     write_binary_rows(out, snapshot_rows(snapshot), 0);
+     write_binary_rows(out, &snapshot->exited, BINARY_ROW_EXITED);
+ }
+ 
+ /*
+  * Write every new snapshot until interrupted, max_snapshots have been written
+  * or a replay ends. A writer that falls behind skips straight to the latest
+  * snapshot; a replay waits for it instead, so no frame is skipped.
+  */
+ static void run_collector(Output *out) {
+     unsigned long last_sequence = 0;
+     unsigned long written = 0;
+     unsigned long skipped = 0;
+     
+     pthread_mutex_lock(&publish_lock);
+     while (!stop_requested && !out->failed && (max_snapshots == 0 || written < max_snapshots)) {
+         if (!snapshot_pending) {
+             if (sampler_finished()) {
+                 break;  // A replay ran out of frames
+             }
+             
+             /* Wake up now and then to notice a signal */
+             struct timespec deadline;
+             clock_gettime(CLOCK_REALTIME, &deadline);
+             deadline.tv_nsec += 250000000L;
+             if (deadline.tv_nsec >= 1000000000L) {
+                 deadline.tv_sec++;
+                 deadline.tv_nsec -= 1000000000L;
+             }
+             pthread_cond_timedwait(&publish_cond, &publish_lock, &deadline);
+             continue;
+         }
+         snapshot_pending = 0;
+         pthread_mutex_unlock(&publish_lock);
+         
+         Snapshot *snapshot = snapshot_acquire();
+         if (snapshot != NULL && snapshot->sequence != last_sequence) {
+             if (last_sequence != 0) {
+                 skipped += snapshot->sequence - last_sequence - 1;
+             }
+             if (output_format == FORMAT_BINARY) {
+                 write_binary(out, snapshot);
+             } else {
+                 write_ndjson(out, snapshot);
+             }
+             output_flush(out);
+             last_sequence = snapshot->sequence;
+             written++;
+         }
+         if (snapshot != NULL) {
+             snapshot_consumed(snapshot);
+             snapshot_release(snapshot);
+         }
+         
+         pthread_mutex_lock(&publish_lock);
+     }
+     pthread_mutex_unlock(&publish_lock);
+     
+     if (skipped > 0) {
+         fprintf(stderr, "Skipped %lu snapshots the output could not keep up with\n", skipped);
+     }
+ }
+ 
+ #ifdef _WIN32
+ /* Gathered write for platforms without one */
+ static ssize_t writev(int fd, const struct iovec *iov, int count) {
+     ssize_t total = 0;
+     for (int i = 0; i < count; i++) {
+         int written = _write(fd, iov[i].iov_base, (unsigned int)iov[i].iov_len);
+         if (written < 0) {
+             return total > 0 ? total : -1;
+         }
+         total += written;
+         if ((size_t)written < iov[i].iov_len) {
+             break;
+         }
+     }
+     return total;
+ }
+ #endif
@@ -0,0 +1,336 @@
+/**
+ * CPU and Memory Usage Tracker - per-process usage history
+ * 
+ * Every process gets one fixed-size entry holding a ring per tier. Entries
+ * come from a pool capped by the memory budget; entries of exited processes
+ * are kept for inspection until their data ages out or the pool runs dry.
+ */
+
+ #include <sched.h>
+ #include <stdatomic.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #include "history.h"
+ 
+ #define HISTORY_RAW_SAMPLES 300
+ #define HISTORY_10S_SAMPLES 360
+ #define HISTORY_1MIN_SAMPLES HISTORY_MAX_SAMPLES
+ #define HISTORY_RETENTION_SECONDS (24 * 60 * 60)  // Dead entries are dropped after this
+ 
+ /* History of one process */
+ typedef struct {
+     int pid;
+     unsigned long long start_time;   // With the PID, identifies the process
+     int alive;
+     double death_time;               // Snapshot time in seconds when the process was first missed
+     HistoryRing rings[HISTORY_N_TIERS];
+     HistorySample samples[HISTORY_RAW_SAMPLES + HISTORY_10S_SAMPLES + HISTORY_1MIN_SAMPLES];
+ } HistoryEntry;
+ 
+ /* Global variables */
+ static atomic_uint history_sequence = 0;          // Odd while history_record() changes the index or rings
+ static HistoryEntry **history_index = NULL;       // Entries ordered by PID
+ static HistoryEntry **history_next_index = NULL;  // Built by history_record(), then swapped in
+ static int history_count = 0;
+ static HistoryEntry **free_entries = NULL;        // Entries ready for reuse
+ static int free_count = 0;
+ static HistoryEntry **dead_entries = NULL;        // Scratch for picking eviction victims
+ static int max_entries = 0;                       // Entries the budget allows, 0 when disabled
+ static int allocated_entries = 0;
+ 
+ /* Function prototypes */
+ static void ring_init(HistoryRing *ring, HistorySample *samples, int capacity, double bucket_seconds);
+ static void ring_push(HistoryRing *ring, double cpu, double mem);
+ static void ring_flush(HistoryRing *ring);
+ static void entry_reset(HistoryEntry *entry, int pid, unsigned long long start_time);
+ static void entry_append(HistoryEntry *entry, double now, double cpu, double mem);
+ static HistoryEntry *entry_claim(int pid, unsigned long long start_time);
+ static void evict_dead_entries(int wanted);
+ 
+ /*
+  * Size the entry pool to fit in budget_bytes, counting each entry's slots in
+  * the index arrays. Entries are allocated as processes appear, so the budget
+  * is a ceiling rather than an up-front allocation. Returns 0 on failure.
+  */
+ int history_init(size_t budget_bytes) {
+     size_t per_entry = sizeof(HistoryEntry) + 4 * sizeof(HistoryEntry*);
+     max_entries = (int)(budget_bytes / per_entry);
+     if (max_entries == 0) {
+         return 0;
+     }
+     
+     history_index = calloc(max_entries, sizeof(HistoryEntry*));  // Readers may look past the count
+     history_next_index = calloc(max_entries, sizeof(HistoryEntry*));
+     free_entries = malloc(max_entries * sizeof(HistoryEntry*));
+     dead_entries = malloc(max_entries * sizeof(HistoryEntry*));
+     if (history_index == NULL || history_next_index == NULL || free_entries == NULL || dead_entries == NULL) {
+         history_free();
+         return 0;
+     }
+     
+     return 1;
+ }
+ 
+ /* Free every entry once nothing reads the history any more */
+ void history_free(void) {
+     for (int i = 0; i < history_count; i++) {
+         free(history_index[i]);
+     }
+     for (int i = 0; i < free_count; i++) {
+         free(free_entries[i]);
+     }
+     free(history_index);
+     free(history_next_index);
+     free(free_entries);
+     free(dead_entries);
+     history_index = NULL;
+     history_next_index = NULL;
+     free_entries = NULL;
+     dead_entries = NULL;
+     history_count = 0;
+     free_count = 0;
+     max_entries = 0;
+     allocated_entries = 0;
+ }
+ 
+ /* Set up an empty ring over part of an entry's sample storage */
+ static void ring_init(HistoryRing *ring, HistorySample *samples, int capacity, double bucket_seconds) {
+     ring->samples = samples;
+     ring->capacity = capacity;
+     ring->count = 0;
+     ring->next = 0;
+     ring->bucket_seconds = bucket_seconds;
+     ring->bucket = -1;
+     ring->cpu_sum = 0;
+     ring->memory_sum = 0;
+     ring->pending = 0;
+ }
+ 
+ /* Append a sample, overwriting the oldest once the ring is full */
+ static void ring_push(HistoryRing *ring, double cpu, double mem) {
+     ring->samples[ring->next].cpu_usage = (float)cpu;
+     ring->samples[ring->next].memory_usage = (float)mem;
+     ring->next = ring->next + 1 == ring->capacity ? 0 : ring->next + 1;
+     if (ring->count < ring->capacity) {
+         ring->count++;
+     }
+ }
+ 
+ /* Push the average of the bucket being accumulated, if it has samples */
+ static void ring_flush(HistoryRing *ring) {
+     if (ring->pending > 0) {
+         ring_push(ring, ring->cpu_sum / ring->pending, ring->memory_sum / ring->pending);
+         ring->cpu_sum = 0;
+         ring->memory_sum = 0;
+         ring->pending = 0;
+     }
+ }
+ 
+ /* Start an empty history for a process */
+ static void entry_reset(HistoryEntry *entry, int pid, unsigned long long start_time) {
+     entry->pid = pid;
+     entry->start_time = start_time;
+     entry->alive = 1;
+     entry->death_time = 0;
+     ring_init(&entry->rings[HISTORY_TIER_RAW], entry->samples, HISTORY_RAW_SAMPLES, 0);
+     ring_init(&entry->rings[HISTORY_TIER_10S], entry->samples + HISTORY_RAW_SAMPLES,
+               HISTORY_10S_SAMPLES, 10);
+     ring_init(&entry->rings[HISTORY_TIER_1MIN], entry->samples + HISTORY_RAW_SAMPLES + HISTORY_10S_SAMPLES,
+               HISTORY_1MIN_SAMPLES, 60);
+ }
+ 
+ /* Record one tick; the coarser tiers push an average whenever a bucket boundary is crossed */
+ static void entry_append(HistoryEntry *entry, double now, double cpu, double mem) {
+     ring_push(&entry->rings[HISTORY_TIER_RAW], cpu, mem);
+     
+     for (int tier = HISTORY_TIER_RAW + 1; tier < HISTORY_N_TIERS; tier++) {
+         HistoryRing *ring = &entry->rings[tier];
+         long long bucket = (long long)(now / ring->bucket_seconds);
+         if (bucket != ring->bucket) {
+             ring_flush(ring);
+             ring->bucket = bucket;
+         }
+         ring->cpu_sum += cpu;
+         ring->memory_sum += mem;
+         ring->pending++;
+     }
+ }
+ 
+ /* Take an entry from the free list or the budget; NULL if the pool is exhausted */
+ static HistoryEntry *entry_claim(int pid, unsigned long long start_time) {
+     HistoryEntry *entry = NULL;
+     if (free_count > 0) {
+         entry = free_entries[--free_count];
+     } else if (allocated_entries < max_entries) {
+         entry = malloc(sizeof(HistoryEntry));
+         if (entry != NULL) {
+             allocated_entries++;
+         }
+     }
+     if (entry != NULL) {
+         entry_reset(entry, pid, start_time);
+     }
+     return entry;
+ }
+ 
+ /* Order dead entries by time of death, oldest first */
+ static int compare_death_times(const void *a, const void *b) {
+     double ta = (*(HistoryEntry* const*)a)->death_time;
+     double tb = (*(HistoryEntry* const*)b)->death_time;
+     return (ta > tb) - (ta < tb);
+ }
+ 
+ /* Return up to `wanted` of the longest-dead entries to the free list */
+ static void evict_dead_entries(int wanted) {
+     int dead_count = 0;
+     for (int i = 0; i < history_count; i++) {
+         if (!history_index[i]->alive) {
+             dead_entries[dead_count++] = history_index[i];
+         }
+     }
+     if (dead_count == 0) {
+         return;
+     }
+     
+     if (dead_count > wanted) {
+         qsort(dead_entries, dead_count, sizeof(HistoryEntry*), compare_death_times);
+         dead_count = wanted;
+     }
+     for (int i = 0; i < dead_count; i++) {
+         dead_entries[i]->pid = -1;
+         free_entries[free_count++] = dead_entries[i];
+     }
+     
+     int kept = 0;
+     for (int i = 0; i < history_count; i++) {
+         if (history_index[i]->pid != -1) {
+             history_index[kept++] = history_index[i];
+         }
+     }
+     history_count = kept;
+ }
+ 
+ /*
+  * Append a tick to the history. Both the index and list are ordered by PID,
+  * so one merge pass appends to live entries, marks missing processes dead
+  * and starts entries for new ones. An entry whose PID shows up again for a
+  * process with another start time, or after the PID was missed, is
+  * restarted for the new process. New processes the pool has no room for are
+  * retried on the next tick, after the longest-dead entries have been evicted.
+  */
+ void history_record(const ProcessList *list, unsigned long long timestamp_ns) {
+     if (max_entries == 0) {
+         return;
+     }
+     
+     double now = timestamp_ns / 1e9;  // Snapshot time, so a replay is bucketed as it was recorded
+     int old = 0;
+     int row = 0;
+     int count = 0;
+     int unserved = 0;
+     
+     // Readers copying while this runs see the sequence change and copy again
+     atomic_store_explicit(&history_sequence, atomic_load(&history_sequence) + 1, memory_order_relaxed);
+     atomic_thread_fence(memory_order_release);
+     
+     while (old < history_count || row < list->count) {
+         HistoryEntry *entry = old < history_count ? history_index[old] : NULL;
+         int at = row < list->count ? row : -1;  // Row to merge, -1 once all are merged
+         
+         if (at < 0 || (entry != NULL && entry->pid < list->pid[at])) {
+             /* Not sampled this tick */
+             old++;
+             if (entry->alive) {
+                 entry->alive = 0;
+                 entry->death_time = now;
+                 for (int tier = HISTORY_TIER_RAW + 1; tier < HISTORY_N_TIERS; tier++) {
+                     ring_flush(&entry->rings[tier]);
+                 }
+             }
+             if (now - entry->death_time > HISTORY_RETENTION_SECONDS) {
+                 free_entries[free_count++] = entry;
+                 continue;
+             }
+             history_next_index[count++] = entry;
+         } else if (entry == NULL || list->pid[at] < entry->pid) {
+             /* New process */
+             row++;
+             entry = entry_claim(list->pid[at], list->start_time[at]);
+             if (entry == NULL) {
+                 unserved++;
+                 continue;
+             }
+             entry_append(entry, now, list->cpu_usage[at], list->memory_usage[at]);
+             history_next_index[count++] = entry;
+         } else {
+             old++;
+             row++;
+             if (!entry->alive || entry->start_time != list->start_time[at]) {
+                 entry_reset(entry, list->pid[at], list->start_time[at]);  // PID reused
+             }
+             entry_append(entry, now, list->cpu_usage[at], list->memory_usage[at]);
+             history_next_index[count++] = entry;
+         }
+     }
+     
+     HistoryEntry **swap = history_index;
+     history_index = history_next_index;
+     history_next_index = swap;
+     history_count = count;
+     
+     if (unserved > 0) {
+         evict_dead_entries(unserved);
+     }
+     
+     atomic_store_explicit(&history_sequence, atomic_load(&history_sequence) + 1, memory_order_release);
+ }
+ 
+ /*
+  * Copy one tier of a PID's history into ring, pointing it at `samples`,
+  * which must have room for HISTORY_MAX_SAMPLES. Returns 0 if the PID has no
+  * history. Entries are never freed while the sampler runs, so a copy can
+  * race with history_record() safely; one that did is taken again, and the
+  * sampler never waits for readers.
+  */
+ int history_copy(int pid, int tier, HistoryRing *ring, HistorySample *samples) {
+     for (;;) {
+         unsigned int sequence = atomic_load_explicit(&history_sequence, memory_order_acquire);
+         if (sequence & 1) {
+             sched_yield();  // A tick is being recorded
+             continue;
+         }
+         
+         HistoryEntry **index = history_index;
+         int count = history_count < max_entries ? history_count : max_entries;
+         const HistoryEntry *entry = NULL;
+         int low = 0;
+         int high = count - 1;
+         while (low <= high) {
+             int mid = low + (high - low) / 2;
+             if (index[mid] == NULL) {
+                 break;  // Torn by history_record(); the sequence check retries
+             }
+             if (index[mid]->pid == pid) {
+                 entry = index[mid];
+                 break;
+             }
+             if (index[mid]->pid < pid) {
+                 low = mid + 1;
+             } else {
+                 high = mid - 1;
+             }
+         }
+         if (entry != NULL) {
+             *ring = entry->rings[tier];
+             int copied = ring->capacity < HISTORY_MAX_SAMPLES ? ring->capacity : HISTORY_MAX_SAMPLES;
+             memcpy(samples, ring->samples, copied * sizeof(HistorySample));
+             ring->samples = samples;
+         }
+         
+         atomic_thread_fence(memory_order_acquire);
+         if (atomic_load_explicit(&history_sequence, memory_order_relaxed) == sequence) {
+             return entry != NULL;
+         }
+     }
+ }
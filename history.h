@@ -0,0 +1,64 @@
+/**
+ * CPU and Memory Usage Tracker - per-process usage history
+ * 
+ * Fixed-memory CPU and memory time series for every process, averaged
+ * into coarser tiers as they age.
+ */
+
+ #ifndef HISTORY_H
+ #define HISTORY_H
+ 
+ #include <stddef.h>
+ 
+ #include "sampler.h"
+ 
+ #define HISTORY_DEFAULT_BUDGET (64u << 20)  // Bytes
+ #define HISTORY_MAX_SAMPLES 1440            // Samples in the longest ring
+ 
+ /* Downsampling tiers, finest first */
+ enum {
+     HISTORY_TIER_RAW,    // One sample per tick, the last 300 ticks (5 min at 1 s)
+     HISTORY_TIER_10S,    // 10 s averages for 1 h
+     HISTORY_TIER_1MIN,   // 1 min averages for 24 h
+     HISTORY_N_TIERS
+ };
+ 
+ typedef struct {
+     float cpu_usage;
+     float memory_usage;
+ } HistorySample;
+ 
+ /*
+  * Ring of one tier's samples. Readers get a copy from history_copy(), so
+  * they can keep it for as long as they like.
+  */
+ typedef struct {
+     HistorySample *samples;
+     int capacity;
+     int count;
+     int next;                 // Slot the next sample goes to
+     double bucket_seconds;    // Time covered by one sample, 0 for raw samples
+     long long bucket;         // Bucket being averaged
+     double cpu_sum;
+     double memory_sum;
+     int pending;              // Samples in the bucket being averaged
+ } HistoryRing;
+ 
+ /* Sample by age, 0 being the newest; age must be below ring->count */
+ static inline const HistorySample *history_sample(const HistoryRing *ring, int age) {
+     int index = ring->next - 1 - age;
+     if (index < 0) {
+         index += ring->capacity;
+     }
+     return &ring->samples[index];
+ }
+ 
+ /* Recording, from the sampler thread */
+ int history_init(size_t budget_bytes);
+ void history_record(const ProcessList *list, unsigned long long timestamp_ns);
+ void history_free(void);
+ 
+ /* Reading, from any thread */
+ int history_copy(int pid, int tier, HistoryRing *ring, HistorySample *samples);
+ 
+ #endif /* HISTORY_H */
@@ -5,82 +5,212 @@
  * of running processes with the ability to terminate them.
  */
 
+ #include <errno.h>
  #include <gtk/gtk.h>
- #include <pthread.h>
+ #include <stdatomic.h>
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
- #include <unistd.h>
  
- #ifdef _WIN32
- #include <windows.h>
- #include <psapi.h>
- #include <tlhelp32.h>
- #elif defined(__APPLE__)
- #include <sys/sysctl.h>
- #include <sys/types.h>
- #include <mach/mach.h>
- #include <mach/task.h>
- #include <mach/mach_init.h>
- #include <signal.h>
- #else /* Linux */
- #include <dirent.h>
- #include <signal.h>
- #include <sys/types.h>
+ #ifndef _WIN32
+ #include <unistd.h>
  #endif
  
- /* Type definitions */
+ #include "history.h"
+ #include "profile.h"
+ #include "rollup.h"
+ #include "sampler.h"
+ #include "view.h"
+ 
+ #define SPARKLINE_SAMPLES 60   // Raw history samples across a sparkline cell
+ #define SPARKLINE_WIDTH 80
+ #define SPARKLINE_HEIGHT 18
+ #define CORE_STRIP_SAMPLES 120  // Refreshes a core's strip chart shows, one pixel column each
+ #define CORE_STRIP_HEIGHT 14    // Including the rule under each strip
+ #define CORE_STRIP_GAP 8        // Between strips side by side
+ 
+ /* Columns of the process model */
+ enum {
+     PROCESS_MODEL_COL_PID,
+     PROCESS_MODEL_COL_NAME,
+     PROCESS_MODEL_COL_STATE,
+     PROCESS_MODEL_COL_CPU,
+     PROCESS_MODEL_COL_MEMORY,
+     PROCESS_MODEL_COL_PSS,          // The smaps_rollup columns are text, empty until read
+     PROCESS_MODEL_COL_USS,
+     PROCESS_MODEL_COL_SWAP,
+     PROCESS_MODEL_COL_ANON,
+     PROCESS_MODEL_COL_FILE,
+     PROCESS_MODEL_COL_READ,         // The rate columns are text too, empty where not read
+     PROCESS_MODEL_COL_WRITE,
+     PROCESS_MODEL_COL_VOLUNTARY,
+     PROCESS_MODEL_COL_INVOLUNTARY,
+     PROCESS_MODEL_COL_MAJOR_FAULTS,
+     PROCESS_MODEL_N_COLUMNS
+ };
+ 
+ /* Row signals emitted while merging a snapshot into the process model */
+ enum {
+     PROCESS_MODEL_ROW_INSERTED,
+     PROCESS_MODEL_ROW_DELETED,
+     PROCESS_MODEL_ROW_CHANGED,
+     PROCESS_MODEL_ROW_HAS_CHILD_TOGGLED
+ };
+ 
+ /* Columns of the tree window's store */
+ enum {
+     TREE_COL_KEY,               // PID or cgroup path, unique in the tree
+     TREE_COL_NAME,
+     TREE_COL_PID,
+     TREE_COL_PROCESSES,
+     TREE_COL_CPU,
+     TREE_COL_MEMORY,
+     TREE_COL_KERNEL_CPU,        // The cgroup's own counters, as text, empty where unknown
+     TREE_COL_KERNEL_MEMORY,
+     TREE_COL_START_TIME,        // Hidden; identifies the process when it is terminated
+     TREE_N_COLUMNS
+ };
+ 
+ /* Hierarchies the tree window shows */
+ enum {
+     TREE_MODE_PROCESSES,
+     TREE_MODE_CGROUPS
+ };
+ 
+ /* Metrics plotted from the process history */
+ enum {
+     HISTORY_METRIC_CPU,
+     HISTORY_METRIC_MEMORY
+ };
+ 
+ /* Process history window, at most one open at a time */
  typedef struct {
+     GtkWidget *window;    // NULL while closed
+     GtkWidget *graph;
      int pid;
-     char name[256];
+     int tier;             // HISTORY_TIER_* being shown
+ } HistoryWindow;
+ 
+ /* Row of the tree window, as last set in its store */
+ typedef struct {
+     GtkTreeIter iter;     // Store iters persist until their row is removed
+     char *parent;         // Key of the parent row, NULL at the top level
+     char *name;
+     guint generation;     // Last update that had this row
+     int processes;
      double cpu_usage;
      double memory_usage;
- } ProcessInfo;
+     double kernel_cpu_usage;
+     double kernel_memory_usage;
+ } TreeNode;
  
+ /* One row of the tree window, read from a snapshot */
  typedef struct {
-     ProcessInfo *processes;
-     int count;
-     int capacity;
- } ProcessList;
+     const char *key;
+     char pid_key[16];     // key for a process row
+     int parent;           // Row of the parent in the same snapshot, -1 at the top level
+     const char *name;
+     int pid;              // 0 for a cgroup
+     unsigned long long start_time;
+     int processes;
+     double cpu_usage;
+     double memory_usage;
+     double kernel_cpu_usage;
+     double kernel_memory_usage;
+ } TreeRow;
+ 
+ /* Process tree and cgroup window, at most one open at a time */
+ typedef struct {
+     GtkWidget *window;    // NULL while closed
+     GtkWidget *view;
+     GtkTreeStore *store;
+     GtkWidget *kill_button;
+     GtkTreeViewColumn *pid_column;
+     GtkTreeViewColumn *kernel_columns[2];
+     GHashTable *nodes;    // Key to TreeNode of every row in the store
+     int mode;             // TREE_MODE_*
+     guint generation;
+ } TreeWindow;
+ 
+ /*
+  * Host panel above the process list. The strip charts of all cores live in
+  * one cached surface, stacked top to bottom, whose columns form a ring: each
+  * refresh draws one new column over the oldest, and the panel is drawn by
+  * blitting the ring in two pieces per column of strips, so neither depends
+  * on how much history is shown.
+  */
+ typedef struct {
+     GtkWidget *area;
+     GtkWidget *summary;         // Total CPU and memory, as text
+     cairo_surface_t *strips;    // CORE_STRIP_SAMPLES wide, CORE_STRIP_HEIGHT per core; NULL before the first sample
+     int num_cpus;               // Strips in the surface
+     int head;                   // Column the next sample goes in, holding the oldest one until then
+     int columns;                // Strips side by side at the current width
+     unsigned long sequence;     // Snapshot of the newest column
+ } SystemPanel;
+ 
+ #define PROCESS_TYPE_MODEL (process_model_get_type())
+ G_DECLARE_FINAL_TYPE(ProcessModel, process_model, PROCESS, MODEL, GObject)
+ 
+ #define SPARKLINE_TYPE_RENDERER (sparkline_renderer_get_type())
+ G_DECLARE_FINAL_TYPE(SparklineRenderer, sparkline_renderer, SPARKLINE, RENDERER, GtkCellRenderer)
  
  /* Global variables */
  GtkWidget *process_view;
- GtkListStore *process_store;
- ProcessList process_list;
- pthread_t update_thread;
- pthread_mutex_t data_mutex;
- int update_interval_ms = 2000;  // Default update interval
- gboolean running = TRUE;
+ ProcessModel *process_model;
+ atomic_int view_update_pending = 0;  // A populate_process_view() idle is queued
+ HistoryWindow history_window = { NULL, NULL, 0, HISTORY_TIER_RAW };
+ SystemPanel system_panel = { NULL, NULL, NULL, 0, 0, 1, 0 };
+ TreeWindow tree_window = { NULL, NULL, NULL, NULL, NULL, { NULL, NULL }, NULL, TREE_MODE_PROCESSES, 0 };
+ GtkWidget *status_bar;
+ GtkWidget *profile_window = NULL;
+ GtkWidget *profile_label = NULL;  // Table in the profile window, NULL while it is closed
+ atomic_ullong published_at_ns = 0;  // When the queued populate_process_view() was requested
+ int pending_expand_pid = -1;  // Process to expand once its thread rows arrive
+ GtkTreeViewColumn *sort_columns[VIEW_N_SORT_KEYS];  // Column header of each sort key
  
  /* Function prototypes */
- static void init_process_list(ProcessList *list);
- static void clear_process_list(ProcessList *list);
- static void add_process(ProcessList *list, int pid, const char *name, double cpu, double mem);
- static void update_process_data();
- static void *update_thread_func(void *data);
+ static ProcessModel *process_model_new(void);
+ static void process_model_set_snapshot(ProcessModel *model, Snapshot *snapshot);
+ static int process_model_find(ProcessModel *model, int pid);
+ static gboolean process_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                              GtkTreeIter *parent, gint n);
+ static GtkCellRenderer *sparkline_renderer_new(int metric);
+ static void sparkline_cell_data(GtkTreeViewColumn *column, GtkCellRenderer *cell,
+                                 GtkTreeModel *model, GtkTreeIter *iter, gpointer data);
+ static void show_history_window(int pid, const char *name);
+ static GtkWidget *system_panel_new(void);
+ static void system_panel_update(const Snapshot *snapshot);
+ static void update_profile_display(void);
+ static void on_profile_button_clicked(GtkWidget *widget, gpointer data);
+ static void tree_window_row(const Snapshot *snapshot, int index, TreeRow *row);
+ static TreeNode *tree_window_ensure(const Snapshot *snapshot, int index, int depth);
+ static void tree_window_forget(GtkTreeIter *iter);
+ static void tree_window_update(const Snapshot *snapshot);
+ static void on_tree_button_clicked(GtkWidget *widget, gpointer data);
+ static void on_snapshot_published(void *data);
  static gboolean populate_process_view(gpointer data);  // Changed return type to gboolean
- static void kill_process(int pid);
  static void on_kill_button_clicked(GtkWidget *widget, gpointer data);
  static void on_refresh_button_clicked(GtkWidget *widget, gpointer data);
  static void on_interval_changed(GtkSpinButton *spinbutton, gpointer data);
  static void on_row_selected(GtkTreeSelection *selection, gpointer data);
- 
- /* Platform-specific functions */
- #ifdef _WIN32
- static void get_win_processes(ProcessList *list);
- #elif defined(__APPLE__)
- static void get_mac_processes(ProcessList *list);
- #else
- static void get_linux_processes(ProcessList *list);
- #endif
+ static void on_row_activated(GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer data);
+ static gboolean on_test_expand_row(GtkTreeView *view, GtkTreeIter *iter, GtkTreePath *path, gpointer data);
+ static void on_row_collapsed(GtkTreeView *view, GtkTreeIter *iter, GtkTreePath *path, gpointer data);
+ static void set_sort_column(GtkTreeViewColumn *column, ViewSortKey key);
+ static void update_sort_indicators(void);
+ static void on_column_clicked(GtkTreeViewColumn *column, gpointer data);
+ static void on_filter_changed(GtkSearchEntry *entry, gpointer data);
+ static void on_filter_regex_toggled(GtkToggleButton *button, gpointer data);
+ static void on_mine_toggled(GtkToggleButton *button, gpointer data);
+ static void on_top_changed(GtkSpinButton *spinbutton, gpointer data);
+ static void parse_args(int argc, char *argv[]);
  
  int main(int argc, char *argv[]) {
      /* Initialize GTK */
      gtk_init(&argc, &argv);
-     
-     /* Initialize process list and mutex */
-     init_process_list(&process_list);
-     pthread_mutex_init(&data_mutex, NULL);
+     history_budget = HISTORY_DEFAULT_BUDGET;
+     parse_args(argc, argv);
      
      /* Create the main window */
      GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -110,12 +240,58 @@
      g_signal_connect(interval_spin, "value-changed", G_CALLBACK(on_interval_changed), NULL);
      gtk_box_pack_start(GTK_BOX(control_box), interval_spin, FALSE, FALSE, 5);
      
+     /* Self-profiling details */
+     GtkWidget *profile_btn = gtk_button_new_with_label("Profile");
+     g_signal_connect(profile_btn, "clicked", G_CALLBACK(on_profile_button_clicked), NULL);
+     gtk_box_pack_start(GTK_BOX(control_box), profile_btn, FALSE, FALSE, 5);
+     
+     /* Process tree and cgroup rollups */
+     GtkWidget *tree_btn = gtk_button_new_with_label("Tree");
+     g_signal_connect(tree_btn, "clicked", G_CALLBACK(on_tree_button_clicked), NULL);
+     gtk_box_pack_start(GTK_BOX(control_box), tree_btn, FALSE, FALSE, 5);
+     
      /* Kill button */
      GtkWidget *kill_btn = gtk_button_new_with_label("Terminate Process");
      gtk_widget_set_sensitive(kill_btn, FALSE);  // Disabled until a process is selected
      g_signal_connect(kill_btn, "clicked", G_CALLBACK(on_kill_button_clicked), NULL);
      gtk_box_pack_end(GTK_BOX(control_box), kill_btn, FALSE, FALSE, 5);
      
+     /* View spec: the sampler filters, sorts and trims the rows before the view sees them */
+     ViewSpec spec;
+     view_get_spec(&spec);
+     GtkWidget *filter_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+     gtk_box_pack_start(GTK_BOX(main_box), filter_box, FALSE, FALSE, 0);
+     
+     GtkWidget *filter_entry = gtk_search_entry_new();
+     gtk_entry_set_placeholder_text(GTK_ENTRY(filter_entry), "Filter by name");
+     gtk_entry_set_text(GTK_ENTRY(filter_entry), spec.filter);
+     g_signal_connect(filter_entry, "search-changed", G_CALLBACK(on_filter_changed), NULL);
+     gtk_box_pack_start(GTK_BOX(filter_box), filter_entry, TRUE, TRUE, 5);
+     
+     GtkWidget *regex_check = gtk_check_button_new_with_label("Regex");
+     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(regex_check), spec.filter_regex);
+     g_signal_connect(regex_check, "toggled", G_CALLBACK(on_filter_regex_toggled), NULL);
+     gtk_box_pack_start(GTK_BOX(filter_box), regex_check, FALSE, FALSE, 5);
+     
+ #ifndef _WIN32
+     GtkWidget *mine_check = gtk_check_button_new_with_label("My processes only");
+     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(mine_check), spec.uid >= 0 && spec.uid == (int)getuid());
+     g_signal_connect(mine_check, "toggled", G_CALLBACK(on_mine_toggled), NULL);
+     gtk_box_pack_start(GTK_BOX(filter_box), mine_check, FALSE, FALSE, 5);
+ #endif
+     
+     GtkWidget *top_label = gtk_label_new("Show top:");
+     gtk_box_pack_start(GTK_BOX(filter_box), top_label, FALSE, FALSE, 5);
+     
+     GtkWidget *top_spin = gtk_spin_button_new_with_range(0, 100000, 10);
+     gtk_spin_button_set_value(GTK_SPIN_BUTTON(top_spin), spec.limit);
+     gtk_widget_set_tooltip_text(top_spin, "Rows to show after sorting, 0 for all");
+     g_signal_connect(top_spin, "value-changed", G_CALLBACK(on_top_changed), NULL);
+     gtk_box_pack_start(GTK_BOX(filter_box), top_spin, FALSE, FALSE, 5);
+     
+     /* Host-wide CPU and memory, to tell a saturated machine from one busy process */
+     gtk_box_pack_start(GTK_BOX(main_box), system_panel_new(), FALSE, FALSE, 0);
+     
      /* Create the process list view */
      GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
      gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
@@ -123,15 +299,11 @@
                                     GTK_POLICY_AUTOMATIC);
      gtk_box_pack_start(GTK_BOX(main_box), scroll, TRUE, TRUE, 0);
      
-     /* Create the list store model */
-     process_store = gtk_list_store_new(4,
-                                       G_TYPE_INT,      // PID
-                                       G_TYPE_STRING,   // Process name
-                                       G_TYPE_DOUBLE,   // CPU usage %
-                                       G_TYPE_DOUBLE);  // Memory usage %
+     /* Create the process model; it reads rows straight from the published snapshot */
+     process_model = process_model_new();
      
      /* Create the tree view */
-     process_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(process_store));
+     process_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(process_model));
      
      /* Add columns */
      GtkCellRenderer *renderer;
@@ -140,32 +312,109 @@
      renderer = gtk_cell_renderer_text_new();
      column = gtk_tree_view_column_new_with_attributes("PID",
                                                       renderer,
-                                                      "text", 0,
+                                                      "text", PROCESS_MODEL_COL_PID,
                                                       NULL);
+     set_sort_column(column, VIEW_SORT_PID);
      gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
      
      renderer = gtk_cell_renderer_text_new();
      column = gtk_tree_view_column_new_with_attributes("Process Name",
                                                       renderer,
-                                                      "text", 1,
+                                                      "text", PROCESS_MODEL_COL_NAME,
                                                       NULL);
      gtk_tree_view_column_set_expand(column, TRUE);
+     set_sort_column(column, VIEW_SORT_NAME);
+     gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
+     
+     renderer = gtk_cell_renderer_text_new();
+     column = gtk_tree_view_column_new_with_attributes("State",
+                                                      renderer,
+                                                      "text", PROCESS_MODEL_COL_STATE,
+                                                      NULL);
      gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
      
      renderer = gtk_cell_renderer_text_new();
      column = gtk_tree_view_column_new_with_attributes("CPU %",
                                                       renderer,
-                                                      "text", 2,
+                                                      "text", PROCESS_MODEL_COL_CPU,
                                                       NULL);
+     set_sort_column(column, VIEW_SORT_CPU);
      gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
      
+     if (history_budget > 0) {
+         renderer = sparkline_renderer_new(HISTORY_METRIC_CPU);
+         column = gtk_tree_view_column_new_with_attributes("CPU History", renderer, NULL);
+         gtk_tree_view_column_set_cell_data_func(column, renderer, sparkline_cell_data, NULL, NULL);
+         gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
+     }
+     
      renderer = gtk_cell_renderer_text_new();
      column = gtk_tree_view_column_new_with_attributes("Memory %",
                                                       renderer,
-                                                      "text", 3,
+                                                      "text", PROCESS_MODEL_COL_MEMORY,
                                                       NULL);
+     set_sort_column(column, VIEW_SORT_MEMORY);
      gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
      
+     if (history_budget > 0) {
+         renderer = sparkline_renderer_new(HISTORY_METRIC_MEMORY);
+         column = gtk_tree_view_column_new_with_attributes("Memory History", renderer, NULL);
+         gtk_tree_view_column_set_cell_data_func(column, renderer, sparkline_cell_data, NULL, NULL);
+         gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
+         
+         /* Double-click a row for its full history */
+         g_signal_connect(process_view, "row-activated", G_CALLBACK(on_row_activated), NULL);
+     }
+     
+     /* Memory breakdown of the largest processes, from smaps_rollup */
+     static const char *smaps_titles[] = { "PSS", "USS", "Swap", "Anon", "File" };
+     for (int i = 0; i < (int)G_N_ELEMENTS(smaps_titles); i++) {
+         renderer = gtk_cell_renderer_text_new();
+         g_object_set(renderer, "xalign", 1.0, NULL);
+         column = gtk_tree_view_column_new_with_attributes(smaps_titles[i],
+                                                          renderer,
+                                                          "text", PROCESS_MODEL_COL_PSS + i,
+                                                          NULL);
+         if (i == 0) {
+             set_sort_column(column, VIEW_SORT_PSS);
+         }
+         gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
+     }
+     
+     /* Per-second rates, only for the columns turned on with --rates */
+     static const struct {
+         const char *title;
+         int model_column;
+         int rate;
+         ViewSortKey sort_key;
+     } rate_titles[] = {
+         { "Read", PROCESS_MODEL_COL_READ, RATE_IO, VIEW_SORT_IO },
+         { "Write", PROCESS_MODEL_COL_WRITE, RATE_IO, VIEW_N_SORT_KEYS },
+         { "Voluntary CS/s", PROCESS_MODEL_COL_VOLUNTARY, RATE_CTXSW, VIEW_SORT_CTXSW },
+         { "Involuntary CS/s", PROCESS_MODEL_COL_INVOLUNTARY, RATE_CTXSW, VIEW_N_SORT_KEYS },
+         { "Major Faults/s", PROCESS_MODEL_COL_MAJOR_FAULTS, RATE_FAULTS, VIEW_SORT_FAULTS }
+     };
+     for (int i = 0; i < (int)G_N_ELEMENTS(rate_titles); i++) {
+         if (!(rate_columns & rate_titles[i].rate)) {
+             continue;
+         }
+         renderer = gtk_cell_renderer_text_new();
+         g_object_set(renderer, "xalign", 1.0, NULL);
+         column = gtk_tree_view_column_new_with_attributes(rate_titles[i].title,
+                                                          renderer,
+                                                          "text", rate_titles[i].model_column,
+                                                          NULL);
+         if (rate_titles[i].sort_key != VIEW_N_SORT_KEYS) {
+             set_sort_column(column, rate_titles[i].sort_key);
+         }
+         gtk_tree_view_append_column(GTK_TREE_VIEW(process_view), column);
+     }
+     update_sort_indicators();
+     
+     /* Thread rows are read only for the processes that are expanded */
+     g_signal_connect(process_view, "test-expand-row", G_CALLBACK(on_test_expand_row), NULL);
+     g_signal_connect(process_view, "row-collapsed", G_CALLBACK(on_row_collapsed), NULL);
+     
      /* Set up row selection */
      GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(process_view));
      gtk_tree_selection_set_mode(selection, GTK_SELECTION_SINGLE);
@@ -173,129 +422,1483 @@
      
      gtk_container_add(GTK_CONTAINER(scroll), process_view);
      
+     /* Status bar with the sampler's own timings */
+     status_bar = gtk_statusbar_new();
+     gtk_box_pack_start(GTK_BOX(main_box), status_bar, FALSE, FALSE, 0);
+     
      /* Show all widgets */
      gtk_widget_show_all(window);
      
-     /* Start the update thread */
-     pthread_create(&update_thread, NULL, update_thread_func, NULL);
+     /* Start the sampler thread */
+     if (!start_sampler(on_snapshot_published, process_model)) {
+         return 1;
+     }
      
      /* Start the GTK main loop */
      gtk_main();
      
      /* Cleanup */
-     running = FALSE;
-     pthread_join(update_thread, NULL);
-     pthread_mutex_destroy(&data_mutex);
-     clear_process_list(&process_list);
+     stop_sampler();
+     g_object_unref(process_model);
+     free_snapshots();
+     if (system_panel.strips != NULL) {
+         cairo_surface_destroy(system_panel.strips);
+     }
      
      return 0;
  }
  
- /* Initialize the process list */
- static void init_process_list(ProcessList *list) {
-     list->capacity = 100;
-     list->count = 0;
-     list->processes = (ProcessInfo*)malloc(list->capacity * sizeof(ProcessInfo));
+ /* Parse the command-line options left over after gtk_init() */
+ static void parse_args(int argc, char *argv[]) {
+     for (int i = 1; i < argc; i++) {
+         if (!parse_sampler_option(argv[i])) {
+             fprintf(stderr, "Ignoring unknown option: %s\n", argv[i]);
+         }
+     }
+ }
+ 
+ /*
+  * GtkTreeModel that reads its rows straight from published snapshots. The
+  * visible rows are the snapshot's view rows when the sampler selected them
+  * for a view spec, otherwise all of its rows in PID order. They are kept as
+  * an array of pointers into the current snapshot or, while a new one is
+  * merged in, the previous one, so every row signal is emitted against a
+  * consistent model. A process row's children are its thread rows, merged
+  * one level down while the process row is `child_row`.
+  */
+ typedef struct {
+     const ProcessList *list;    // Snapshot list holding the row
+     int index;                  // Row in list
+     const ThreadInfo *threads;  // The process's thread rows, from the same snapshot as list
+ } ProcessModelRow;
+ 
+ /* Row key used to pair the rows of two snapshots */
+ typedef struct {
+     int pid;
+     int index;
+ } ProcessModelKey;
+ 
+ struct _ProcessModel {
+     GObject parent_instance;
+     Snapshot *snapshot;     // Referenced
+     Snapshot *previous;     // Referenced during a merge only
+     ProcessModelRow *rows;  // Visible rows
+     int count;
+     int kept;               // While deleting, rows [0, kept) are followed by rows [next_old, count)
+     int next_old;           // -1 outside the delete pass
+     int capacity;           // Of rows and the merge scratch below
+     ProcessModelRow *scratch;
+     ProcessModelKey *old_keys;
+     ProcessModelKey *new_keys;
+     int *old_to_new;        // New index of each old row, -1 if it is gone
+     int *new_order;         // Current position of each new row, as rows_reordered wants it
+     int child_row;          // Row whose threads are being merged, -1 otherwise
+     const ThreadInfo *child_old;  // Its threads in the previous snapshot
+     int child_old_count;
+     int child_merged;       // New threads visible under child_row
+     int child_old_next;     // First old thread still visible under child_row
+     gint stamp;
+ };
+ 
+ static void process_model_tree_model_init(GtkTreeModelIface *iface);
+ 
+ G_DEFINE_TYPE_WITH_CODE(ProcessModel, process_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, process_model_tree_model_init))
+ 
+ /* Number of rows currently visible through the model */
+ static int process_model_n_rows(ProcessModel *model) {
+     if (model->next_old >= 0) {
+         return model->kept + model->count - model->next_old;
+     }
+     return model->count;
+ }
+ 
+ /* Visible row at an index, or NULL if out of range */
+ static const ProcessModelRow *process_model_entry(ProcessModel *model, int index) {
+     if (index < 0 || index >= process_model_n_rows(model)) {
+         return NULL;
+     }
+     if (model->next_old >= 0 && index >= model->kept) {
+         index += model->next_old - model->kept;
+     }
+     return &model->rows[index];
+ }
+ 
+ /* A row's memory breakdown, or NULL where its smaps_rollup was not read */
+ static const SmapsInfo *process_model_smaps(const ProcessModelRow *row) {
+     int entry = row->list->smaps[row->index];
+     return entry >= 0 ? &row->list->smaps_info[entry] : NULL;
+ }
+ 
+ /* A row's value in a rate column, -1 where unknown or the column is not collected */
+ static float process_model_rate(const float *column, int index) {
+     return column != NULL ? column[index] : -1;
+ }
+ 
+ /* Number of thread rows visible under a row */
+ static int process_model_n_threads(ProcessModel *model, int index) {
+     const ProcessModelRow *row = process_model_entry(model, index);
+     if (row == NULL) {
+         return 0;
+     }
+     if (index == model->child_row) {
+         return model->child_merged + model->child_old_count - model->child_old_next;
+     }
+     return row->list->thread_rows[row->index];
+ }
+ 
+ /* Thread row under a visible row, or NULL if out of range */
+ static const ThreadInfo *process_model_thread(ProcessModel *model, int index, int child) {
+     if (child < 0 || child >= process_model_n_threads(model, index)) {
+         return NULL;
+     }
+     if (index == model->child_row && child >= model->child_merged) {
+         return &model->child_old[model->child_old_next + child - model->child_merged];
+     }
+     return &process_model_entry(model, index)->threads[child];
+ }
+ 
+ /* Whether a row shows an expander: it has thread rows, or threads that can be read on expansion */
+ static gboolean process_model_has_threads(ProcessModel *model, int index) {
+     const ProcessModelRow *row = process_model_entry(model, index);
+     return row != NULL && (process_model_n_threads(model, index) > 0 || row->list->num_threads[row->index] > 1);
+ }
+ 
+ /* Whether an iter points at a thread row rather than a process row */
+ static gboolean process_model_is_thread(GtkTreeIter *iter) {
+     return iter->user_data2 != NULL;
+ }
+ 
+ static GtkTreeModelFlags process_model_get_flags(GtkTreeModel *tree_model) {
+     (void)tree_model;  // Unused parameter
+     return 0;
+ }
+ 
+ static gint process_model_get_n_columns(GtkTreeModel *tree_model) {
+     (void)tree_model;  // Unused parameter
+     return PROCESS_MODEL_N_COLUMNS;
+ }
+ 
+ static GType process_model_get_column_type(GtkTreeModel *tree_model, gint index) {
+     (void)tree_model;  // Unused parameter
+     
+     switch (index) {
+     case PROCESS_MODEL_COL_PID:
+         return G_TYPE_INT;
+     case PROCESS_MODEL_COL_NAME:
+     case PROCESS_MODEL_COL_STATE:
+     case PROCESS_MODEL_COL_PSS:
+     case PROCESS_MODEL_COL_USS:
+     case PROCESS_MODEL_COL_SWAP:
+     case PROCESS_MODEL_COL_ANON:
+     case PROCESS_MODEL_COL_FILE:
+     case PROCESS_MODEL_COL_READ:
+     case PROCESS_MODEL_COL_WRITE:
+     case PROCESS_MODEL_COL_VOLUNTARY:
+     case PROCESS_MODEL_COL_INVOLUNTARY:
+     case PROCESS_MODEL_COL_MAJOR_FAULTS:
+         return G_TYPE_STRING;
+     default:
+         return G_TYPE_DOUBLE;
+     }
  }
  
- /* Clear the process list */
- static void clear_process_list(ProcessList *list) {
-     free(list->processes);
-     list->processes = NULL;
-     list->count = 0;
-     list->capacity = 0;
+ /* Point an iter at a visible row index */
+ static gboolean process_model_set_iter(ProcessModel *model, GtkTreeIter *iter, int index) {
+     if (index < 0 || index >= process_model_n_rows(model)) {
+         iter->stamp = 0;
+         return FALSE;
+     }
+     iter->stamp = model->stamp;
+     iter->user_data = GINT_TO_POINTER(index);
+     iter->user_data2 = NULL;
+     return TRUE;
  }
  
- /* Add a process to the list */
- static void add_process(ProcessList *list, int pid, const char *name, double cpu, double mem) {
-     if (list->count >= list->capacity) {
-         list->capacity *= 2;
-         list->processes = (ProcessInfo*)realloc(list->processes, list->capacity * sizeof(ProcessInfo));
+ /* Point an iter at a thread row; user_data2 holds the thread index plus one */
+ static gboolean process_model_set_child_iter(ProcessModel *model, GtkTreeIter *iter, int index, int child) {
+     if (child < 0 || child >= process_model_n_threads(model, index)) {
+         iter->stamp = 0;
+         return FALSE;
      }
+     iter->stamp = model->stamp;
+     iter->user_data = GINT_TO_POINTER(index);
+     iter->user_data2 = GINT_TO_POINTER(child + 1);
+     return TRUE;
+ }
+ 
+ static gboolean process_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path) {
+     ProcessModel *model = PROCESS_MODEL(tree_model);
+     int depth = gtk_tree_path_get_depth(path);
+     int *indices = gtk_tree_path_get_indices(path);
      
-     list->processes[list->count].pid = pid;
-     strncpy(list->processes[list->count].name, name, 254);
-     list->processes[list->count].name[254] = '\0';
-     list->processes[list->count].cpu_usage = cpu;
-     list->processes[list->count].memory_usage = mem;
-     list->count++;
+     if (depth == 1) {
+         return process_model_set_iter(model, iter, indices[0]);
+     }
+     if (depth == 2) {
+         return process_model_set_child_iter(model, iter, indices[0], indices[1]);
+     }
+     iter->stamp = 0;
+     return FALSE;
+ }
+ 
+ static GtkTreePath *process_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+     g_return_val_if_fail(iter->stamp == PROCESS_MODEL(tree_model)->stamp, NULL);
+     if (process_model_is_thread(iter)) {
+         return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data),
+                                               GPOINTER_TO_INT(iter->user_data2) - 1, -1);
+     }
+     return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
  }
  
- /* Update process data */
- static void update_process_data() {
-     pthread_mutex_lock(&data_mutex);
+ static void process_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value) {
+     ProcessModel *model = PROCESS_MODEL(tree_model);
+     int index = GPOINTER_TO_INT(iter->user_data);
+     char state[2] = { 0, 0 };
      
-     /* Clear the previous list */
-     process_list.count = 0;
+     g_value_init(value, process_model_get_column_type(tree_model, column));
+     if (iter->stamp != model->stamp) {
+         return;
+     }
      
-     /* Get platform-specific process data */
- #ifdef _WIN32
-     get_win_processes(&process_list);
- #elif defined(__APPLE__)
-     get_mac_processes(&process_list);
- #else
-     get_linux_processes(&process_list);
- #endif
+     if (process_model_is_thread(iter)) {
+         const ThreadInfo *thread = process_model_thread(model, index, GPOINTER_TO_INT(iter->user_data2) - 1);
+         if (thread == NULL) {
+             return;
+         }
+         switch (column) {
+         case PROCESS_MODEL_COL_PID:
+             g_value_set_int(value, thread->tid);
+             break;
+         case PROCESS_MODEL_COL_NAME:
+             g_value_set_static_string(value, thread->name);
+             break;
+         case PROCESS_MODEL_COL_STATE:
+             state[0] = thread->state;
+             g_value_set_string(value, state);
+             break;
+         case PROCESS_MODEL_COL_CPU:
+             g_value_set_double(value, thread->cpu_usage);
+             break;
+         }
+         return;  // Memory is shared by the whole process
+     }
+     
+     const ProcessModelRow *row = process_model_entry(model, index);
+     if (row == NULL) {
+         return;
+     }
+     const ProcessList *list = row->list;
+     int i = row->index;
+     switch (column) {
+     case PROCESS_MODEL_COL_PID:
+         g_value_set_int(value, list->pid[i]);
+         break;
+     case PROCESS_MODEL_COL_NAME:
+         // The model holds a reference to the snapshot, so the name stays valid
+         g_value_set_static_string(value, list->name[i]);
+         break;
+     case PROCESS_MODEL_COL_STATE:
+         state[0] = list->state[i];
+         g_value_set_string(value, state);
+         break;
+     case PROCESS_MODEL_COL_CPU:
+         g_value_set_double(value, list->cpu_usage[i]);
+         break;
+     case PROCESS_MODEL_COL_MEMORY:
+         g_value_set_double(value, list->memory_usage[i]);
+         break;
+     case PROCESS_MODEL_COL_PSS:
+     case PROCESS_MODEL_COL_USS:
+     case PROCESS_MODEL_COL_SWAP:
+     case PROCESS_MODEL_COL_ANON:
+     case PROCESS_MODEL_COL_FILE: {
+         const SmapsInfo *smaps = process_model_smaps(row);
+         if (smaps != NULL) {
+             const unsigned long long kb[] = { smaps->pss_kb, smaps->uss_kb, smaps->swap_kb, smaps->anon_kb,
+                                               smaps->file_kb };
+             g_value_take_string(value, g_strdup_printf("%.1f MB", kb[column - PROCESS_MODEL_COL_PSS] / 1024.0));
+         }
+         break;
+     }
+     case PROCESS_MODEL_COL_READ:
+     case PROCESS_MODEL_COL_WRITE: {
+         float rate = process_model_rate(column == PROCESS_MODEL_COL_READ ? list->read_rate : list->write_rate, i);
+         if (rate >= 0) {
+             gchar *size = g_format_size((guint64)rate);
+             g_value_take_string(value, g_strdup_printf("%s/s", size));
+             g_free(size);
+         }
+         break;
+     }
+     case PROCESS_MODEL_COL_VOLUNTARY:
+     case PROCESS_MODEL_COL_INVOLUNTARY:
+     case PROCESS_MODEL_COL_MAJOR_FAULTS: {
+         const float rates[] = {
+             process_model_rate(list->voluntary_switch_rate, i),
+             process_model_rate(list->involuntary_switch_rate, i),
+             process_model_rate(list->major_fault_rate, i)
+         };
+         if (rates[column - PROCESS_MODEL_COL_VOLUNTARY] >= 0) {
+             g_value_take_string(value, g_strdup_printf("%.1f", rates[column - PROCESS_MODEL_COL_VOLUNTARY]));
+         }
+         break;
+     }
+     }
+ }
+ 
+ static gboolean process_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+     ProcessModel *model = PROCESS_MODEL(tree_model);
+     int index = GPOINTER_TO_INT(iter->user_data);
+     if (process_model_is_thread(iter)) {
+         return process_model_set_child_iter(model, iter, index, GPOINTER_TO_INT(iter->user_data2));
+     }
+     return process_model_set_iter(model, iter, index + 1);
+ }
+ 
+ static gboolean process_model_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+     ProcessModel *model = PROCESS_MODEL(tree_model);
+     int index = GPOINTER_TO_INT(iter->user_data);
+     if (process_model_is_thread(iter)) {
+         return process_model_set_child_iter(model, iter, index, GPOINTER_TO_INT(iter->user_data2) - 2);
+     }
+     return process_model_set_iter(model, iter, index - 1);
+ }
+ 
+ static gboolean process_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent) {
+     return process_model_iter_nth_child(tree_model, iter, parent, 0);
+ }
+ 
+ static gboolean process_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+     if (process_model_is_thread(iter)) {
+         return FALSE;
+     }
+     return process_model_has_threads(PROCESS_MODEL(tree_model), GPOINTER_TO_INT(iter->user_data));
+ }
+ 
+ static gint process_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+     ProcessModel *model = PROCESS_MODEL(tree_model);
+     if (iter == NULL) {
+         return process_model_n_rows(model);
+     }
+     if (process_model_is_thread(iter)) {
+         return 0;
+     }
+     return process_model_n_threads(model, GPOINTER_TO_INT(iter->user_data));
+ }
+ 
+ static gboolean process_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                              GtkTreeIter *parent, gint n) {
+     ProcessModel *model = PROCESS_MODEL(tree_model);
+     if (parent == NULL) {
+         return process_model_set_iter(model, iter, n);
+     }
+     if (process_model_is_thread(parent)) {
+         iter->stamp = 0;
+         return FALSE;
+     }
+     return process_model_set_child_iter(model, iter, GPOINTER_TO_INT(parent->user_data), n);
+ }
+ 
+ static gboolean process_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child) {
+     if (!process_model_is_thread(child)) {
+         iter->stamp = 0;
+         return FALSE;
+     }
+     return process_model_set_iter(PROCESS_MODEL(tree_model), iter, GPOINTER_TO_INT(child->user_data));
+ }
+ 
+ static void process_model_tree_model_init(GtkTreeModelIface *iface) {
+     iface->get_flags = process_model_get_flags;
+     iface->get_n_columns = process_model_get_n_columns;
+     iface->get_column_type = process_model_get_column_type;
+     iface->get_iter = process_model_get_iter;
+     iface->get_path = process_model_get_path;
+     iface->get_value = process_model_get_value;
+     iface->iter_next = process_model_iter_next;
+     iface->iter_previous = process_model_iter_previous;
+     iface->iter_children = process_model_iter_children;
+     iface->iter_has_child = process_model_iter_has_child;
+     iface->iter_n_children = process_model_iter_n_children;
+     iface->iter_nth_child = process_model_iter_nth_child;
+     iface->iter_parent = process_model_iter_parent;
+ }
+ 
+ static void process_model_finalize(GObject *object) {
+     ProcessModel *model = PROCESS_MODEL(object);
+     
+     if (model->snapshot != NULL) {
+         snapshot_release(model->snapshot);
+     }
+     g_free(model->rows);
+     g_free(model->scratch);
+     g_free(model->old_keys);
+     g_free(model->new_keys);
+     g_free(model->old_to_new);
+     g_free(model->new_order);
+     
+     G_OBJECT_CLASS(process_model_parent_class)->finalize(object);
+ }
+ 
+ static void process_model_class_init(ProcessModelClass *klass) {
+     G_OBJECT_CLASS(klass)->finalize = process_model_finalize;
+ }
+ 
+ static void process_model_init(ProcessModel *model) {
+     model->stamp = g_random_int();
+     model->next_old = -1;
+     model->child_row = -1;
+ }
+ 
+ /* Create an empty process model */
+ static ProcessModel *process_model_new(void) {
+     return g_object_new(PROCESS_TYPE_MODEL, NULL);
+ }
+ 
+ /* Emit a row signal for a visible row index, or for thread `child` under it when child >= 0 */
+ static void process_model_emit(ProcessModel *model, int index, int child, int signal) {
+     GtkTreePath *path = child < 0 ? gtk_tree_path_new_from_indices(index, -1) :
+                                     gtk_tree_path_new_from_indices(index, child, -1);
+     GtkTreeIter iter;
+     
+     if (signal == PROCESS_MODEL_ROW_DELETED) {
+         gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+     } else {
+         if (child < 0) {
+             process_model_set_iter(model, &iter, index);
+         } else {
+             process_model_set_child_iter(model, &iter, index, child);
+         }
+         if (signal == PROCESS_MODEL_ROW_INSERTED) {
+             gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+         } else if (signal == PROCESS_MODEL_ROW_HAS_CHILD_TOGGLED) {
+             gtk_tree_model_row_has_child_toggled(GTK_TREE_MODEL(model), path, &iter);
+         } else {
+             gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+         }
+     }
+     gtk_tree_path_free(path);
+ }
+ 
+ /*
+  * Merge the threads of the row at `index`, which has just switched to the new
+  * snapshot, against its threads in the previous one. Thread rows are ordered
+  * by TID within a process, so one merge pass finds the changes.
+  */
+ static void process_model_merge_threads(ProcessModel *model, int index, const ProcessModelRow *old) {
+     const ProcessModelRow *entry = &model->rows[index];
+     int thread_rows = entry->list->thread_rows[entry->index];
+     if (old->list->thread_rows[old->index] == 0 && thread_rows == 0) {
+         return;
+     }
+     
+     model->child_row = index;
+     model->child_old = old->threads;
+     model->child_old_count = old->list->thread_rows[old->index];
+     model->child_merged = 0;
+     model->child_old_next = 0;
+     
+     while (model->child_old_next < model->child_old_count || model->child_merged < thread_rows) {
+         const ThreadInfo *old_thread = model->child_old_next < model->child_old_count ?
+                                        &model->child_old[model->child_old_next] : NULL;
+         const ThreadInfo *new_thread = model->child_merged < thread_rows ?
+                                        &entry->threads[model->child_merged] : NULL;
+         
+         if (new_thread == NULL || (old_thread != NULL && old_thread->tid < new_thread->tid)) {
+             model->child_old_next++;
+             process_model_emit(model, index, model->child_merged, PROCESS_MODEL_ROW_DELETED);
+         } else if (old_thread == NULL || new_thread->tid < old_thread->tid) {
+             model->child_merged++;
+             process_model_emit(model, index, model->child_merged - 1, PROCESS_MODEL_ROW_INSERTED);
+         } else {
+             gboolean changed = old_thread->cpu_usage != new_thread->cpu_usage ||
+                                old_thread->state != new_thread->state ||
+                                strcmp(old_thread->name, new_thread->name) != 0;
+             model->child_old_next++;
+             model->child_merged++;
+             if (changed) {
+                 process_model_emit(model, index, model->child_merged - 1, PROCESS_MODEL_ROW_CHANGED);
+             }
+         }
+     }
+     
+     model->child_row = -1;
+ }
+ 
+ /* Order row keys by PID */
+ static int compare_model_keys(const void *a, const void *b) {
+     int pid_a = ((const ProcessModelKey*)a)->pid;
+     int pid_b = ((const ProcessModelKey*)b)->pid;
+     return (pid_a > pid_b) - (pid_a < pid_b);
+ }
+ 
+ /* Sort row keys by PID; rows without a view spec are in PID order already, so usually this is one pass */
+ static void sort_model_keys(ProcessModelKey *keys, int count) {
+     for (int i = 1; i < count; i++) {
+         if (keys[i].pid < keys[i - 1].pid) {
+             qsort(keys, count, sizeof(ProcessModelKey), compare_model_keys);
+             return;
+         }
+     }
+ }
+ 
+ /*
+  * Pair the visible rows with the rows of a new list by PID, filling
+  * old_to_new and, for the new rows that have an old one, new_order.
+  */
+ static void process_model_match(ProcessModel *model, const ProcessList *list) {
+     for (int i = 0; i < model->count; i++) {
+         model->old_keys[i].pid = model->rows[i].list->pid[model->rows[i].index];
+         model->old_keys[i].index = i;
+         model->old_to_new[i] = -1;
+     }
+     for (int i = 0; i < list->count; i++) {
+         model->new_keys[i].pid = list->pid[i];
+         model->new_keys[i].index = i;
+         model->new_order[i] = -1;
+     }
+     sort_model_keys(model->old_keys, model->count);
+     sort_model_keys(model->new_keys, list->count);
+     
+     int old = 0;
+     int row = 0;
+     while (old < model->count && row < list->count) {
+         if (model->old_keys[old].pid < model->new_keys[row].pid) {
+             old++;
+         } else if (model->new_keys[row].pid < model->old_keys[old].pid) {
+             row++;
+         } else {
+             model->old_to_new[model->old_keys[old].index] = model->new_keys[row].index;
+             model->new_order[model->new_keys[row].index] = model->old_keys[old].index;
+             old++;
+             row++;
+         }
+     }
+ }
+ 
+ /*
+  * Switch the model to a new snapshot, taking over the caller's reference.
+  * Rows are paired by PID. Rows of exited or filtered-out processes are
+  * deleted, new rows are appended, and if the order changed the rows are
+  * reordered in one signal, so survivors keep their selection and expansion
+  * wherever they move. Survivors whose values changed are then signalled.
+  */
+ static void process_model_set_snapshot(ProcessModel *model, Snapshot *snapshot) {
+     if (snapshot == model->snapshot) {
+         snapshot_release(snapshot);
+         return;
+     }
+     
+     const ProcessList *list = snapshot->has_view ? &snapshot->view : &snapshot->list;
+     int needed = model->count > list->count ? model->count : list->count;
+     if (needed > model->capacity) {
+         model->capacity = needed * 2;
+         model->rows = g_renew(ProcessModelRow, model->rows, model->capacity);
+         model->scratch = g_renew(ProcessModelRow, model->scratch, model->capacity);
+         model->old_keys = g_renew(ProcessModelKey, model->old_keys, model->capacity);
+         model->new_keys = g_renew(ProcessModelKey, model->new_keys, model->capacity);
+         model->old_to_new = g_renew(int, model->old_to_new, model->capacity);
+         model->new_order = g_renew(int, model->new_order, model->capacity);
+     }
+     
+     model->previous = model->snapshot;
+     model->snapshot = snapshot;
+     model->stamp++;
+     process_model_match(model, list);
+     
+     /* Delete the rows that have no new row, compacting the survivors */
+     model->kept = 0;
+     model->next_old = 0;
+     while (model->next_old < model->count) {
+         int old = model->next_old++;
+         if (model->old_to_new[old] >= 0) {
+             model->new_order[model->old_to_new[old]] = model->kept;
+             model->rows[model->kept++] = model->rows[old];
+         } else {
+             process_model_emit(model, model->kept, -1, PROCESS_MODEL_ROW_DELETED);
+         }
+     }
+     int survivors = model->kept;
+     model->count = survivors;
+     model->next_old = -1;
+     
+     /* Append the new rows */
+     gboolean reordered = FALSE;
+     for (int i = 0; i < list->count; i++) {
+         if (model->new_order[i] >= 0) {
+             reordered |= model->new_order[i] != i;
+             continue;
+         }
+         model->new_order[i] = model->count;
+         reordered |= model->count != i;
+         model->rows[model->count].list = list;
+         model->rows[model->count].index = i;
+         model->rows[model->count].threads = snapshot->threads.threads + list->first_thread[i];
+         model->count++;
+         process_model_emit(model, model->count - 1, -1, PROCESS_MODEL_ROW_INSERTED);
+         if (process_model_has_threads(model, model->count - 1)) {
+             process_model_emit(model, model->count - 1, -1, PROCESS_MODEL_ROW_HAS_CHILD_TOGGLED);
+         }
+     }
+     
+     /* Move every row to its new position */
+     if (reordered) {
+         for (int i = 0; i < list->count; i++) {
+             model->scratch[i] = model->rows[model->new_order[i]];
+         }
+         ProcessModelRow *swap = model->rows;
+         model->rows = model->scratch;
+         model->scratch = swap;
+         
+         GtkTreePath *path = gtk_tree_path_new();
+         gtk_tree_model_rows_reordered(GTK_TREE_MODEL(model), path, NULL, model->new_order);
+         gtk_tree_path_free(path);
+     }
+     
+     /* Switch the survivors to their new rows */
+     for (int i = 0; i < list->count; i++) {
+         if (model->new_order[i] >= survivors) {
+             continue;  // Appended above
+         }
+         ProcessModelRow old = model->rows[i];
+         ProcessModelRow new_row = { list, i, snapshot->threads.threads + list->first_thread[i] };
+         const ProcessList *was = old.list;
+         int at = old.index;
+         const SmapsInfo *old_smaps = process_model_smaps(&old);
+         const SmapsInfo *new_smaps = process_model_smaps(&new_row);
+         gboolean changed = was->cpu_usage[at] != list->cpu_usage[i] ||
+                            was->memory_usage[at] != list->memory_usage[i] ||
+                            was->state[at] != list->state[i] ||
+                            (old_smaps == NULL) != (new_smaps == NULL) ||
+                            (new_smaps != NULL && memcmp(old_smaps, new_smaps, sizeof(SmapsInfo)) != 0) ||
+                            process_model_rate(was->read_rate, at) != process_model_rate(list->read_rate, i) ||
+                            process_model_rate(was->write_rate, at) != process_model_rate(list->write_rate, i) ||
+                            process_model_rate(was->voluntary_switch_rate, at) !=
+                            process_model_rate(list->voluntary_switch_rate, i) ||
+                            process_model_rate(was->involuntary_switch_rate, at) !=
+                            process_model_rate(list->involuntary_switch_rate, i) ||
+                            process_model_rate(was->major_fault_rate, at) !=
+                            process_model_rate(list->major_fault_rate, i) ||
+                            strcmp(was->name[at], list->name[i]) != 0;
+         gboolean had_threads = process_model_has_threads(model, i);
+         model->rows[i] = new_row;
+         process_model_merge_threads(model, i, &old);
+         if (changed) {
+             process_model_emit(model, i, -1, PROCESS_MODEL_ROW_CHANGED);
+         }
+         if (had_threads != process_model_has_threads(model, i)) {
+             process_model_emit(model, i, -1, PROCESS_MODEL_ROW_HAS_CHILD_TOGGLED);
+         }
+     }
+     
+     if (model->previous != NULL) {
+         snapshot_release(model->previous);
+         model->previous = NULL;
+     }
+ }
+ 
+ /* Visible row index of a PID once a merge is complete, or -1 */
+ static int process_model_find(ProcessModel *model, int pid) {
+     for (int i = 0; i < model->count; i++) {
+         if (model->rows[i].list->pid[model->rows[i].index] == pid) {
+             return i;
+         }
+     }
+     return -1;
+ }
+ 
+ /*
+  * Cell renderer that plots a process's recent history. It draws straight
+  * from the raw history ring under the history read lock, so nothing is
+  * copied per row or per tick.
+  */
+ struct _SparklineRenderer {
+     GtkCellRenderer parent_instance;
+     int pid;       // Row being rendered, set by sparkline_cell_data()
+     int metric;    // HISTORY_METRIC_*
+ };
+ 
+ G_DEFINE_TYPE(SparklineRenderer, sparkline_renderer, GTK_TYPE_CELL_RENDERER)
+ 
+ /* One metric of a history sample */
+ static double history_value(const HistorySample *sample, int metric) {
+     return metric == HISTORY_METRIC_CPU ? sample->cpu_usage : sample->memory_usage;
+ }
+ 
+ /* Vertical scale for the newest `samples` samples, with a floor so idle processes stay flat */
+ static double history_scale(const HistoryRing *ring, int metric, int samples) {
+     double scale = metric == HISTORY_METRIC_CPU ? 10.0 : 1.0;
+     for (int age = 0; age < samples; age++) {
+         double value = history_value(history_sample(ring, age), metric);
+         if (value > scale) {
+             scale = value;
+         }
+     }
+     return scale;
+ }
+ 
+ /* Set the line colour of a metric */
+ static void history_set_color(cairo_t *cr, int metric) {
+     if (metric == HISTORY_METRIC_CPU) {
+         cairo_set_source_rgb(cr, 0.2, 0.4, 0.8);
+     } else {
+         cairo_set_source_rgb(cr, 0.9, 0.5, 0.1);
+     }
+ }
+ 
+ /*
+  * Plot the newest `samples` samples of a ring into a box, newest at the
+  * right edge and `slots` samples across the full width.
+  */
+ static void draw_history_line(cairo_t *cr, const HistoryRing *ring, int metric, int samples, int slots,
+                               double x, double y, double width, double height, double scale) {
+     double step = width / (slots - 1);
+     
+     for (int age = 0; age < samples; age++) {
+         double value = history_value(history_sample(ring, age), metric);
+         double px = x + width - age * step;
+         double py = y + height - (value / scale) * height;
+         if (age == 0) {
+             cairo_move_to(cr, px, py);
+         } else {
+             cairo_line_to(cr, px, py);
+         }
+     }
+     cairo_set_line_width(cr, 1.0);
+     cairo_stroke(cr);
+ }
+ 
+ static void sparkline_renderer_render(GtkCellRenderer *cell, cairo_t *cr, GtkWidget *widget,
+                                       const GdkRectangle *background_area, const GdkRectangle *cell_area,
+                                       GtkCellRendererState flags) {
+     (void)widget;           // Unused parameter
+     (void)background_area;  // Unused parameter
+     (void)flags;            // Unused parameter
+     
+     SparklineRenderer *sparkline = SPARKLINE_RENDERER(cell);
+     int xpad, ypad;
+     gtk_cell_renderer_get_padding(cell, &xpad, &ypad);
+     
+     static HistorySample ring_samples[HISTORY_MAX_SAMPLES];  // Only drawn from the main thread
+     HistoryRing ring;
+     if (history_copy(sparkline->pid, HISTORY_TIER_RAW, &ring, ring_samples) && ring.count > 1) {
+         int samples = ring.count < SPARKLINE_SAMPLES ? ring.count : SPARKLINE_SAMPLES;
+         history_set_color(cr, sparkline->metric);
+         draw_history_line(cr, &ring, sparkline->metric, samples, SPARKLINE_SAMPLES,
+                           cell_area->x + xpad, cell_area->y + ypad,
+                           cell_area->width - 2 * xpad, cell_area->height - 2 * ypad,
+                           history_scale(&ring, sparkline->metric, samples));
+     }
+ }
+ 
+ static void sparkline_renderer_class_init(SparklineRendererClass *klass) {
+     GTK_CELL_RENDERER_CLASS(klass)->render = sparkline_renderer_render;
+ }
+ 
+ static void sparkline_renderer_init(SparklineRenderer *sparkline) {
+     gtk_cell_renderer_set_fixed_size(GTK_CELL_RENDERER(sparkline), SPARKLINE_WIDTH, SPARKLINE_HEIGHT);
+ }
+ 
+ /* Create a sparkline renderer for one metric */
+ static GtkCellRenderer *sparkline_renderer_new(int metric) {
+     SparklineRenderer *sparkline = g_object_new(SPARKLINE_TYPE_RENDERER, NULL);
+     sparkline->metric = metric;
+     return GTK_CELL_RENDERER(sparkline);
+ }
+ 
+ /* Point a sparkline renderer at the PID of the row being drawn */
+ static void sparkline_cell_data(GtkTreeViewColumn *column, GtkCellRenderer *cell,
+                                 GtkTreeModel *model, GtkTreeIter *iter, gpointer data) {
+     (void)column;  // Unused parameter
+     (void)data;    // Unused parameter
+     
+     // Threads have no history of their own
+     if (process_model_is_thread(iter)) {
+         SPARKLINE_RENDERER(cell)->pid = -1;
+         return;
+     }
+     gtk_tree_model_get(model, iter, PROCESS_MODEL_COL_PID, &SPARKLINE_RENDERER(cell)->pid, -1);
+ }
+ 
+ /* Draw the history of the process shown in the history window */
+ static gboolean on_history_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+     (void)data;  // Unused parameter
+     
+     double width = gtk_widget_get_allocated_width(widget);
+     double height = gtk_widget_get_allocated_height(widget);
+     double margin = 10.0;
+     double plot_top = 2 * margin + 24.0;  // Room for the legend
+     double plot_height = height - plot_top - margin;
+     double plot_width = width - 2 * margin;
+     
+     cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+     cairo_paint(cr);
+     if (plot_height < 10 || plot_width < 10) {
+         return FALSE;
+     }
+     
+     /* Frame and quarter lines */
+     cairo_set_source_rgb(cr, 0.85, 0.85, 0.85);
+     cairo_set_line_width(cr, 1.0);
+     for (int i = 0; i <= 4; i++) {
+         cairo_move_to(cr, margin, plot_top + plot_height * i / 4);
+         cairo_line_to(cr, margin + plot_width, plot_top + plot_height * i / 4);
+     }
+     cairo_stroke(cr);
+     
+     static HistorySample samples[HISTORY_MAX_SAMPLES];  // Only drawn from the main thread
+     HistoryRing ring;
+     if (history_copy(history_window.pid, history_window.tier, &ring, samples) && ring.count > 1) {
+         static const char *labels[] = { "CPU %", "Memory %" };
+         for (int metric = HISTORY_METRIC_CPU; metric <= HISTORY_METRIC_MEMORY; metric++) {
+             double scale = history_scale(&ring, metric, ring.count);
+             char legend[64];
+             g_snprintf(legend, sizeof(legend), "%s (top %.1f)", labels[metric], scale);
+             
+             history_set_color(cr, metric);
+             cairo_move_to(cr, margin + metric * plot_width / 2, margin + 12.0);
+             cairo_show_text(cr, legend);
+             draw_history_line(cr, &ring, metric, ring.count, ring.capacity,
+                               margin, plot_top, plot_width, plot_height, scale);
+         }
+     } else {
+         cairo_set_source_rgb(cr, 0.4, 0.4, 0.4);
+         cairo_move_to(cr, margin, margin + 12.0);
+         cairo_show_text(cr, "No history recorded for this process yet");
+     }
      
-     pthread_mutex_unlock(&data_mutex);
+     return FALSE;
  }
  
- /* Update thread function */
- static void *update_thread_func(void *data) {
+ /* History range selector handler */
+ static void on_history_tier_changed(GtkComboBox *combo, gpointer data) {
      (void)data;  // Unused parameter
      
-     while (running) {
-         update_process_data();
+     history_window.tier = gtk_combo_box_get_active(combo);
+     gtk_widget_queue_draw(history_window.graph);
+ }
+ 
+ /* History window close handler */
+ static void on_history_window_destroy(GtkWidget *widget, gpointer data) {
+     (void)widget;  // Unused parameter
+     (void)data;    // Unused parameter
+     
+     history_window.window = NULL;
+     history_window.graph = NULL;
+ }
+ 
+ /* Show the history graph of a process, reusing the window if it is open */
+ static void show_history_window(int pid, const char *name) {
+     if (history_window.window == NULL) {
+         history_window.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+         gtk_window_set_default_size(GTK_WINDOW(history_window.window), 640, 320);
+         gtk_window_set_transient_for(GTK_WINDOW(history_window.window),
+                                      GTK_WINDOW(gtk_widget_get_toplevel(process_view)));
+         g_signal_connect(history_window.window, "destroy", G_CALLBACK(on_history_window_destroy), NULL);
          
-         /* Update the UI from the main thread */
-         gdk_threads_add_idle(populate_process_view, process_store);
+         GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+         gtk_container_add(GTK_CONTAINER(history_window.window), box);
          
-         /* Sleep for the update interval */
-         usleep(update_interval_ms * 1000);
+         /* Range selector, one entry per history tier */
+         GtkWidget *range = gtk_combo_box_text_new();
+         gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(range), "Every tick (last 300 ticks)");
+         gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(range), "10 s averages (last hour)");
+         gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(range), "1 min averages (last 24 hours)");
+         gtk_combo_box_set_active(GTK_COMBO_BOX(range), history_window.tier);
+         g_signal_connect(range, "changed", G_CALLBACK(on_history_tier_changed), NULL);
+         gtk_box_pack_start(GTK_BOX(box), range, FALSE, FALSE, 5);
+         
+         history_window.graph = gtk_drawing_area_new();
+         g_signal_connect(history_window.graph, "draw", G_CALLBACK(on_history_draw), NULL);
+         gtk_box_pack_start(GTK_BOX(box), history_window.graph, TRUE, TRUE, 0);
      }
      
-     return NULL;
+     history_window.pid = pid;
+     char *title = g_strdup_printf("History of %s (PID %d)", name, pid);
+     gtk_window_set_title(GTK_WINDOW(history_window.window), title);
+     g_free(title);
+     
+     gtk_widget_show_all(history_window.window);
+     gtk_window_present(GTK_WINDOW(history_window.window));
+     gtk_widget_queue_draw(history_window.graph);
  }
  
- /* Populate the process view with data */
- static gboolean populate_process_view(gpointer data) {
-     GtkListStore *store = GTK_LIST_STORE(data);
+ /* Pick how many strips fit side by side and ask for the height they then need */
+ static void system_panel_layout(int width, gboolean cpus_changed) {
+     int columns = (width + CORE_STRIP_GAP) / (CORE_STRIP_SAMPLES + CORE_STRIP_GAP);
+     columns = columns > 0 ? columns : 1;
+     if (columns != system_panel.columns || cpus_changed) {
+         system_panel.columns = columns;
+         int rows = (system_panel.num_cpus + columns - 1) / columns;
+         gtk_widget_set_size_request(system_panel.area, CORE_STRIP_SAMPLES, rows * CORE_STRIP_HEIGHT);
+     }
+ }
+ 
+ /* Clear columns of every strip, leaving the rule at the bottom of each */
+ static void system_panel_clear(cairo_t *cr, int x, int width) {
+     cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+     cairo_rectangle(cr, x, 0, width, system_panel.num_cpus * CORE_STRIP_HEIGHT);
+     cairo_fill(cr);
+     cairo_set_source_rgb(cr, 0.85, 0.85, 0.85);
+     for (int i = 1; i <= system_panel.num_cpus; i++) {
+         cairo_rectangle(cr, x, i * CORE_STRIP_HEIGHT - 1, width, 1);
+     }
+     cairo_fill(cr);
+ }
+ 
+ /* Add a snapshot's host figures: one new column in the strips, and the summary */
+ static void system_panel_update(const Snapshot *snapshot) {
+     const SystemInfo *system = &snapshot->system;
+     if (system->num_cpus == 0 || snapshot->sequence == system_panel.sequence) {
+         return;  // Not read on this platform or in a replay, or already drawn
+     }
+     system_panel.sequence = snapshot->sequence;
+     
+     /* The history no longer lines up once CPUs come or go, so it starts over */
+     if (system_panel.strips == NULL || system->num_cpus != system_panel.num_cpus) {
+         if (system_panel.strips != NULL) {
+             cairo_surface_destroy(system_panel.strips);
+         }
+         system_panel.num_cpus = system->num_cpus;
+         system_panel.head = 0;
+         system_panel.strips = cairo_image_surface_create(CAIRO_FORMAT_RGB24, CORE_STRIP_SAMPLES,
+                                                          system->num_cpus * CORE_STRIP_HEIGHT);
+         cairo_t *cr = cairo_create(system_panel.strips);
+         system_panel_clear(cr, 0, CORE_STRIP_SAMPLES);
+         cairo_destroy(cr);
+         system_panel_layout(gtk_widget_get_allocated_width(system_panel.area), TRUE);
+     }
+     
+     /* Draw only the newest column, over the oldest */
+     cairo_t *cr = cairo_create(system_panel.strips);
+     system_panel_clear(cr, system_panel.head, 1);
+     history_set_color(cr, HISTORY_METRIC_CPU);
+     for (int i = 0; i < system->num_cpus; i++) {
+         double usage = system->cpu_usage[i] < 100 ? system->cpu_usage[i] : 100;
+         int height = (int)(usage * (CORE_STRIP_HEIGHT - 1) / 100.0 + 0.5);
+         if (height > 0) {
+             cairo_rectangle(cr, system_panel.head, (i + 1) * CORE_STRIP_HEIGHT - 1 - height, 1, height);
+         }
+     }
+     cairo_fill(cr);
+     cairo_destroy(cr);
+     system_panel.head = (system_panel.head + 1) % CORE_STRIP_SAMPLES;
+     
+     gchar *used = g_format_size((system->mem_total_kb - system->mem_available_kb) * 1024);
+     gchar *total = g_format_size(system->mem_total_kb * 1024);
+     gchar *cached = g_format_size(system->mem_cached_kb * 1024);
+     gchar *swap = g_format_size((system->swap_total_kb - system->swap_free_kb) * 1024);
+     gchar *text = g_strdup_printf("CPU %.1f%% of %d CPUs    Memory %s of %s used, %s cache    Swap %s used",
+                                   system->total_cpu_usage > 0 ? system->total_cpu_usage : 0.0,
+                                   system->num_cpus, used, total, cached, swap);
+     gtk_label_set_text(GTK_LABEL(system_panel.summary), text);
+     g_free(text);
+     g_free(swap);
+     g_free(cached);
+     g_free(total);
+     g_free(used);
+     
+     gtk_widget_queue_draw(system_panel.area);
+ }
+ 
+ /* Blit the cached strips, oldest sample on the left of each */
+ static gboolean on_system_panel_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+     (void)widget;  // Unused parameter
+     (void)data;    // Unused parameter
+     
+     if (system_panel.strips == NULL) {
+         return FALSE;
+     }
+     int rows = (system_panel.num_cpus + system_panel.columns - 1) / system_panel.columns;
+     int older = CORE_STRIP_SAMPLES - system_panel.head;  // Columns from the oldest sample to the end of the ring
+     for (int first = 0; first < system_panel.num_cpus; first += rows) {
+         int count = system_panel.num_cpus - first < rows ? system_panel.num_cpus - first : rows;
+         double x = first / rows * (CORE_STRIP_SAMPLES + CORE_STRIP_GAP);
+         double y = -(double)first * CORE_STRIP_HEIGHT;  // Puts strip `first` at the top
+         
+         cairo_set_source_surface(cr, system_panel.strips, x - system_panel.head, y);
+         cairo_rectangle(cr, x, 0, older, count * CORE_STRIP_HEIGHT);
+         cairo_fill(cr);
+         if (system_panel.head > 0) {
+             cairo_set_source_surface(cr, system_panel.strips, x + older, y);
+             cairo_rectangle(cr, x + older, 0, system_panel.head, count * CORE_STRIP_HEIGHT);
+             cairo_fill(cr);
+         }
+     }
+     return FALSE;
+ }
+ 
+ /* Re-flow the strips when the panel's width changes */
+ static void on_system_panel_size_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer data) {
+     (void)widget;  // Unused parameter
+     (void)data;    // Unused parameter
+     system_panel_layout(allocation->width, FALSE);
+ }
+ 
+ /* Build the host panel, collapsible so the process list can have the room */
+ static GtkWidget *system_panel_new(void) {
+     GtkWidget *expander = gtk_expander_new("System");
+     gtk_expander_set_expanded(GTK_EXPANDER(expander), TRUE);
+     GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 3);
+     gtk_container_add(GTK_CONTAINER(expander), box);
+     
+     system_panel.summary = gtk_label_new("Waiting for the first refresh");
+     gtk_label_set_xalign(GTK_LABEL(system_panel.summary), 0.0);
+     gtk_box_pack_start(GTK_BOX(box), system_panel.summary, FALSE, FALSE, 0);
+     
+     system_panel.area = gtk_drawing_area_new();
+     gtk_widget_set_tooltip_text(system_panel.area,
+                                 "One strip per CPU, numbered down each column; newest refresh on the right");
+     g_signal_connect(system_panel.area, "draw", G_CALLBACK(on_system_panel_draw), NULL);
+     g_signal_connect(system_panel.area, "size-allocate", G_CALLBACK(on_system_panel_size_allocate), NULL);
+     gtk_box_pack_start(GTK_BOX(box), system_panel.area, FALSE, FALSE, 0);
+     return expander;
+ }
+ 
+ /* Show the latest self-profiling figures in the status bar and the profile window */
+ static void update_profile_display(void) {
+     ProfileSummary tick, merge;
+     profile_summarize(PROFILE_TICK, &tick);
+     profile_summarize(PROFILE_VIEW_MERGE, &merge);
+     
+     char *text = g_strdup_printf("Sampler tick p50 %.1f ms, p99 %.1f ms  |  View update p50 %.1f ms  |  %llu overruns",
+                                  tick.p50 / 1e6, tick.p99 / 1e6, merge.p50 / 1e6, profile_overruns());
+     guint context = gtk_statusbar_get_context_id(GTK_STATUSBAR(status_bar), "profile");
+     gtk_statusbar_pop(GTK_STATUSBAR(status_bar), context);
+     gtk_statusbar_push(GTK_STATUSBAR(status_bar), context, text);
+     g_free(text);
+     
+     if (profile_label != NULL) {
+         char table[2048];
+         profile_format(table, sizeof(table));
+         char *markup = g_markup_printf_escaped("<tt>%s</tt>", table);
+         gtk_label_set_markup(GTK_LABEL(profile_label), markup);
+         g_free(markup);
+     }
+ }
+ 
+ /* Profile window close handler */
+ static void on_profile_window_destroy(GtkWidget *widget, gpointer data) {
+     (void)widget;  // Unused parameter
+     (void)data;    // Unused parameter
+     
+     profile_window = NULL;
+     profile_label = NULL;
+ }
+ 
+ /* Profile button click handler; the table refreshes with every view update while open */
+ static void on_profile_button_clicked(GtkWidget *widget, gpointer data) {
+     (void)data;  // Unused parameter
+     
+     if (profile_window == NULL) {
+         profile_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+         gtk_window_set_title(GTK_WINDOW(profile_window), "Sampler Profile");
+         gtk_window_set_transient_for(GTK_WINDOW(profile_window), GTK_WINDOW(gtk_widget_get_toplevel(widget)));
+         g_signal_connect(profile_window, "destroy", G_CALLBACK(on_profile_window_destroy), NULL);
+         
+         profile_label = gtk_label_new(NULL);
+         gtk_label_set_selectable(GTK_LABEL(profile_label), TRUE);
+         gtk_container_set_border_width(GTK_CONTAINER(profile_window), 10);
+         gtk_container_add(GTK_CONTAINER(profile_window), profile_label);
+         update_profile_display();
+     }
+     
+     gtk_widget_show_all(profile_window);
+     gtk_window_present(GTK_WINDOW(profile_window));
+ }
+ 
+ /* Read row `index` of the tree window's hierarchy from a snapshot */
+ static void tree_window_row(const Snapshot *snapshot, int index, TreeRow *row) {
+     if (tree_window.mode == TREE_MODE_PROCESSES) {
+         const ProcessList *list = &snapshot->list;
+         g_snprintf(row->pid_key, sizeof(row->pid_key), "%d", list->pid[index]);
+         row->key = row->pid_key;
+         row->parent = list->parent[index];
+         row->name = list->name[index];
+         row->pid = list->pid[index];
+         row->start_time = list->start_time[index];
+         row->processes = list->subtree_processes[index];
+         row->cpu_usage = list->subtree_cpu[index];
+         row->memory_usage = list->subtree_memory[index];
+         row->kernel_cpu_usage = -1;
+         row->kernel_memory_usage = -1;
+     } else {
+         const CgroupInfo *info = &snapshot->cgroups.cgroups[index];
+         const char *path = snapshot->cgroups.paths + info->path;
+         const char *slash = strrchr(path, '/');
+         row->key = path;
+         row->parent = info->parent;
+         row->name = slash != NULL && slash[1] != '\0' ? slash + 1 : path;
+         row->pid = 0;
+         row->start_time = 0;
+         row->processes = info->processes;
+         row->cpu_usage = info->cpu_usage;
+         row->memory_usage = info->memory_usage;
+         row->kernel_cpu_usage = info->kernel_cpu_usage;
+         row->kernel_memory_usage = info->kernel_memory_usage;
+     }
+ }
+ 
+ /* Make sure row `index` and its ancestors are in the store, parents first, and bring its values up to date */
+ static TreeNode *tree_window_ensure(const Snapshot *snapshot, int index, int depth) {
+     TreeRow row;
+     tree_window_row(snapshot, index, &row);
+     
+     TreeNode *node = g_hash_table_lookup(tree_window.nodes, row.key);
+     if (node == NULL) {
+         // A parent chain longer than the snapshot can only be a cycle; the row goes to the top level
+         TreeNode *parent = row.parent >= 0 && depth < snapshot->list.count + snapshot->cgroups.count ?
+                            tree_window_ensure(snapshot, row.parent, depth + 1) : NULL;
+         TreeRow parent_row;
+         if (parent != NULL) {
+             tree_window_row(snapshot, row.parent, &parent_row);
+         }
+         
+         node = g_new0(TreeNode, 1);
+         node->parent = parent != NULL ? g_strdup(parent_row.key) : NULL;
+         node->processes = -1;  // Set below
+         gtk_tree_store_append(tree_window.store, &node->iter, parent != NULL ? &parent->iter : NULL);
+         gtk_tree_store_set(tree_window.store, &node->iter, TREE_COL_KEY, row.key, TREE_COL_PID, row.pid,
+                            TREE_COL_START_TIME, (guint64)row.start_time, -1);
+         g_hash_table_insert(tree_window.nodes, g_strdup(row.key), node);
+     }
+     node->generation = tree_window.generation;
+     
+     // Only rows whose figures moved are set, so only they are redrawn
+     if (node->name == NULL || strcmp(node->name, row.name) != 0) {
+         g_free(node->name);
+         node->name = g_strdup(row.name);
+         gtk_tree_store_set(tree_window.store, &node->iter, TREE_COL_NAME, row.name, -1);
+     }
+     if (node->processes != row.processes || node->cpu_usage != row.cpu_usage ||
+         node->memory_usage != row.memory_usage || node->kernel_cpu_usage != row.kernel_cpu_usage ||
+         node->kernel_memory_usage != row.kernel_memory_usage) {
+         char *kernel_cpu = row.kernel_cpu_usage >= 0 ? g_strdup_printf("%.2f", row.kernel_cpu_usage) : NULL;
+         char *kernel_memory = row.kernel_memory_usage >= 0 ? g_strdup_printf("%.2f", row.kernel_memory_usage) : NULL;
+         gtk_tree_store_set(tree_window.store, &node->iter,
+                            TREE_COL_PROCESSES, row.processes,
+                            TREE_COL_CPU, row.cpu_usage,
+                            TREE_COL_MEMORY, row.memory_usage,
+                            TREE_COL_KERNEL_CPU, kernel_cpu,
+                            TREE_COL_KERNEL_MEMORY, kernel_memory,
+                            -1);
+         g_free(kernel_cpu);
+         g_free(kernel_memory);
+         node->processes = row.processes;
+         node->cpu_usage = row.cpu_usage;
+         node->memory_usage = row.memory_usage;
+         node->kernel_cpu_usage = row.kernel_cpu_usage;
+         node->kernel_memory_usage = row.kernel_memory_usage;
+     }
+     return node;
+ }
+ 
+ /* Drop the nodes of a row and everything below it, before the row is removed from the store */
+ static void tree_window_forget(GtkTreeIter *iter) {
+     GtkTreeModel *model = GTK_TREE_MODEL(tree_window.store);
+     GtkTreeIter child;
+     
+     for (gboolean more = gtk_tree_model_iter_children(model, &child, iter); more;
+          more = gtk_tree_model_iter_next(model, &child)) {
+         tree_window_forget(&child);
+     }
+     char *key;
+     gtk_tree_model_get(model, iter, TREE_COL_KEY, &key, -1);
+     g_hash_table_remove(tree_window.nodes, key);
+     g_free(key);
+ }
+ 
+ /*
+  * Merge a snapshot into the tree window. The store keeps its rows between
+  * snapshots, so expanded rows stay expanded: rows that left or moved to
+  * another parent are removed with their subtrees, then missing rows are
+  * appended under their parents and rows whose figures changed are set.
+  */
+ static void tree_window_update(const Snapshot *snapshot) {
+     int count = tree_window.mode == TREE_MODE_PROCESSES ? snapshot->list.count : snapshot->cgroups.count;
+     gboolean was_empty = g_hash_table_size(tree_window.nodes) == 0;
+     tree_window.generation++;
+     
+     for (int i = 0; i < count; i++) {
+         TreeRow row, parent_row;
+         tree_window_row(snapshot, i, &row);
+         TreeNode *node = g_hash_table_lookup(tree_window.nodes, row.key);
+         if (node == NULL) {
+             continue;
+         }
+         if (row.parent >= 0) {
+             tree_window_row(snapshot, row.parent, &parent_row);
+         }
+         if (row.parent >= 0 ? node->parent != NULL && strcmp(node->parent, parent_row.key) == 0 :
+                               node->parent == NULL) {
+             node->generation = tree_window.generation;
+         }
+     }
      
-     /* Clear the store */
-     gtk_list_store_clear(store);
+     // Collect first: removing a row drops the nodes of its whole subtree
+     GPtrArray *stale = g_ptr_array_new_with_free_func(g_free);
+     GHashTableIter nodes;
+     gpointer key, value;
+     g_hash_table_iter_init(&nodes, tree_window.nodes);
+     while (g_hash_table_iter_next(&nodes, &key, &value)) {
+         if (((TreeNode*)value)->generation != tree_window.generation) {
+             g_ptr_array_add(stale, g_strdup(key));
+         }
+     }
+     for (guint i = 0; i < stale->len; i++) {
+         TreeNode *node = g_hash_table_lookup(tree_window.nodes, g_ptr_array_index(stale, i));
+         if (node != NULL) {
+             GtkTreeIter iter = node->iter;
+             tree_window_forget(&iter);
+             gtk_tree_store_remove(tree_window.store, &iter);
+         }
+     }
+     g_ptr_array_free(stale, TRUE);
      
-     /* Lock the data mutex */
-     pthread_mutex_lock(&data_mutex);
+     for (int i = 0; i < count; i++) {
+         tree_window_ensure(snapshot, i, 0);
+     }
      
-     /* Add each process to the store */
-     for (int i = 0; i < process_list.count; i++) {
+     // Open the top level the first time the store is filled
+     if (was_empty) {
          GtkTreeIter iter;
-         gtk_list_store_append(store, &iter);
-         gtk_list_store_set(store, &iter,
-                           0, process_list.processes[i].pid,
-                           1, process_list.processes[i].name,
-                           2, process_list.processes[i].cpu_usage,
-                           3, process_list.processes[i].memory_usage,
-                           -1);
+         GtkTreeModel *model = GTK_TREE_MODEL(tree_window.store);
+         for (gboolean more = gtk_tree_model_get_iter_first(model, &iter); more;
+              more = gtk_tree_model_iter_next(model, &iter)) {
+             GtkTreePath *path = gtk_tree_model_get_path(model, &iter);
+             gtk_tree_view_expand_row(GTK_TREE_VIEW(tree_window.view), path, FALSE);
+             gtk_tree_path_free(path);
+         }
      }
+ }
+ 
+ /* Free a tree window node; the store row is removed separately */
+ static void tree_node_free(gpointer data) {
+     TreeNode *node = data;
+     g_free(node->parent);
+     g_free(node->name);
+     g_free(node);
+ }
+ 
+ /* Switch the tree window between the process tree and the cgroups, refilling it from the current snapshot */
+ static void on_tree_mode_changed(GtkComboBox *combo, gpointer data) {
+     (void)data;  // Unused parameter
      
-     /* Unlock the data mutex */
-     pthread_mutex_unlock(&data_mutex);
+     tree_window.mode = gtk_combo_box_get_active(combo) == 1 ? TREE_MODE_CGROUPS : TREE_MODE_PROCESSES;
+     gtk_tree_view_column_set_visible(tree_window.pid_column, tree_window.mode == TREE_MODE_PROCESSES);
+     gtk_tree_view_column_set_visible(tree_window.kernel_columns[0], tree_window.mode == TREE_MODE_CGROUPS);
+     gtk_tree_view_column_set_visible(tree_window.kernel_columns[1], tree_window.mode == TREE_MODE_CGROUPS);
+     gtk_button_set_label(GTK_BUTTON(tree_window.kill_button),
+                          tree_window.mode == TREE_MODE_PROCESSES ? "Terminate Subtree" : "Terminate Cgroup");
      
-     return FALSE;  // Remove the idle source
+     g_hash_table_remove_all(tree_window.nodes);
+     gtk_tree_store_clear(tree_window.store);
+     if (process_model->snapshot != NULL) {
+         tree_window_update(process_model->snapshot);
+     }
+ }
+ 
+ /* Tree window selection handler */
+ static void on_tree_selection_changed(GtkTreeSelection *selection, gpointer data) {
+     (void)data;  // Unused parameter
+     
+     gtk_widget_set_sensitive(tree_window.kill_button, gtk_tree_selection_get_selected(selection, NULL, NULL));
  }
  
- /* Kill the selected process */
- static void kill_process(int pid) {
- #ifdef _WIN32
-     HANDLE handle = OpenProcess(PROCESS_TERMINATE, FALSE, pid);
-     if (handle != NULL) {
-         TerminateProcess(handle, 0);
-         CloseHandle(handle);
+ /* Terminate the selected process with its descendants, or every process in the selected cgroup */
+ static void on_tree_kill_clicked(GtkWidget *widget, gpointer data) {
+     (void)widget;  // Unused parameter
+     (void)data;    // Unused parameter
+     
+     GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(tree_window.view));
+     GtkTreeModel *model;
+     GtkTreeIter iter;
+     if (!gtk_tree_selection_get_selected(selection, &model, &iter)) {
+         return;
      }
- #else
-     kill(pid, SIGTERM);
- #endif
+     
+     char *key;
+     int pid, processes;
+     guint64 start_time;
+     gtk_tree_model_get(model, &iter, TREE_COL_KEY, &key, TREE_COL_PID, &pid, TREE_COL_PROCESSES, &processes,
+                        TREE_COL_START_TIME, &start_time, -1);
+     GtkWidget *dialog;
+     if (tree_window.mode == TREE_MODE_PROCESSES) {
+         dialog = gtk_message_dialog_new(GTK_WINDOW(tree_window.window), GTK_DIALOG_DESTROY_WITH_PARENT,
+                                         GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO,
+                                         "Are you sure you want to terminate process %d and its %d descendants?",
+                                         pid, processes - 1);
+     } else {
+         dialog = gtk_message_dialog_new(GTK_WINDOW(tree_window.window), GTK_DIALOG_DESTROY_WITH_PARENT,
+                                         GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO,
+                                         "Are you sure you want to terminate the %d processes in cgroup %s?",
+                                         processes, key);
+     }
+     int response = gtk_dialog_run(GTK_DIALOG(dialog));
+     gtk_widget_destroy(dialog);
+     
+     if (response == GTK_RESPONSE_YES) {
+         if (tree_window.mode == TREE_MODE_PROCESSES) {
+             kill_process_tree(pid, start_time);
+         } else {
+             kill_cgroup(key);
+         }
+         request_refresh();
+     }
+     g_free(key);
+ }
+ 
+ /* Tree window close handler */
+ static void on_tree_window_destroy(GtkWidget *widget, gpointer data) {
+     (void)widget;  // Unused parameter
+     (void)data;    // Unused parameter
+     
+     g_hash_table_destroy(tree_window.nodes);
+     g_object_unref(tree_window.store);
+     tree_window.window = NULL;
+     tree_window.view = NULL;
+     tree_window.store = NULL;
+     tree_window.nodes = NULL;
+ }
+ 
+ /* Tree button click handler; the tree follows every view update while open */
+ static void on_tree_button_clicked(GtkWidget *widget, gpointer data) {
+     (void)data;  // Unused parameter
+     
+     if (tree_window.window == NULL) {
+         tree_window.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+         gtk_window_set_title(GTK_WINDOW(tree_window.window), "Process Tree");
+         gtk_window_set_default_size(GTK_WINDOW(tree_window.window), 720, 480);
+         gtk_window_set_transient_for(GTK_WINDOW(tree_window.window), GTK_WINDOW(gtk_widget_get_toplevel(widget)));
+         g_signal_connect(tree_window.window, "destroy", G_CALLBACK(on_tree_window_destroy), NULL);
+         
+         GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+         gtk_container_add(GTK_CONTAINER(tree_window.window), box);
+         GtkWidget *controls = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+         gtk_box_pack_start(GTK_BOX(box), controls, FALSE, FALSE, 5);
+         
+         GtkWidget *mode = gtk_combo_box_text_new();
+         gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(mode), "Processes by parent");
+         gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(mode), "Cgroups");
+         gtk_box_pack_start(GTK_BOX(controls), mode, FALSE, FALSE, 5);
+         
+         tree_window.kill_button = gtk_button_new_with_label("Terminate Subtree");
+         gtk_widget_set_sensitive(tree_window.kill_button, FALSE);
+         g_signal_connect(tree_window.kill_button, "clicked", G_CALLBACK(on_tree_kill_clicked), NULL);
+         gtk_box_pack_end(GTK_BOX(controls), tree_window.kill_button, FALSE, FALSE, 5);
+         
+         tree_window.store = gtk_tree_store_new(TREE_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_INT,
+                                                G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT64);
+         tree_window.nodes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, tree_node_free);
+         tree_window.view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(tree_window.store));
+         
+         /* Totals are over the whole subtree, or the cgroup and every cgroup below it */
+         static const char *titles[] = { "Name", "PID", "Processes", "CPU %", "Memory %", "Cgroup CPU %", "Cgroup Memory %" };
+         for (int i = 0; i < (int)G_N_ELEMENTS(titles); i++) {
+             GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+             if (i > 0) {
+                 g_object_set(renderer, "xalign", 1.0, NULL);
+             }
+             GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes(titles[i], renderer,
+                                                                                  "text", TREE_COL_NAME + i, NULL);
+             gtk_tree_view_column_set_expand(column, i == 0);
+             gtk_tree_view_append_column(GTK_TREE_VIEW(tree_window.view), column);
+             if (i == 1) {
+                 tree_window.pid_column = column;
+             } else if (i >= 5) {
+                 tree_window.kernel_columns[i - 5] = column;
+             }
+         }
+         
+         GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(tree_window.view));
+         gtk_tree_selection_set_mode(selection, GTK_SELECTION_SINGLE);
+         g_signal_connect(selection, "changed", G_CALLBACK(on_tree_selection_changed), NULL);
+         
+         GtkWidget *scroll = gtk_scrolled_window_new(NULL, NULL);
+         gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+         gtk_container_add(GTK_CONTAINER(scroll), tree_window.view);
+         gtk_box_pack_start(GTK_BOX(box), scroll, TRUE, TRUE, 0);
+         
+         // Setting the mode fills the store
+         g_signal_connect(mode, "changed", G_CALLBACK(on_tree_mode_changed), NULL);
+         gtk_combo_box_set_active(GTK_COMBO_BOX(mode), tree_window.mode == TREE_MODE_CGROUPS ? 1 : 0);
+     }
+     
+     gtk_widget_show_all(tree_window.window);
+     gtk_window_present(GTK_WINDOW(tree_window.window));
+ }
+ 
+ /* Row activation (double click) handler */
+ static void on_row_activated(GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer data) {
+     (void)column;  // Unused parameter
+     (void)data;    // Unused parameter
+     
+     GtkTreeModel *model = gtk_tree_view_get_model(view);
+     GtkTreeIter iter, parent;
+     if (gtk_tree_model_get_iter(model, &iter, path)) {
+         // A thread row shows the history of its process
+         if (gtk_tree_model_iter_parent(model, &parent, &iter)) {
+             iter = parent;
+         }
+         int pid;
+         char *name;
+         gtk_tree_model_get(model, &iter, PROCESS_MODEL_COL_PID, &pid, PROCESS_MODEL_COL_NAME, &name, -1);
+         show_history_window(pid, name);
+         g_free(name);
+     }
+ }
+ 
+ /* Sampler publish hook; update the UI from the main thread, unless an update is already queued */
+ static void on_snapshot_published(void *data) {
+     if (!atomic_exchange(&view_update_pending, 1)) {
+         atomic_store(&published_at_ns, profile_now());
+         gdk_threads_add_idle(populate_process_view, data);
+     }
+ }
+ 
+ /* Populate the process view with data */
+ static gboolean populate_process_view(gpointer data) {
+     ProcessModel *model = PROCESS_MODEL(data);
+     unsigned long long start = profile_now();
+     
+     profile_record(PROFILE_VIEW_WAIT, start - atomic_load(&published_at_ns));
+     atomic_store(&view_update_pending, 0);
+     
+     /* Hand the latest snapshot to the model; the sampler never blocks on it */
+     Snapshot *snapshot = snapshot_acquire();
+     if (snapshot != NULL) {
+         process_model_set_snapshot(model, snapshot);
+         system_panel_update(model->snapshot);
+         if (tree_window.window != NULL) {
+             tree_window_update(model->snapshot);
+         }
+         snapshot_consumed(snapshot);
+     }
+     profile_record(PROFILE_VIEW_MERGE, profile_now() - start);
+     update_profile_display();
+     
+     /* Expand a process asked for in on_test_expand_row() once its threads have been read */
+     if (pending_expand_pid != -1) {
+         int index = process_model_find(model, pending_expand_pid);
+         if (index == -1) {
+             pending_expand_pid = -1;
+         } else if (model->rows[index].list->thread_rows[model->rows[index].index] > 0) {
+             GtkTreePath *path = gtk_tree_path_new_from_indices(index, -1);
+             pending_expand_pid = -1;
+             gtk_tree_view_expand_row(GTK_TREE_VIEW(process_view), path, FALSE);
+             gtk_tree_path_free(path);
+         }
+     }
+     
+     /* History moved on for every row, not just the ones the merge signalled */
+     if (history_budget > 0) {
+         gtk_widget_queue_draw(process_view);
+         if (history_window.graph != NULL) {
+             gtk_widget_queue_draw(history_window.graph);
+         }
+     }
+     
+     return FALSE;  // Remove the idle source
  }
  
  /* Kill button click handler */
@@ -308,8 +1911,18 @@
      GtkTreeModel *model;
      
      if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+         // A thread row terminates the process it belongs to
+         GtkTreeIter process = iter;
+         if (process_model_is_thread(&iter)) {
+             gtk_tree_model_iter_parent(model, &process, &iter);
+         }
          int pid;
-         gtk_tree_model_get(model, &iter, 0, &pid, -1);
+         gtk_tree_model_get(model, &process, PROCESS_MODEL_COL_PID, &pid, -1);
+         
+         // Taken before the dialog, as a newer snapshot may have a different process with this PID
+         int row = process_model_find(process_model, pid);
+         const ProcessModelRow *entry = row >= 0 ? &process_model->rows[row] : NULL;
+         unsigned long long start_time = entry != NULL ? entry->list->start_time[entry->index] : 0;
          
          /* Confirm before killing */
          GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(process_view)),
@@ -322,9 +1935,18 @@
          gtk_widget_destroy(dialog);
          
          if (response == GTK_RESPONSE_YES) {
-             kill_process(pid);
-             update_process_data();
-             populate_process_view(process_store);
+             if (!kill_process(pid, start_time)) {
+                 int error = errno;
+                 dialog = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(process_view)),
+                                                 GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                 GTK_MESSAGE_ERROR,
+                                                 GTK_BUTTONS_CLOSE,
+                                                 "Could not terminate process %d: %s", pid,
+                                                 error == ESRCH ? "it has already exited" : g_strerror(error));
+                 gtk_dialog_run(GTK_DIALOG(dialog));
+                 gtk_widget_destroy(dialog);
+             }
+             request_refresh();
          }
      }
  }
@@ -334,15 +1956,14 @@
      (void)widget;  // Unused parameter
      (void)data;    // Unused parameter
      
-     update_process_data();
-     populate_process_view(process_store);
+     request_refresh();
  }
  
  /* Interval change handler */
  static void on_interval_changed(GtkSpinButton *spinbutton, gpointer data) {
      (void)data;  // Unused parameter
      
-     update_interval_ms = gtk_spin_button_get_value_as_int(spinbutton);
+     set_update_interval(gtk_spin_button_get_value_as_int(spinbutton));
  }
  
  /* Row selection handler */
@@ -358,212 +1979,120 @@
      }
  }
  
- #ifdef _WIN32
- /* Get Windows processes */
- static void get_win_processes(ProcessList *list) {
-     HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-     if (snapshot == INVALID_HANDLE_VALUE) {
-         return;
-     }
+ /*
+  * Row expansion handler. The sampler only reads the threads of expanded
+  * processes, so a process without thread rows yet is marked expanded, a
+  * refresh is requested and the row is expanded when the threads arrive.
+  */
+ static gboolean on_test_expand_row(GtkTreeView *view, GtkTreeIter *iter, GtkTreePath *path, gpointer data) {
+     (void)path;  // Unused parameter
+     (void)data;  // Unused parameter
      
-     PROCESSENTRY32 process;
-     process.dwSize = sizeof(PROCESSENTRY32);
+     GtkTreeModel *model = gtk_tree_view_get_model(view);
+     int pid;
+     gtk_tree_model_get(model, iter, PROCESS_MODEL_COL_PID, &pid, -1);
+     set_threads_expanded(pid, 1);
      
-     if (!Process32First(snapshot, &process)) {
-         CloseHandle(snapshot);
-         return;
+     if (!gtk_tree_model_iter_has_child(model, iter) || gtk_tree_model_iter_n_children(model, iter) == 0) {
+         pending_expand_pid = pid;
+         request_refresh();
+         return TRUE;  // Don't expand yet
      }
-     
-     do {
-         HANDLE handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, process.th32ProcessID);
-         if (handle) {
-             PROCESS_MEMORY_COUNTERS pmc;
-             if (GetProcessMemoryInfo(handle, &pmc, sizeof(pmc))) {
-                 // Get system memory info for percentage calculation
-                 MEMORYSTATUSEX memInfo;
-                 memInfo.dwLength = sizeof(MEMORYSTATUSEX);
-                 GlobalMemoryStatusEx(&memInfo);
-                 
-                 // Calculate memory usage percentage
-                 double memUsage = (double)pmc.WorkingSetSize / (double)memInfo.ullTotalPhys * 100.0;
-                 
-                 // TODO: Calculate CPU usage (requires multiple sampling)
-                 double cpuUsage = 0.0;  // Placeholder
-                 
-                 add_process(list, process.th32ProcessID, process.szExeFile, cpuUsage, memUsage);
-             }
-             CloseHandle(handle);
-         }
-     } while (Process32Next(snapshot, &process));
-     
-     CloseHandle(snapshot);
+     return FALSE;
  }
- #elif defined(__APPLE__)
- /* Get macOS processes */
- static void get_mac_processes(ProcessList *list) {
-     // Get all BSD processes
-     int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0 };
-     size_t size;
-     
-     if (sysctl(mib, 4, NULL, &size, NULL, 0) < 0) {
-         return;
-     }
-     
-     struct kinfo_proc *processes = malloc(size);
-     if (processes == NULL) {
-         return;
-     }
-     
-     if (sysctl(mib, 4, processes, &size, NULL, 0) < 0) {
-         free(processes);
-         return;
-     }
-     
-     // Calculate number of processes
-     int count = size / sizeof(struct kinfo_proc);
-     
-     // Get host port for memory info
-     host_t host = mach_host_self();
-     vm_size_t page_size;
-     mach_msg_type_number_t count_info;
-     vm_statistics_data_t vm_stats;
-     mach_port_t host_port;
-     
-     host_port = mach_host_self();
-     count_info = HOST_VM_INFO_COUNT;
-     
-     if (host_page_size(host, &page_size) != KERN_SUCCESS) {
-         page_size = 4096;  // Default page size if we can't get it
-     }
-     
-     if (host_statistics(host_port, HOST_VM_INFO, (host_info_t)&vm_stats, &count_info) != KERN_SUCCESS) {
-         free(processes);
-         return;
-     }
-     
-     // Total physical memory (approximate)
-     int64_t total_mem = (int64_t)page_size * 
-                       (vm_stats.free_count + vm_stats.active_count + 
-                        vm_stats.inactive_count + vm_stats.wire_count);
+ 
+ /* Row collapse handler; stop reading the process's threads */
+ static void on_row_collapsed(GtkTreeView *view, GtkTreeIter *iter, GtkTreePath *path, gpointer data) {
+     (void)path;  // Unused parameter
+     (void)data;  // Unused parameter
      
-     for (int i = 0; i < count; i++) {
-         pid_t pid = processes[i].kp_proc.p_pid;
-         
-         if (pid == 0) continue;  // Skip kernel_task
-         
-         // Get process info
-         task_t task;
-         if (task_for_pid(mach_task_self(), pid, &task) == KERN_SUCCESS) {
-             struct task_basic_info task_info;
-             mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
-             
-             if (task_info(task, TASK_BASIC_INFO, (task_info_t)&task_info, &count) == KERN_SUCCESS) {
-                 // Calculate memory usage
-                 double mem_usage = (double)task_info.resident_size / (double)total_mem * 100.0;
-                 
-                 // Get process name
-                 char name[256];
-                 proc_name(pid, name, sizeof(name));
-                 
-                 // TODO: Calculate CPU usage (requires multiple sampling)
-                 double cpu_usage = 0.0;  // Placeholder
-                 
-                 add_process(list, pid, name, cpu_usage, mem_usage);
-             }
-             
-             mach_port_deallocate(mach_task_self(), task);
+     int pid;
+     gtk_tree_model_get(gtk_tree_view_get_model(view), iter, PROCESS_MODEL_COL_PID, &pid, -1);
+     set_threads_expanded(pid, 0);
+ }
+ 
+ /* Make a column header select a sort key when clicked */
+ static void set_sort_column(GtkTreeViewColumn *column, ViewSortKey key) {
+     sort_columns[key] = column;
+     gtk_tree_view_column_set_clickable(column, TRUE);
+     g_signal_connect(column, "clicked", G_CALLBACK(on_column_clicked), GINT_TO_POINTER(key));
+ }
+ 
+ /* Show the view spec's sort key and direction on the column headers */
+ static void update_sort_indicators(void) {
+     ViewSpec spec;
+     view_get_spec(&spec);
+     for (int key = 0; key < VIEW_N_SORT_KEYS; key++) {
+         if (sort_columns[key] != NULL) {
+             gtk_tree_view_column_set_sort_indicator(sort_columns[key], key == (int)spec.sort_key);
+             gtk_tree_view_column_set_sort_order(sort_columns[key],
+                                                 spec.descending ? GTK_SORT_DESCENDING : GTK_SORT_ASCENDING);
          }
      }
-     
-     free(processes);
  }
- #else
- /* Get Linux processes */
- static void get_linux_processes(ProcessList *list) {
-     DIR *dir;
-     struct dirent *entry;
-     char path[256];
-     char line[256];
-     
-     // Open /proc directory
-     dir = opendir("/proc");
-     if (dir == NULL) {
-         perror("Cannot open /proc");
-         return;
+ 
+ /* Column header click handler; a second click on the same column reverses the order */
+ static void on_column_clicked(GtkTreeViewColumn *column, gpointer data) {
+     (void)column;  // Unused parameter
+     
+     ViewSpec spec;
+     view_get_spec(&spec);
+     ViewSortKey key = (ViewSortKey)GPOINTER_TO_INT(data);
+     if (spec.sort_key == key) {
+         spec.descending = !spec.descending;
+     } else {
+         spec.sort_key = key;
+         spec.descending = key >= VIEW_SORT_CPU;  // Usage columns start with the largest
      }
+     view_set_spec(&spec);
+     update_sort_indicators();
+     request_refresh();
+ }
+ 
+ /* Name filter handler */
+ static void on_filter_changed(GtkSearchEntry *entry, gpointer data) {
+     (void)data;  // Unused parameter
      
-     // Get system memory info
-     FILE *meminfo = fopen("/proc/meminfo", "r");
-     unsigned long total_mem = 0;
+     ViewSpec spec;
+     view_get_spec(&spec);
+     g_strlcpy(spec.filter, gtk_entry_get_text(GTK_ENTRY(entry)), sizeof(spec.filter));
+     view_set_spec(&spec);
+     request_refresh();
+ }
+ 
+ /* Regex toggle handler */
+ static void on_filter_regex_toggled(GtkToggleButton *button, gpointer data) {
+     (void)data;  // Unused parameter
      
-     if (meminfo) {
-         if (fgets(line, sizeof(line), meminfo)) {
-             sscanf(line, "MemTotal: %lu kB", &total_mem);
-             total_mem *= 1024;  // Convert to bytes
-         }
-         fclose(meminfo);
-     }
+     ViewSpec spec;
+     view_get_spec(&spec);
+     spec.filter_regex = gtk_toggle_button_get_active(button);
+     view_set_spec(&spec);
+     request_refresh();
+ }
+ 
+ /* "My processes only" toggle handler */
+ static void on_mine_toggled(GtkToggleButton *button, gpointer data) {
+     (void)data;  // Unused parameter
      
-     // Read through each directory in /proc
-     while ((entry = readdir(dir)) != NULL) {
-         // Check if the name is a number (pid)
-         if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9') {
-             int pid = atoi(entry->d_name);
-             
-             // Get process name from /proc/[pid]/comm
-             snprintf(path, sizeof(path), "/proc/%d/comm", pid);
-             FILE *comm = fopen(path, "r");
-             char name[256] = "<unknown>";
-             
-             if (comm) {
-                 if (fgets(name, sizeof(name), comm)) {
-                     // Remove newline
-                     size_t len = strlen(name);
-                     if (len > 0 && name[len-1] == '\n') {
-                         name[len-1] = '\0';
-                     }
-                 }
-                 fclose(comm);
-             }
-             
-             // Get memory usage
-             snprintf(path, sizeof(path), "/proc/%d/statm", pid);
-             FILE *statm = fopen(path, "r");
-             unsigned long rss = 0;
-             
-             if (statm) {
-                 if (fscanf(statm, "%*u %lu", &rss) == 1) {
-                     rss *= sysconf(_SC_PAGESIZE);  // Convert to bytes
-                 }
-                 fclose(statm);
-             }
-             
-             // Calculate memory usage percentage
-             double mem_usage = 0.0;
-             if (total_mem > 0) {
-                 mem_usage = (double)rss / (double)total_mem * 100.0;
-             }
-             
-             // Get CPU usage (simplified, more accurate would require multiple samples)
-             double cpu_usage = 0.0;
-             snprintf(path, sizeof(path), "/proc/%d/stat", pid);
-             FILE *stat = fopen(path, "r");
-             
-             if (stat) {
-                 unsigned long utime, stime;
-                 if (fscanf(stat, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %lu %lu", 
-                           &utime, &stime) == 2) {
-                     // This is a simplified version. For accurate CPU usage,
-                     // we would need to sample at intervals and calculate deltas
-                     cpu_usage = (utime + stime) / 100.0;  // Just a placeholder
-                 }
-                 fclose(stat);
-             }
-             
-             add_process(list, pid, name, cpu_usage, mem_usage);
-         }
-     }
+     ViewSpec spec;
+     view_get_spec(&spec);
+ #ifndef _WIN32
+     spec.uid = gtk_toggle_button_get_active(button) ? (int)getuid() : -1;
+ #else
+     (void)button;  // Unused parameter
+ #endif
+     view_set_spec(&spec);
+     request_refresh();
+ }
+ 
+ /* Row limit handler */
+ static void on_top_changed(GtkSpinButton *spinbutton, gpointer data) {
+     (void)data;  // Unused parameter
      
-     closedir(dir);
+     ViewSpec spec;
+     view_get_spec(&spec);
+     spec.limit = gtk_spin_button_get_value_as_int(spinbutton);
+     view_set_spec(&spec);
+     request_refresh();
  }
- #endif
\ No newline at end of file
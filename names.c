@@ -0,0 +1,146 @@
+/**
+ * CPU and Memory Usage Tracker - interned process names
+ * 
+ * Names live in an open-addressed table and are never changed once made.
+ * The sampler stamps each name with the newest snapshot that uses it and
+ * now and then frees the names no snapshot a reader can still hold uses.
+ * Processes only change names on exec or a comm write, so the scan can
+ * usually reuse the previous tick's pointer without touching the table.
+ */
+
+ #include <pthread.h>
+ #include <stddef.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #include "names.h"
+ 
+ #define NAME_MAX_LENGTH 254     // Longer names are cut short
+ #define NAMES_MIN_CAPACITY 256
+ 
+ /* One interned name; rows point at its text */
+ typedef struct {
+     unsigned long last_used;    // Sequence of the newest snapshot with a row using it
+     unsigned int hash;
+     char text[];
+ } NameEntry;
+ 
+ /* Global variables */
+ static pthread_mutex_t names_lock = PTHREAD_MUTEX_INITIALIZER;  // Scan workers intern concurrently
+ static NameEntry **slots = NULL;           // Open-addressed by hash, NULL for an empty slot
+ static unsigned int slot_capacity = 0;     // Power of two
+ static unsigned int name_count = 0;
+ static unsigned long next_sequence = 1;    // Sequence of the snapshot being filled
+ 
+ /* Function prototypes */
+ static unsigned int name_hash(const char *name, size_t len);
+ static void slots_insert(NameEntry **table, unsigned int capacity, NameEntry *entry);
+ static void slots_rebuild(unsigned int capacity);
+ 
+ /* FNV-1a hash of a name */
+ static unsigned int name_hash(const char *name, size_t len) {
+     unsigned int hash = 2166136261u;
+     for (size_t i = 0; i < len; i++) {
+         hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+     }
+     return hash;
+ }
+ 
+ /* Put an entry into the first free slot of its probe sequence */
+ static void slots_insert(NameEntry **table, unsigned int capacity, NameEntry *entry) {
+     unsigned int mask = capacity - 1;
+     unsigned int i = entry->hash & mask;
+     while (table[i] != NULL) {
+         i = (i + 1) & mask;
+     }
+     table[i] = entry;
+ }
+ 
+ /* Move every entry into a new table of the given capacity */
+ static void slots_rebuild(unsigned int capacity) {
+     NameEntry **table = (NameEntry**)calloc(capacity, sizeof(NameEntry*));
+     for (unsigned int i = 0; i < slot_capacity; i++) {
+         if (slots[i] != NULL) {
+             slots_insert(table, capacity, slots[i]);
+         }
+     }
+     free(slots);
+     slots = table;
+     slot_capacity = capacity;
+ }
+ 
+ /* The shared copy of a name, made on first use; valid while a snapshot using it is */
+ const char *names_intern(const char *name) {
+     size_t len = strnlen(name, NAME_MAX_LENGTH);
+     unsigned int hash = name_hash(name, len);
+     
+     pthread_mutex_lock(&names_lock);
+     if ((name_count + 1) * 2 > slot_capacity) {
+         slots_rebuild(slot_capacity > 0 ? slot_capacity * 2 : NAMES_MIN_CAPACITY);
+     }
+     unsigned int mask = slot_capacity - 1;
+     unsigned int i = hash & mask;
+     for (; slots[i] != NULL; i = (i + 1) & mask) {
+         if (slots[i]->hash == hash && strncmp(slots[i]->text, name, len) == 0 && slots[i]->text[len] == '\0') {
+             const char *text = slots[i]->text;
+             pthread_mutex_unlock(&names_lock);
+             return text;
+         }
+     }
+     
+     NameEntry *entry = (NameEntry*)malloc(sizeof(NameEntry) + len + 1);
+     entry->last_used = next_sequence;  // Kept until at least the snapshot being filled is gone
+     entry->hash = hash;
+     memcpy(entry->text, name, len);
+     entry->text[len] = '\0';
+     slots[i] = entry;
+     name_count++;
+     pthread_mutex_unlock(&names_lock);
+     return entry->text;
+ }
+ 
+ /* Stamp the names of a snapshot's rows with its sequence */
+ void names_mark(const ProcessList *list, unsigned long sequence) {
+     for (int i = 0; i < list->count; i++) {
+         NameEntry *entry = (NameEntry*)(list->name[i] - offsetof(NameEntry, text));
+         entry->last_used = sequence;
+     }
+     next_sequence = sequence + 1;
+ }
+ 
+ /* Free the names last used before the oldest snapshot a reader may still hold */
+ void names_collect(unsigned long oldest_live) {
+     pthread_mutex_lock(&names_lock);
+     unsigned int freed = 0;
+     for (unsigned int i = 0; i < slot_capacity; i++) {
+         if (slots[i] != NULL && slots[i]->last_used < oldest_live) {
+             free(slots[i]);
+             slots[i] = NULL;
+             freed++;
+         }
+     }
+     if (freed > 0) {
+         // Open addressing cannot leave holes in probe sequences, so the survivors are reinserted
+         name_count -= freed;
+         unsigned int capacity = slot_capacity;
+         while (capacity > NAMES_MIN_CAPACITY && name_count * 8 < capacity) {
+             capacity /= 2;
+         }
+         slots_rebuild(capacity);
+     }
+     pthread_mutex_unlock(&names_lock);
+ }
+ 
+ /* Free every name, once no snapshot is read any more */
+ void names_free(void) {
+     pthread_mutex_lock(&names_lock);
+     for (unsigned int i = 0; i < slot_capacity; i++) {
+         free(slots[i]);
+     }
+     free(slots);
+     slots = NULL;
+     slot_capacity = 0;
+     name_count = 0;
+     next_sequence = 1;
+     pthread_mutex_unlock(&names_lock);
+ }
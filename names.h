@@ -0,0 +1,22 @@
+/**
+ * CPU and Memory Usage Tracker - interned process names
+ * 
+ * Rows point at one shared, immutable copy of each process name instead
+ * of carrying their own. A name stays valid while any snapshot that has a
+ * row using it can still be read.
+ */
+
+ #ifndef NAMES_H
+ #define NAMES_H
+ 
+ #include "sampler.h"
+ 
+ /* Interning, from any thread */
+ const char *names_intern(const char *name);
+ 
+ /* Collection, from the sampler thread */
+ void names_mark(const ProcessList *list, unsigned long sequence);
+ void names_collect(unsigned long oldest_live);
+ void names_free(void);
+ 
+ #endif /* NAMES_H */
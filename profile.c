@@ -0,0 +1,173 @@
+/**
+ * CPU and Memory Usage Tracker - self-profiling
+ * 
+ * Each phase has a histogram with 16 linear sub-buckets per power of two,
+ * so any recorded value is known to within about 6% in constant memory.
+ * Buckets are relaxed atomics: phases are recorded by the sampler and the
+ * GTK thread and read by either without a lock.
+ */
+
+ #include <stdarg.h>
+ #include <stdatomic.h>
+ #include <stdio.h>
+ 
+ #include "profile.h"
+ 
+ #define PROFILE_SUB_BITS 4                        // 16 sub-buckets per power of two
+ #define PROFILE_SUB_COUNT (1 << PROFILE_SUB_BITS)
+ #define PROFILE_MAX_BITS 40                       // Values are clamped below 2^40 ns (about 18 minutes)
+ #define PROFILE_BUCKETS ((PROFILE_MAX_BITS - PROFILE_SUB_BITS + 1) * PROFILE_SUB_COUNT)
+ 
+ /* Histogram of one phase */
+ typedef struct {
+     atomic_ullong buckets[PROFILE_BUCKETS];
+     atomic_ullong count;
+     atomic_ullong total;
+     atomic_ullong max;
+ } ProfileHistogram;
+ 
+ /* Global variables */
+ static ProfileHistogram histograms[PROFILE_N_PHASES];
+ static atomic_ullong overruns;
+ static const char *phase_names[PROFILE_N_PHASES] = {
+     "tick", "readdir", "open", "read", "parse", "smaps", "rollup", "watchdog", "publish", "view wait", "view merge"
+ };
+ 
+ /* Function prototypes */
+ static int bucket_index(unsigned long long ns);
+ static unsigned long long bucket_upper(int index);
+ static unsigned long long histogram_percentile(const ProfileHistogram *histogram,
+                                                unsigned long long count, double fraction);
+ static void append_text(char *buf, size_t size, size_t *used, const char *format, ...);
+ 
+ /* Bucket of a value: exact below 2 * PROFILE_SUB_COUNT, then log-linear */
+ static int bucket_index(unsigned long long ns) {
+     if (ns >= 1ULL << PROFILE_MAX_BITS) {
+         ns = (1ULL << PROFILE_MAX_BITS) - 1;
+     }
+     if (ns < 2 * PROFILE_SUB_COUNT) {
+         return (int)ns;
+     }
+     int shift = 63 - __builtin_clzll(ns) - PROFILE_SUB_BITS;
+     return (shift + 1) * PROFILE_SUB_COUNT + (int)(ns >> shift) - PROFILE_SUB_COUNT;
+ }
+ 
+ /* Largest value that lands in a bucket */
+ static unsigned long long bucket_upper(int index) {
+     if (index < 2 * PROFILE_SUB_COUNT) {
+         return (unsigned long long)index;
+     }
+     int shift = index / PROFILE_SUB_COUNT - 1;
+     unsigned long long sub = (unsigned long long)(index % PROFILE_SUB_COUNT + PROFILE_SUB_COUNT);
+     return ((sub + 1) << shift) - 1;
+ }
+ 
+ /* Add one timing to a phase */
+ void profile_record(int phase, unsigned long long ns) {
+     ProfileHistogram *histogram = &histograms[phase];
+     
+     atomic_fetch_add_explicit(&histogram->buckets[bucket_index(ns)], 1, memory_order_relaxed);
+     atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+     atomic_fetch_add_explicit(&histogram->total, ns, memory_order_relaxed);
+     unsigned long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+     while (ns > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, ns,
+                                                               memory_order_relaxed, memory_order_relaxed)) {
+     }
+ }
+ 
+ /* Count a tick that took longer than the update interval */
+ void profile_overrun(void) {
+     atomic_fetch_add_explicit(&overruns, 1, memory_order_relaxed);
+ }
+ 
+ unsigned long long profile_overruns(void) {
+     return atomic_load_explicit(&overruns, memory_order_relaxed);
+ }
+ 
+ const char *profile_phase_name(int phase) {
+     return phase_names[phase];
+ }
+ 
+ /* Nearest-rank percentile, reported as the top of its bucket */
+ static unsigned long long histogram_percentile(const ProfileHistogram *histogram,
+                                                unsigned long long count, double fraction) {
+     unsigned long long rank = (unsigned long long)(fraction * count + 0.999999);
+     unsigned long long seen = 0;
+     
+     if (rank == 0) {
+         rank = 1;
+     }
+     for (int i = 0; i < PROFILE_BUCKETS; i++) {
+         seen += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+         if (seen >= rank) {
+             return bucket_upper(i);
+         }
+     }
+     return bucket_upper(PROFILE_BUCKETS - 1);
+ }
+ 
+ /*
+  * Summarize a phase. Counters are read one by one while others may be
+  * recording, so a summary taken mid-tick can be off by the timings in flight.
+  */
+ void profile_summarize(int phase, ProfileSummary *summary) {
+     const ProfileHistogram *histogram = &histograms[phase];
+     
+     summary->count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+     summary->max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+     if (summary->count == 0) {
+         summary->mean = summary->p50 = summary->p90 = summary->p99 = 0;
+         return;
+     }
+     summary->mean = atomic_load_explicit(&histogram->total, memory_order_relaxed) / summary->count;
+     summary->p50 = histogram_percentile(histogram, summary->count, 0.50);
+     summary->p90 = histogram_percentile(histogram, summary->count, 0.90);
+     summary->p99 = histogram_percentile(histogram, summary->count, 0.99);
+     
+     // The top bucket can overshoot the largest value actually seen
+     if (summary->p50 > summary->max) {
+         summary->p50 = summary->max;
+     }
+     if (summary->p90 > summary->max) {
+         summary->p90 = summary->max;
+     }
+     if (summary->p99 > summary->max) {
+         summary->p99 = summary->max;
+     }
+ }
+ 
+ /* Append formatted text to buf, keeping *used within size - 1 */
+ static void append_text(char *buf, size_t size, size_t *used, const char *format, ...) {
+     va_list args;
+     va_start(args, format);
+     int len = vsnprintf(buf + *used, size - *used, format, args);
+     va_end(args);
+     if (len > 0) {
+         *used += (size_t)len < size - *used ? (size_t)len : size - *used - 1;
+     }
+ }
+ 
+ /* Write a table of every phase into buf; returns the length, truncated to fit */
+ size_t profile_format(char *buf, size_t size) {
+     size_t used = 0;
+     
+     buf[0] = '\0';
+     append_text(buf, size, &used, "%-11s %8s %10s %10s %10s %10s %10s\n",
+                 "phase", "count", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+     for (int phase = 0; phase < PROFILE_N_PHASES; phase++) {
+         ProfileSummary summary;
+         profile_summarize(phase, &summary);
+         append_text(buf, size, &used, "%-11s %8llu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                     phase_names[phase], summary.count, summary.mean / 1e6, summary.p50 / 1e6,
+                     summary.p90 / 1e6, summary.p99 / 1e6, summary.max / 1e6);
+     }
+     append_text(buf, size, &used, "%-11s %8llu\n", "overruns", profile_overruns());
+     return used;
+ }
+ 
+ /* Print the table, as for --stats */
+ void profile_dump(FILE *out) {
+     char buf[2048];
+     profile_format(buf, sizeof(buf));
+     fputs(buf, out);
+ }
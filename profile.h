@@ -0,0 +1,66 @@
+/**
+ * CPU and Memory Usage Tracker - self-profiling
+ * 
+ * Monotonic-clock timings of the sampler and view phases, kept in
+ * fixed-size log-linear (HDR-style) histograms.
+ */
+
+ #ifndef PROFILE_H
+ #define PROFILE_H
+ 
+ #include <stddef.h>
+ #include <stdio.h>
+ #include <time.h>
+ 
+ /* Profiled phases */
+ enum {
+     PROFILE_TICK,         // Whole sampler tick
+     PROFILE_READDIR,      // Listing the PIDs
+     PROFILE_OPEN,         // Opening and closing /proc files, summed across scan threads
+     PROFILE_READ,         // Reading /proc files, summed across scan threads
+     PROFILE_PARSE,        // Parsing and accounting, summed across scan threads
+     PROFILE_SMAPS,        // Reading smaps_rollup of the largest processes
+     PROFILE_ROLLUP,       // Process tree and cgroup totals, with the cgroups' own counters
+     PROFILE_WATCHDOG,     // Matching the watchdog rules and taking their actions
+     PROFILE_PUBLISH,      // Sorting, history, recording and publishing the snapshot
+     PROFILE_VIEW_WAIT,    // From publish until the view picks the snapshot up
+     PROFILE_VIEW_MERGE,   // Merging the snapshot into the view's model
+     PROFILE_N_PHASES
+ };
+ 
+ /* Percentiles of one phase, in nanoseconds */
+ typedef struct {
+     unsigned long long count;
+     unsigned long long mean;
+     unsigned long long p50;
+     unsigned long long p90;
+     unsigned long long p99;
+     unsigned long long max;
+ } ProfileSummary;
+ 
+ /* Monotonic time in nanoseconds */
+ static inline unsigned long long profile_now(void) {
+     struct timespec now;
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+ }
+ 
+ /* Add the time since *mark to *total and move the mark to now */
+ static inline void profile_lap(unsigned long long *mark, unsigned long long *total) {
+     unsigned long long now = profile_now();
+     *total += now - *mark;
+     *mark = now;
+ }
+ 
+ /* Recording, from any thread */
+ void profile_record(int phase, unsigned long long ns);
+ void profile_overrun(void);
+ 
+ /* Reading, from any thread */
+ const char *profile_phase_name(int phase);
+ void profile_summarize(int phase, ProfileSummary *summary);
+ unsigned long long profile_overruns(void);
+ size_t profile_format(char *buf, size_t size);
+ void profile_dump(FILE *out);
+ 
+ #endif /* PROFILE_H */
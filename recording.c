@@ -0,0 +1,955 @@
+/**
+ * CPU and Memory Usage Tracker - session recording
+ * 
+ * File layout, all integers little-endian:
+ * 
+ *   RecordingHeader
+ *   block*               each: RecordingBlock, new names, frames
+ *   index footer         written on a clean finish: index entries,
+ *                        name offsets, RecordingTrailer
+ * 
+ * A frame is one snapshot stored column by column: PIDs, CPU, memory and
+ * name ids, each as zigzag varints. PIDs are deltas from the previous row;
+ * CPU, memory and name ids are deltas from the same PID in the previous
+ * frame of the block, so a steady process costs a few zero bytes. Blocks
+ * start from empty state and can be decoded on their own. Names are
+ * interned once per recording and read in place from the mapping.
+ * 
+ * A recording that was not finished (the tracker crashed or is still
+ * recording) has no footer; its index is rebuilt by walking block headers.
+ */
+
+ #include <errno.h>
+ #include <fcntl.h>
+ #include <stdint.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+ 
+ #ifdef _WIN32
+ #include <io.h>
+ #else
+ #include <sys/mman.h>
+ #include <sys/uio.h>
+ #endif
+ 
+ #include "recording.h"
+ 
+ #ifdef _WIN32
+ struct iovec {
+     void *iov_base;
+     size_t iov_len;
+ };
+ #endif
+ 
+ #define RECORDING_MAGIC "CMTR"
+ #define RECORDING_BLOCK_MAGIC "CMTB"
+ #define RECORDING_TRAILER_MAGIC "CMTI"
+ #define RECORDING_VERSION 2                // 1 stored memory in thousandths; still read
+ #define RECORDING_BLOCK_FRAMES 64          // Frames per block, also the seek granularity
+ #define RECORDING_BLOCK_BYTES (1 << 20)    // Flush a block early once its frames get this big
+ #define RECORDING_CPU_SCALE 100.0          // CPU% is stored in hundredths
+ #define RECORDING_MEMORY_SCALE 100.0       // Memory% too, so a replay prints the same two decimals as live
+ #define RECORDING_V1_MEMORY_SCALE 1000.0
+ 
+ /* Start of the file */
+ typedef struct {
+     char magic[4];                   // RECORDING_MAGIC
+     uint32_t version;                // RECORDING_VERSION
+     uint64_t reserved;
+ } RecordingHeader;
+ 
+ /* Start of every block */
+ typedef struct {
+     char magic[4];                   // RECORDING_BLOCK_MAGIC
+     uint32_t size;                   // Whole block including this header
+     uint32_t frame_count;
+     uint32_t name_count;             // Names first used in this block, ids follow on from earlier blocks
+     uint64_t first_timestamp_ns;
+     uint64_t last_timestamp_ns;
+ } RecordingBlock;
+ 
+ /* One block in the time index */
+ typedef struct {
+     uint64_t first_timestamp_ns;
+     uint64_t last_timestamp_ns;
+     uint64_t offset;                 // File offset of the RecordingBlock
+ } RecordingIndexEntry;
+ 
+ /* End of a finished recording */
+ typedef struct {
+     char magic[4];                   // RECORDING_TRAILER_MAGIC
+     uint32_t block_count;            // Index entries
+     uint32_t name_count;             // Name offsets, one uint64 each, after the index
+     uint32_t reserved;
+     uint64_t index_offset;
+ } RecordingTrailer;
+ 
+ /* Quantized row, kept from the previous frame for deltas */
+ typedef struct {
+     int pid;
+     uint32_t name_id;
+     int64_t cpu;
+     int64_t mem;
+ } FrameRow;
+ 
+ /* Growable byte buffer */
+ typedef struct {
+     unsigned char *data;
+     size_t size;
+     size_t capacity;
+ } Buffer;
+ 
+ /* Name -> id slot of the intern table */
+ typedef struct {
+     uint32_t hash;
+     uint32_t id;                     // Name id + 1, 0 marks an empty slot
+ } NameSlot;
+ 
+ struct RecordingWriter {
+     int fd;
+     uint64_t offset;                 // File offset of the next block
+     /* Block being built */
+     Buffer names;                    // Names first used in this block
+     Buffer frames;
+     uint32_t frame_count;
+     uint32_t first_name;             // Id of the first name in `names`
+     uint64_t first_timestamp_ns;
+     uint64_t timestamp_ns;           // Timestamp of the last frame as the reader will decode it
+     FrameRow *rows;
+     FrameRow *prev_rows;
+     int prev_count;
+     int row_capacity;
+     /* Interned names; name_offsets are relative to `names` until their block is flushed */
+     char *arena;
+     size_t arena_size;
+     size_t arena_capacity;
+     uint64_t *name_offsets;
+     size_t *name_arena;              // Arena offset of each name
+     uint32_t name_count;
+     uint32_t name_capacity;
+     NameSlot *slots;
+     uint32_t slot_capacity;          // Power of two
+     RecordingIndexEntry *index;
+     uint32_t block_count;
+     uint32_t index_capacity;
+     int failed;
+ };
+ 
+ struct Recording {
+     const unsigned char *data;
+     size_t size;
+     RecordingIndexEntry *index;
+     uint32_t block_count;
+     uint64_t *name_offsets;
+     uint32_t name_count;
+     double memory_scale;             // Of the memory column in this file's version
+     /* Replay cursor */
+     uint32_t block;                  // Block being read, block_count at the end
+     uint32_t frame;                  // Frames already read from it
+     uint32_t frame_count;
+     const unsigned char *pos;
+     const unsigned char *end;
+     uint64_t timestamp_ns;           // Last frame read
+     FrameRow *rows;
+     FrameRow *prev_rows;
+     int prev_count;
+     int row_capacity;
+ };
+ 
+ /* Function prototypes */
+ static int buffer_reserve(Buffer *buffer, size_t size);
+ static void put_varint(Buffer *buffer, uint64_t value);
+ static void put_svarint(Buffer *buffer, int64_t value);
+ static int get_varint(const unsigned char **pos, const unsigned char *end, uint64_t *value);
+ static int get_svarint(const unsigned char **pos, const unsigned char *end, int64_t *value);
+ static uint32_t intern_name(RecordingWriter *writer, const char *name);
+ static int flush_block(RecordingWriter *writer);
+ static int write_all(int fd, struct iovec *iov, int count);
+ static int rows_reserve(FrameRow **rows, FrameRow **prev_rows, int *capacity, int count);
+ static int build_index(Recording *recording);
+ static int check_footer(const Recording *recording, uint64_t index_offset);
+ static int enter_block(Recording *recording, uint32_t block);
+ 
+ /* Make room for size more bytes */
+ static int buffer_reserve(Buffer *buffer, size_t size) {
+     if (buffer->size + size <= buffer->capacity) {
+         return 1;
+     }
+     size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+     while (capacity < buffer->size + size) {
+         capacity *= 2;
+     }
+     unsigned char *data = realloc(buffer->data, capacity);
+     if (data == NULL) {
+         return 0;
+     }
+     buffer->data = data;
+     buffer->capacity = capacity;
+     return 1;
+ }
+ 
+ /* Append an unsigned LEB128 varint; the caller has reserved 10 bytes */
+ static void put_varint(Buffer *buffer, uint64_t value) {
+     while (value >= 0x80) {
+         buffer->data[buffer->size++] = (unsigned char)(value | 0x80);
+         value >>= 7;
+     }
+     buffer->data[buffer->size++] = (unsigned char)value;
+ }
+ 
+ /* Append a zigzag-encoded signed varint */
+ static void put_svarint(Buffer *buffer, int64_t value) {
+     put_varint(buffer, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+ }
+ 
+ /* Read an unsigned varint; returns 0 if it runs past end */
+ static int get_varint(const unsigned char **pos, const unsigned char *end, uint64_t *value) {
+     const unsigned char *p = *pos;
+     uint64_t result = 0;
+     for (int shift = 0; shift < 64; shift += 7) {
+         if (p >= end) {
+             return 0;
+         }
+         result |= (uint64_t)(*p & 0x7f) << shift;
+         if ((*p++ & 0x80) == 0) {
+             *pos = p;
+             *value = result;
+             return 1;
+         }
+     }
+     return 0;
+ }
+ 
+ /* Read a zigzag-encoded signed varint */
+ static int get_svarint(const unsigned char **pos, const unsigned char *end, int64_t *value) {
+     uint64_t raw;
+     if (!get_varint(pos, end, &raw)) {
+         return 0;
+     }
+     *value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+     return 1;
+ }
+ 
+ /* Grow a pair of row arrays to hold count rows */
+ static int rows_reserve(FrameRow **rows, FrameRow **prev_rows, int *capacity, int count) {
+     if (count <= *capacity) {
+         return 1;
+     }
+     int new_capacity = *capacity > 0 ? *capacity : 256;
+     while (new_capacity < count) {
+         new_capacity *= 2;
+     }
+     FrameRow *grown = realloc(*rows, new_capacity * sizeof(FrameRow));
+     if (grown == NULL) {
+         return 0;
+     }
+     *rows = grown;
+     grown = realloc(*prev_rows, new_capacity * sizeof(FrameRow));
+     if (grown == NULL) {
+         return 0;
+     }
+     *prev_rows = grown;
+     *capacity = new_capacity;
+     return 1;
+ }
+ 
+ /* Create a recording file and write its header; NULL on failure */
+ RecordingWriter *recording_create(const char *path) {
+     RecordingWriter *writer = calloc(1, sizeof(RecordingWriter));
+     if (writer == NULL) {
+         return NULL;
+     }
+     
+     writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+     if (writer->fd < 0) {
+         fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+         free(writer);
+         return NULL;
+     }
+     
+     RecordingHeader header;
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, RECORDING_MAGIC, 4);
+     header.version = RECORDING_VERSION;
+     struct iovec iov = { &header, sizeof(header) };
+     if (!write_all(writer->fd, &iov, 1)) {
+         close(writer->fd);
+         free(writer);
+         return NULL;
+     }
+     writer->offset = sizeof(header);
+     
+     return writer;
+ }
+ 
+ /* FNV-1a */
+ static uint32_t hash_name(const char *name) {
+     uint32_t hash = 2166136261u;
+     for (; *name != '\0'; name++) {
+         hash = (hash ^ (unsigned char)*name) * 16777619u;
+     }
+     return hash;
+ }
+ 
+ /* Id of a name, adding it to the current block's names the first time it is seen */
+ static uint32_t intern_name(RecordingWriter *writer, const char *name) {
+     uint32_t hash = hash_name(name);
+     
+     if (writer->slot_capacity > 0) {
+         uint32_t i = hash & (writer->slot_capacity - 1);
+         while (writer->slots[i].id != 0) {
+             uint32_t id = writer->slots[i].id - 1;
+             if (writer->slots[i].hash == hash && strcmp(writer->arena + writer->name_arena[id], name) == 0) {
+                 return id;
+             }
+             i = (i + 1) & (writer->slot_capacity - 1);
+         }
+     }
+     
+     /* New name: keep the table under half full */
+     if ((writer->name_count + 1) * 2 > writer->slot_capacity) {
+         uint32_t capacity = writer->slot_capacity > 0 ? writer->slot_capacity * 2 : 1024;
+         NameSlot *slots = calloc(capacity, sizeof(NameSlot));
+         if (slots == NULL) {
+             writer->failed = 1;
+             return 0;
+         }
+         for (uint32_t i = 0; i < writer->slot_capacity; i++) {
+             if (writer->slots[i].id != 0) {
+                 uint32_t j = writer->slots[i].hash & (capacity - 1);
+                 while (slots[j].id != 0) {
+                     j = (j + 1) & (capacity - 1);
+                 }
+                 slots[j] = writer->slots[i];
+             }
+         }
+         free(writer->slots);
+         writer->slots = slots;
+         writer->slot_capacity = capacity;
+     }
+     if (writer->name_count == writer->name_capacity) {
+         uint32_t capacity = writer->name_capacity > 0 ? writer->name_capacity * 2 : 1024;
+         uint64_t *offsets = realloc(writer->name_offsets, capacity * sizeof(uint64_t));
+         if (offsets != NULL) {
+             writer->name_offsets = offsets;
+         }
+         size_t *arena_offsets = realloc(writer->name_arena, capacity * sizeof(size_t));
+         if (arena_offsets != NULL) {
+             writer->name_arena = arena_offsets;
+         }
+         if (offsets == NULL || arena_offsets == NULL) {
+             writer->failed = 1;
+             return 0;
+         }
+         writer->name_capacity = capacity;
+     }
+     size_t len = strlen(name);
+     if (writer->arena_size + len + 1 > writer->arena_capacity) {
+         size_t capacity = writer->arena_capacity > 0 ? writer->arena_capacity * 2 : 65536;
+         while (capacity < writer->arena_size + len + 1) {
+             capacity *= 2;
+         }
+         char *arena = realloc(writer->arena, capacity);
+         if (arena == NULL) {
+             writer->failed = 1;
+             return 0;
+         }
+         writer->arena = arena;
+         writer->arena_capacity = capacity;
+     }
+     if (!buffer_reserve(&writer->names, len + 11)) {
+         writer->failed = 1;
+         return 0;
+     }
+     
+     uint32_t id = writer->name_count++;
+     memcpy(writer->arena + writer->arena_size, name, len + 1);
+     writer->name_arena[id] = writer->arena_size;
+     writer->arena_size += len + 1;
+     
+     put_varint(&writer->names, len);
+     writer->name_offsets[id] = writer->names.size;  // Made a file offset by flush_block()
+     memcpy(writer->names.data + writer->names.size, name, len + 1);
+     writer->names.size += len + 1;
+     
+     uint32_t i = hash & (writer->slot_capacity - 1);
+     while (writer->slots[i].id != 0) {
+         i = (i + 1) & (writer->slot_capacity - 1);
+     }
+     writer->slots[i].hash = hash;
+     writer->slots[i].id = id + 1;
+     
+     return id;
+ }
+ 
+ /*
+  * Append a snapshot as one frame. Rows are matched to the previous frame
+  * by a merge over the PID-ordered lists. Returns 0 once writing has failed.
+  */
+ int recording_append(RecordingWriter *writer, const Snapshot *snapshot) {
+     if (writer->failed) {
+         return 0;
+     }
+     
+     const ProcessList *list = &snapshot->list;
+     const ProcessList *exited = &snapshot->exited;
+     int n = list->count + exited->count;
+     if (!rows_reserve(&writer->rows, &writer->prev_rows, &writer->row_capacity, n) ||
+         !buffer_reserve(&writer->frames, 30 + (size_t)n * 40)) {
+         writer->failed = 1;
+         return 0;
+     }
+     
+     if (writer->frame_count == 0) {
+         writer->first_timestamp_ns = snapshot->timestamp_ns;
+         writer->timestamp_ns = snapshot->timestamp_ns;
+         writer->prev_count = 0;
+     }
+     
+     /* Quantize, intern names and find each live row's previous frame */
+     for (int i = 0; i < n; i++) {
+         const ProcessList *from = i < list->count ? list : exited;
+         int at = i < list->count ? i : i - list->count;
+         FrameRow *row = &writer->rows[i];
+         row->pid = from->pid[at];
+         row->name_id = intern_name(writer, from->name[at]);
+         row->cpu = (int64_t)(from->cpu_usage[at] * RECORDING_CPU_SCALE + 0.5);
+         row->mem = (int64_t)(from->memory_usage[at] * RECORDING_MEMORY_SCALE + 0.5);
+     }
+     if (writer->failed) {
+         return 0;
+     }
+     
+     /* Frame header */
+     Buffer *out = &writer->frames;
+     uint64_t delta_us = snapshot->timestamp_ns > writer->timestamp_ns ?
+                         (snapshot->timestamp_ns - writer->timestamp_ns) / 1000 : 0;
+     writer->timestamp_ns += delta_us * 1000;
+     put_varint(out, delta_us);
+     put_varint(out, (uint64_t)list->count);
+     put_varint(out, (uint64_t)exited->count);
+     
+     /* PID column */
+     int prev_pid = 0;
+     for (int i = 0; i < n; i++) {
+         put_svarint(out, (int64_t)writer->rows[i].pid - prev_pid);
+         prev_pid = writer->rows[i].pid;
+     }
+     
+     /* CPU, memory and name columns against the previous frame; exited rows are stored whole */
+     for (int column = 0; column < 3; column++) {
+         int prev = 0;
+         for (int i = 0; i < n; i++) {
+             const FrameRow *row = &writer->rows[i];
+             const FrameRow *before = NULL;
+             if (i < list->count) {
+                 while (prev < writer->prev_count && writer->prev_rows[prev].pid < row->pid) {
+                     prev++;
+                 }
+                 if (prev < writer->prev_count && writer->prev_rows[prev].pid == row->pid) {
+                     before = &writer->prev_rows[prev];
+                 }
+             }
+             if (column == 0) {
+                 put_svarint(out, row->cpu - (before != NULL ? before->cpu : 0));
+             } else if (column == 1) {
+                 put_svarint(out, row->mem - (before != NULL ? before->mem : 0));
+             } else {
+                 put_svarint(out, (int64_t)row->name_id - (before != NULL ? (int64_t)before->name_id : 0));
+             }
+         }
+     }
+     
+     /* The live rows become the previous frame */
+     FrameRow *swap = writer->prev_rows;
+     writer->prev_rows = writer->rows;
+     writer->rows = swap;
+     writer->prev_count = list->count;
+     writer->frame_count++;
+     
+     if (writer->frame_count == RECORDING_BLOCK_FRAMES || writer->frames.size >= RECORDING_BLOCK_BYTES) {
+         return flush_block(writer);
+     }
+     return 1;
+ }
+ 
+ /* Write iovecs completely, resuming after short writes */
+ static int write_all(int fd, struct iovec *iov, int count) {
+     while (count > 0) {
+         if (iov->iov_len == 0) {
+             iov++;
+             count--;
+             continue;
+         }
+ #ifdef _WIN32
+         ssize_t written = _write(fd, iov->iov_base, (unsigned int)iov->iov_len);
+ #else
+         ssize_t written = writev(fd, iov, count);
+ #endif
+         if (written < 0) {
+             if (errno == EINTR) {
+                 continue;
+             }
+             fprintf(stderr, "Recording write failed: %s\n", strerror(errno));
+             return 0;
+         }
+         while (count > 0 && (size_t)written >= iov->iov_len) {
+             written -= iov->iov_len;
+             iov++;
+             count--;
+         }
+         if (count > 0) {
+             iov->iov_base = (char*)iov->iov_base + written;
+             iov->iov_len -= written;
+         }
+     }
+     return 1;
+ }
+ 
+ /* Write the block being built with one writev() and add it to the index */
+ static int flush_block(RecordingWriter *writer) {
+     if (writer->frame_count == 0) {
+         return 1;
+     }
+     
+     RecordingBlock block;
+     memset(&block, 0, sizeof(block));
+     memcpy(block.magic, RECORDING_BLOCK_MAGIC, 4);
+     block.size = (uint32_t)(sizeof(block) + writer->names.size + writer->frames.size);
+     block.frame_count = writer->frame_count;
+     block.name_count = writer->name_count - writer->first_name;
+     block.first_timestamp_ns = writer->first_timestamp_ns;
+     block.last_timestamp_ns = writer->timestamp_ns;
+     
+     if (writer->block_count == writer->index_capacity) {
+         uint32_t capacity = writer->index_capacity > 0 ? writer->index_capacity * 2 : 256;
+         RecordingIndexEntry *index = realloc(writer->index, capacity * sizeof(RecordingIndexEntry));
+         if (index == NULL) {
+             writer->failed = 1;
+             return 0;
+         }
+         writer->index = index;
+         writer->index_capacity = capacity;
+     }
+     RecordingIndexEntry *entry = &writer->index[writer->block_count++];
+     entry->first_timestamp_ns = block.first_timestamp_ns;
+     entry->last_timestamp_ns = block.last_timestamp_ns;
+     entry->offset = writer->offset;
+     
+     for (uint32_t id = writer->first_name; id < writer->name_count; id++) {
+         writer->name_offsets[id] += writer->offset + sizeof(block);
+     }
+     
+     struct iovec iov[3] = {
+         { &block, sizeof(block) },
+         { writer->names.data, writer->names.size },
+         { writer->frames.data, writer->frames.size }
+     };
+     if (!write_all(writer->fd, iov, 3)) {
+         writer->failed = 1;
+         return 0;
+     }
+     
+     writer->offset += block.size;
+     writer->names.size = 0;
+     writer->frames.size = 0;
+     writer->frame_count = 0;
+     writer->first_name = writer->name_count;
+     return 1;
+ }
+ 
+ /* Flush the last block, append the index footer and close; returns 0 if anything failed */
+ int recording_finish(RecordingWriter *writer) {
+     int ok = !writer->failed && flush_block(writer);
+     
+     if (ok) {
+         RecordingTrailer trailer;
+         memset(&trailer, 0, sizeof(trailer));
+         memcpy(trailer.magic, RECORDING_TRAILER_MAGIC, 4);
+         trailer.block_count = writer->block_count;
+         trailer.name_count = writer->name_count;
+         trailer.index_offset = writer->offset;
+         
+         struct iovec iov[3] = {
+             { writer->index, writer->block_count * sizeof(RecordingIndexEntry) },
+             { writer->name_offsets, writer->name_count * sizeof(uint64_t) },
+             { &trailer, sizeof(trailer) }
+         };
+         ok = write_all(writer->fd, iov, 3);
+     }
+     
+     close(writer->fd);
+     free(writer->names.data);
+     free(writer->frames.data);
+     free(writer->rows);
+     free(writer->prev_rows);
+     free(writer->arena);
+     free(writer->name_offsets);
+     free(writer->name_arena);
+     free(writer->slots);
+     free(writer->index);
+     free(writer);
+     return ok;
+ }
+ 
+ /* Walk the block headers of a recording without a footer */
+ static int build_index(Recording *recording) {
+     uint32_t capacity = 0;
+     uint32_t name_capacity = 0;
+     size_t offset = sizeof(RecordingHeader);
+     
+     while (offset + sizeof(RecordingBlock) <= recording->size) {
+         RecordingBlock block;
+         memcpy(&block, recording->data + offset, sizeof(block));
+         if (memcmp(block.magic, RECORDING_BLOCK_MAGIC, 4) != 0 || block.size < sizeof(block) ||
+             block.size > recording->size - offset) {
+             break;  // End of the complete blocks
+         }
+         
+         if (recording->block_count == capacity) {
+             capacity = capacity > 0 ? capacity * 2 : 256;
+             RecordingIndexEntry *index = realloc(recording->index, capacity * sizeof(RecordingIndexEntry));
+             if (index == NULL) {
+                 return 0;
+             }
+             recording->index = index;
+         }
+         RecordingIndexEntry *entry = &recording->index[recording->block_count++];
+         entry->first_timestamp_ns = block.first_timestamp_ns;
+         entry->last_timestamp_ns = block.last_timestamp_ns;
+         entry->offset = offset;
+         
+         const unsigned char *pos = recording->data + offset + sizeof(block);
+         const unsigned char *end = recording->data + offset + block.size;
+         for (uint32_t i = 0; i < block.name_count; i++) {
+             uint64_t len;
+             if (!get_varint(&pos, end, &len) || len + 1 > (uint64_t)(end - pos)) {
+                 return 0;
+             }
+             if (recording->name_count == name_capacity) {
+                 name_capacity = name_capacity > 0 ? name_capacity * 2 : 1024;
+                 uint64_t *offsets = realloc(recording->name_offsets, name_capacity * sizeof(uint64_t));
+                 if (offsets == NULL) {
+                     return 0;
+                 }
+                 recording->name_offsets = offsets;
+             }
+             recording->name_offsets[recording->name_count++] = (uint64_t)(pos - recording->data);
+             pos += len + 1;
+         }
+         
+         offset += block.size;
+     }
+     return 1;
+ }
+ 
+ /* Check that a footer's blocks and names lie before it, as build_index() would find them */
+ static int check_footer(const Recording *recording, uint64_t index_offset) {
+     for (uint32_t i = 0; i < recording->block_count; i++) {
+         uint64_t offset = recording->index[i].offset;
+         if (offset < sizeof(RecordingHeader) || offset > index_offset ||
+             index_offset - offset < sizeof(RecordingBlock)) {
+             return 0;
+         }
+         RecordingBlock block;
+         memcpy(&block, recording->data + offset, sizeof(block));
+         if (memcmp(block.magic, RECORDING_BLOCK_MAGIC, 4) != 0 || block.size < sizeof(block) ||
+             block.size > index_offset - offset) {
+             return 0;
+         }
+     }
+     for (uint32_t i = 0; i < recording->name_count; i++) {
+         uint64_t offset = recording->name_offsets[i];
+         if (offset < sizeof(RecordingHeader) || offset >= index_offset ||
+             memchr(recording->data + offset, '\0', index_offset - offset) == NULL) {
+             return 0;  // Not a NUL-terminated name inside the blocks
+         }
+     }
+     return 1;
+ }
+ 
+ /* Map a recording and load or rebuild its index; NULL on failure */
+ Recording *recording_open(const char *path) {
+     int fd = open(path, O_RDONLY);
+     if (fd < 0) {
+         fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+         return NULL;
+     }
+     struct stat st;
+     if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RecordingHeader)) {
+         fprintf(stderr, "%s is not a recording\n", path);
+         close(fd);
+         return NULL;
+     }
+     
+     Recording *recording = calloc(1, sizeof(Recording));
+     if (recording == NULL) {
+         close(fd);
+         return NULL;
+     }
+     recording->size = (size_t)st.st_size;
+ #ifdef _WIN32
+     unsigned char *data = malloc(recording->size);
+     if (data != NULL && _read(fd, data, (unsigned int)recording->size) != (int)recording->size) {
+         free(data);
+         data = NULL;
+     }
+ #else
+     void *data = mmap(NULL, recording->size, PROT_READ, MAP_PRIVATE, fd, 0);
+     if (data == MAP_FAILED) {
+         data = NULL;
+     }
+ #endif
+     close(fd);
+     if (data == NULL) {
+         fprintf(stderr, "Cannot map %s\n", path);
+         free(recording);
+         return NULL;
+     }
+     recording->data = data;
+     
+     RecordingHeader header;
+     memcpy(&header, recording->data, sizeof(header));
+     if (memcmp(header.magic, RECORDING_MAGIC, 4) != 0 || header.version < 1 || header.version > RECORDING_VERSION) {
+         fprintf(stderr, "%s is not a recording\n", path);
+         recording_close(recording);
+         return NULL;
+     }
+     recording->memory_scale = header.version == 1 ? RECORDING_V1_MEMORY_SCALE : RECORDING_MEMORY_SCALE;
+     
+     /* Use the footer of a finished recording, otherwise walk the blocks */
+     RecordingTrailer trailer;
+     int have_footer = 0;
+     if (recording->size >= sizeof(header) + sizeof(trailer)) {
+         memcpy(&trailer, recording->data + recording->size - sizeof(trailer), sizeof(trailer));
+         uint64_t footer_size = (uint64_t)trailer.block_count * sizeof(RecordingIndexEntry) +
+                                (uint64_t)trailer.name_count * sizeof(uint64_t) + sizeof(trailer);
+         have_footer = memcmp(trailer.magic, RECORDING_TRAILER_MAGIC, 4) == 0 &&
+                       footer_size <= recording->size - sizeof(header) &&
+                       trailer.index_offset == recording->size - footer_size;
+     }
+     if (have_footer) {
+         recording->block_count = trailer.block_count;
+         recording->name_count = trailer.name_count;
+         recording->index = malloc((trailer.block_count + 1) * sizeof(RecordingIndexEntry));
+         recording->name_offsets = malloc((trailer.name_count + 1) * sizeof(uint64_t));
+         if (recording->index == NULL || recording->name_offsets == NULL) {
+             recording_close(recording);
+             return NULL;
+         }
+         memcpy(recording->index, recording->data + trailer.index_offset,
+                trailer.block_count * sizeof(RecordingIndexEntry));
+         memcpy(recording->name_offsets,
+                recording->data + trailer.index_offset + trailer.block_count * sizeof(RecordingIndexEntry),
+                trailer.name_count * sizeof(uint64_t));
+         
+         /* A footer that points outside the blocks is damaged; the blocks may still be fine */
+         if (!check_footer(recording, trailer.index_offset)) {
+             free(recording->index);
+             free(recording->name_offsets);
+             recording->index = NULL;
+             recording->name_offsets = NULL;
+             recording->block_count = 0;
+             recording->name_count = 0;
+             have_footer = 0;
+         }
+     }
+     if (!have_footer && !build_index(recording)) {
+         fprintf(stderr, "%s is damaged\n", path);
+         recording_close(recording);
+         return NULL;
+     }
+     
+     if (!enter_block(recording, 0)) {
+         recording->block = recording->block_count;
+     }
+     return recording;
+ }
+ 
+ /* Position the cursor at the start of a block; returns 0 past the last block */
+ static int enter_block(Recording *recording, uint32_t block) {
+     recording->block = block;
+     recording->frame = 0;
+     recording->prev_count = 0;
+     if (block >= recording->block_count) {
+         return 0;
+     }
+     
+     RecordingBlock header;
+     const RecordingIndexEntry *entry = &recording->index[block];
+     memcpy(&header, recording->data + entry->offset, sizeof(header));
+     recording->frame_count = header.frame_count;
+     recording->timestamp_ns = header.first_timestamp_ns;
+     recording->pos = recording->data + entry->offset + sizeof(header);
+     recording->end = recording->data + entry->offset + header.size;
+     
+     /* Skip the names; they are found through name_offsets */
+     for (uint32_t i = 0; i < header.name_count; i++) {
+         uint64_t len;
+         if (!get_varint(&recording->pos, recording->end, &len) ||
+             len + 1 > (uint64_t)(recording->end - recording->pos)) {
+             recording->frame_count = 0;
+             return 1;
+         }
+         recording->pos += len + 1;
+     }
+     return 1;
+ }
+ 
+ /* Timestamp of the frame recording_next() would return; 0 at the end */
+ int recording_peek_timestamp(const Recording *recording, unsigned long long *timestamp_ns) {
+     if (recording->block >= recording->block_count) {
+         return 0;
+     }
+     if (recording->frame < recording->frame_count) {
+         const unsigned char *pos = recording->pos;
+         uint64_t delta_us;
+         if (!get_varint(&pos, recording->end, &delta_us)) {
+             return 0;
+         }
+         *timestamp_ns = recording->timestamp_ns + delta_us * 1000;
+         return 1;
+     }
+     if (recording->block + 1 < recording->block_count) {
+         *timestamp_ns = recording->index[recording->block + 1].first_timestamp_ns;
+         return 1;
+     }
+     return 0;
+ }
+ 
+ /*
+  * Decode the next frame, appending its rows to list and exited. Names are
+  * copied out of the mapping into the rows. Returns 0 at the end of the
+  * recording or at the first damaged frame.
+  */
+ int recording_next(Recording *recording, ProcessList *list, ProcessList *exited,
+                    unsigned long long *timestamp_ns) {
+     while (recording->frame >= recording->frame_count) {
+         if (!enter_block(recording, recording->block + 1)) {
+             return 0;
+         }
+     }
+     
+     const unsigned char **pos = &recording->pos;
+     const unsigned char *end = recording->end;
+     uint64_t delta_us, live, gone;
+     if (!get_varint(pos, end, &delta_us) || !get_varint(pos, end, &live) || !get_varint(pos, end, &gone) ||
+         live + gone > (uint64_t)(end - *pos)) {
+         recording->block = recording->block_count;
+         return 0;
+     }
+     int n = (int)(live + gone);
+     if (!rows_reserve(&recording->rows, &recording->prev_rows, &recording->row_capacity, n)) {
+         return 0;
+     }
+     
+     /* PID column */
+     int64_t pid = 0;
+     for (int i = 0; i < n; i++) {
+         int64_t delta;
+         if (!get_svarint(pos, end, &delta)) {
+             recording->block = recording->block_count;
+             return 0;
+         }
+         pid += delta;
+         recording->rows[i].pid = (int)pid;
+     }
+     
+     /* CPU, memory and name columns */
+     for (int column = 0; column < 3; column++) {
+         int prev = 0;
+         for (int i = 0; i < n; i++) {
+             FrameRow *row = &recording->rows[i];
+             const FrameRow *before = NULL;
+             if (i < (int)live) {
+                 while (prev < recording->prev_count && recording->prev_rows[prev].pid < row->pid) {
+                     prev++;
+                 }
+                 if (prev < recording->prev_count && recording->prev_rows[prev].pid == row->pid) {
+                     before = &recording->prev_rows[prev];
+                 }
+             }
+             int64_t delta;
+             if (!get_svarint(pos, end, &delta)) {
+                 recording->block = recording->block_count;
+                 return 0;
+             }
+             if (column == 0) {
+                 row->cpu = (before != NULL ? before->cpu : 0) + delta;
+             } else if (column == 1) {
+                 row->mem = (before != NULL ? before->mem : 0) + delta;
+             } else {
+                 row->name_id = (uint32_t)((before != NULL ? (int64_t)before->name_id : 0) + delta);
+             }
+         }
+     }
+     
+     for (int i = 0; i < n; i++) {
+         const FrameRow *row = &recording->rows[i];
+         const char *name = row->name_id < recording->name_count ?
+                            (const char*)recording->data + recording->name_offsets[row->name_id] : "?";
+         add_process(i < (int)live ? list : exited, row->pid, name,
+                     row->cpu / RECORDING_CPU_SCALE, row->mem / recording->memory_scale);
+     }
+     
+     FrameRow *swap = recording->prev_rows;
+     recording->prev_rows = recording->rows;
+     recording->rows = swap;
+     recording->prev_count = (int)live;
+     recording->frame++;
+     recording->timestamp_ns += delta_us * 1000;
+     *timestamp_ns = recording->timestamp_ns;
+     return 1;
+ }
+ 
+ /*
+  * Position the cursor so recording_next() returns the first frame at or after
+  * timestamp_ns. The index finds the block with a binary search; frames before
+  * the target within that block are decoded and dropped. Returns 0 if no frame
+  * is that late.
+  */
+ int recording_seek(Recording *recording, unsigned long long timestamp_ns) {
+     uint32_t low = 0;
+     uint32_t high = recording->block_count;
+     while (low < high) {
+         uint32_t mid = low + (high - low) / 2;
+         if (recording->index[mid].last_timestamp_ns < timestamp_ns) {
+             low = mid + 1;
+         } else {
+             high = mid;
+         }
+     }
+     if (!enter_block(recording, low)) {
+         return 0;
+     }
+     
+     ProcessList scratch;
+     memset(&scratch, 0, sizeof(scratch));
+     unsigned long long next;
+     while (recording_peek_timestamp(recording, &next) && next < timestamp_ns) {
+         unsigned long long frame_timestamp;
+         process_list_clear(&scratch);
+         if (!recording_next(recording, &scratch, &scratch, &frame_timestamp)) {
+             break;
+         }
+     }
+     process_list_free(&scratch);
+     return recording->block < recording->block_count;
+ }
+ 
+ /* Unmap a recording */
+ void recording_close(Recording *recording) {
+ #ifdef _WIN32
+     free((void*)recording->data);
+ #else
+     munmap((void*)recording->data, recording->size);
+ #endif
+     free(recording->index);
+     free(recording->name_offsets);
+     free(recording->rows);
+     free(recording->prev_rows);
+     free(recording);
+ }
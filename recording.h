@@ -0,0 +1,29 @@
+/**
+ * CPU and Memory Usage Tracker - session recording
+ * 
+ * Append-only, columnar recording of published snapshots, and replay of
+ * recordings through a read-only memory mapping.
+ */
+
+ #ifndef RECORDING_H
+ #define RECORDING_H
+ 
+ #include "sampler.h"
+ 
+ typedef struct RecordingWriter RecordingWriter;
+ typedef struct Recording Recording;
+ 
+ /* Recording, from the sampler thread */
+ RecordingWriter *recording_create(const char *path);
+ int recording_append(RecordingWriter *writer, const Snapshot *snapshot);
+ int recording_finish(RecordingWriter *writer);
+ 
+ /* Replay */
+ Recording *recording_open(const char *path);
+ int recording_seek(Recording *recording, unsigned long long timestamp_ns);
+ int recording_next(Recording *recording, ProcessList *list, ProcessList *exited,
+                    unsigned long long *timestamp_ns);
+ int recording_peek_timestamp(const Recording *recording, unsigned long long *timestamp_ns);
+ void recording_close(Recording *recording);
+ 
+ #endif /* RECORDING_H */
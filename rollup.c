@@ -0,0 +1,549 @@
+/**
+ * CPU and Memory Usage Tracker - process tree and cgroup rollups
+ * 
+ * The sampler links every row to its parent and cgroup once per tick and
+ * sums CPU and memory up both hierarchies in one pass each. Cgroup paths
+ * are interned on the sampler thread, so processes share one entry per
+ * cgroup, and the totals are published next to the kernel's own
+ * cpu.stat and memory.current figures for the same cgroups.
+ */
+
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ #include <fcntl.h>
+ #include <unistd.h>
+ #endif
+ 
+ #include "profile.h"
+ #include "rollup.h"
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ /* Interned cgroup, shared by every process in it */
+ typedef struct {
+     char *path;                      // Relative to the cgroup2 mount, "/" for the root; NULL for a free entry
+     int parent;                      // Entry of the parent cgroup, -1 for the root
+     int used;                        // Has processes in this tick, or descendants that do
+     int index;                       // Index in the snapshot being filled
+     unsigned long long usage_usec;   // cpu.stat usage_usec at the last read
+     unsigned long long read_ns;      // Monotonic time of that read, 0 before the first
+ } CgroupEntry;
+ #endif
+ 
+ /* Global variables */
+ int cgroup_every = 30;
+ static int *tree_pending = NULL;      // Children of each row not yet added into it
+ static int *tree_queue = NULL;        // Rows whose subtrees are complete, leaves first
+ static int tree_capacity = 0;
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ static const char *cgroup_root = NULL;  // --cgroup-root, or the cgroup2 mount from mountinfo
+ static int cgroup_root_fd = -1;         // Counters are read relative to it; -1 when not read
+ static CgroupEntry *cgroup_entries = NULL;
+ static int cgroup_count = 0;            // Entries in use or free, the free ones listed in free_ids
+ static int cgroup_capacity = 0;
+ static int *free_ids = NULL;
+ static int free_count = 0;
+ static int *cgroup_index = NULL;        // Open-addressed by path hash, entry + 1, 0 for an empty slot
+ static unsigned int index_capacity = 0; // Power of two
+ static int *kept_ids = NULL;            // Scratch for filling a snapshot
+ #endif
+ 
+ /* Function prototypes */
+ static int find_row_index(const ProcessList *list, int pid);
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ static unsigned int path_hash(const char *path);
+ static void index_rebuild(unsigned int capacity);
+ static int index_find(const char *path);
+ static void read_cgroup_counters(CgroupEntry *entry, CgroupInfo *info, unsigned long long total_mem);
+ static int compare_cgroup_paths(const void *a, const void *b);
+ #endif
+ 
+ /* Apply one rollup command-line option; returns 0 if the option is not a rollup one */
+ int rollup_parse_option(const char *arg) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     // --cgroup-every=T: re-read the cgroup of each process every T ticks, 0 disables cgroups
+     if (strncmp(arg, "--cgroup-every=", 15) == 0) {
+         cgroup_every = atoi(arg + 15) > 0 ? atoi(arg + 15) : 0;
+         return 1;
+     }
+     // --cgroup-root=DIR: where the cgroup2 hierarchy is mounted, for the kernel's counters
+     if (strncmp(arg, "--cgroup-root=", 14) == 0) {
+         cgroup_root = arg + 14;
+         return 1;
+     }
+ #else
+     (void)arg;  // Unused parameter
+ #endif
+     return 0;
+ }
+ 
+ /* Row of a PID in a PID-ordered list, or -1 */
+ static int find_row_index(const ProcessList *list, int pid) {
+     int low = 0;
+     int high = list->count - 1;
+     while (low <= high) {
+         int mid = low + (high - low) / 2;
+         if (list->pid[mid] == pid) {
+             return mid;
+         }
+         if (list->pid[mid] < pid) {
+             low = mid + 1;
+         } else {
+             high = mid - 1;
+         }
+     }
+     return -1;
+ }
+ 
+ /*
+  * Link every row of a PID-ordered list to its parent's row and sum CPU and
+  * memory over each subtree. Rows are added into their parent once all of
+  * their own children have been, leaves first, so the sums take one pass
+  * whatever order the PIDs are in. Rows whose parent is not listed are roots.
+  */
+ void rollup_process_tree(ProcessList *list) {
+     if (list->count > tree_capacity) {
+         tree_capacity = list->count * 2;
+         tree_pending = (int*)realloc(tree_pending, tree_capacity * sizeof(int));
+         tree_queue = (int*)realloc(tree_queue, tree_capacity * sizeof(int));
+     }
+     
+     for (int i = 0; i < list->count; i++) {
+         int ppid = list->ppid[i];
+         list->parent[i] = ppid > 0 && ppid != list->pid[i] ? find_row_index(list, ppid) : -1;
+         list->subtree_processes[i] = 1;
+         list->subtree_cpu[i] = (float)list->cpu_usage[i];
+         list->subtree_memory[i] = (float)list->memory_usage[i];
+         tree_pending[i] = 0;
+     }
+     for (int i = 0; i < list->count; i++) {
+         if (list->parent[i] >= 0) {
+             tree_pending[list->parent[i]]++;
+         }
+     }
+     
+     int tail = 0;
+     for (int i = 0; i < list->count; i++) {
+         if (tree_pending[i] == 0) {
+             tree_queue[tail++] = i;
+         }
+     }
+     for (int head = 0; head < tail; head++) {
+         int row = tree_queue[head];
+         int parent = list->parent[row];
+         if (parent < 0) {
+             continue;
+         }
+         list->subtree_processes[parent] += list->subtree_processes[row];
+         list->subtree_cpu[parent] += list->subtree_cpu[row];
+         list->subtree_memory[parent] += list->subtree_memory[row];
+         if (--tree_pending[parent] == 0) {
+             tree_queue[tail++] = parent;
+         }
+     }
+ }
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ /* Find the cgroup2 mount for the kernel's counters; without --cgroup-root only for the real /proc */
+ void rollup_cgroup_init(int real_proc) {
+     static char mount_point[4096];
+     
+     if (cgroup_every <= 0 || cgroup_root_fd >= 0 || (cgroup_root == NULL && !real_proc)) {
+         return;
+     }
+     
+     // "36 25 0:31 / /sys/fs/cgroup rw,nosuid - cgroup2 cgroup2 rw"
+     if (cgroup_root == NULL) {
+         FILE *mounts = fopen("/proc/self/mountinfo", "r");
+         char line[8192];
+         while (mounts != NULL && fgets(line, sizeof(line), mounts) != NULL) {
+             if (strstr(line, " - cgroup2 ") != NULL &&
+                 sscanf(line, "%*s %*s %*s %*s %4095s", mount_point) == 1) {
+                 cgroup_root = mount_point;
+                 break;
+             }
+         }
+         if (mounts != NULL) {
+             fclose(mounts);
+         }
+     }
+     if (cgroup_root != NULL) {
+         cgroup_root_fd = open(cgroup_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+     }
+ }
+ 
+ /* FNV-1a hash of a cgroup path */
+ static unsigned int path_hash(const char *path) {
+     unsigned int h = 2166136261u;
+     for (; *path != '\0'; path++) {
+         h = (h ^ (unsigned char)*path) * 16777619u;
+     }
+     return h;
+ }
+ 
+ /* Rebuild the path index over the entries in use, keeping its load factor under 1/2 */
+ static void index_rebuild(unsigned int capacity) {
+     free(cgroup_index);
+     index_capacity = capacity;
+     cgroup_index = (int*)calloc(index_capacity, sizeof(int));
+     
+     for (int id = 0; id < cgroup_count; id++) {
+         if (cgroup_entries[id].path == NULL) {
+             continue;
+         }
+         unsigned int i = path_hash(cgroup_entries[id].path) & (index_capacity - 1);
+         while (cgroup_index[i] != 0) {
+             i = (i + 1) & (index_capacity - 1);
+         }
+         cgroup_index[i] = id + 1;
+     }
+ }
+ 
+ /* Entry of an interned path, or -1 */
+ static int index_find(const char *path) {
+     if (index_capacity == 0) {
+         return -1;
+     }
+     for (unsigned int i = path_hash(path) & (index_capacity - 1);
+          cgroup_index[i] != 0;
+          i = (i + 1) & (index_capacity - 1)) {
+         if (strcmp(cgroup_entries[cgroup_index[i] - 1].path, path) == 0) {
+             return cgroup_index[i] - 1;
+         }
+     }
+     return -1;
+ }
+ 
+ /* Entry of a cgroup path from /proc/<pid>/cgroup, interning it and its ancestors as needed */
+ int rollup_cgroup_intern(const char *path) {
+     int id = index_find(path);
+     if (id >= 0) {
+         return id;
+     }
+     
+     // "/a/b" hangs off "/a", and "/a" off "/"
+     int parent = -1;
+     const char *slash = strrchr(path, '/');
+     if (slash != NULL && path[1] != '\0') {
+         char parent_path[4096];
+         size_t len = slash > path ? (size_t)(slash - path) : 1;
+         if (len >= sizeof(parent_path)) {
+             return -1;
+         }
+         memcpy(parent_path, path, len);
+         parent_path[len] = '\0';
+         parent = rollup_cgroup_intern(parent_path);
+     }
+     
+     if (free_count > 0) {
+         id = free_ids[--free_count];
+     } else {
+         if (cgroup_count == cgroup_capacity) {
+             cgroup_capacity = cgroup_capacity > 0 ? cgroup_capacity * 2 : 64;
+             cgroup_entries = (CgroupEntry*)realloc(cgroup_entries, cgroup_capacity * sizeof(CgroupEntry));
+             free_ids = (int*)realloc(free_ids, cgroup_capacity * sizeof(int));
+             kept_ids = (int*)realloc(kept_ids, cgroup_capacity * sizeof(int));
+         }
+         id = cgroup_count++;
+     }
+     CgroupEntry *entry = &cgroup_entries[id];
+     entry->path = strdup(path);
+     entry->parent = parent;
+     entry->used = 0;
+     entry->index = -1;
+     entry->usage_usec = 0;
+     entry->read_ns = 0;
+     
+     if ((unsigned int)(cgroup_count - free_count) * 2 > index_capacity) {
+         index_rebuild(index_capacity > 0 ? index_capacity * 2 : 128);
+     } else {
+         unsigned int i = path_hash(path) & (index_capacity - 1);
+         while (cgroup_index[i] != 0) {
+             i = (i + 1) & (index_capacity - 1);
+         }
+         cgroup_index[i] = id + 1;
+     }
+     return id;
+ }
+ 
+ /* Read a cgroup's cpu.stat and memory.current into its snapshot row; -1 where unavailable */
+ static void read_cgroup_counters(CgroupEntry *entry, CgroupInfo *info, unsigned long long total_mem) {
+     char path[4096];
+     char buf[512];
+     
+     info->kernel_cpu_usage = -1;
+     info->kernel_memory_usage = -1;
+     if (cgroup_root_fd < 0) {
+         return;
+     }
+     
+     // The root has a cpu.stat of its own but no memory.current
+     const char *relative = entry->path[1] != '\0' ? entry->path + 1 : ".";
+     snprintf(path, sizeof(path), "%s/cpu.stat", relative);
+     int fd = openat(cgroup_root_fd, path, O_RDONLY | O_CLOEXEC);
+     if (fd >= 0) {
+         ssize_t len = read(fd, buf, sizeof(buf) - 1);
+         unsigned long long now = profile_now();
+         unsigned long long usage;
+         close(fd);
+         buf[len > 0 ? len : 0] = '\0';
+         if (sscanf(buf, "usage_usec %llu", &usage) == 1) {
+             if (entry->read_ns != 0 && now > entry->read_ns && usage >= entry->usage_usec) {
+                 info->kernel_cpu_usage = (double)(usage - entry->usage_usec) * 1000.0 * 100.0 /
+                                          (double)(now - entry->read_ns);
+             }
+             entry->usage_usec = usage;
+             entry->read_ns = now;
+         }
+     }
+     
+     snprintf(path, sizeof(path), "%s/memory.current", relative);
+     fd = openat(cgroup_root_fd, path, O_RDONLY | O_CLOEXEC);
+     if (fd >= 0) {
+         ssize_t len = read(fd, buf, sizeof(buf) - 1);
+         unsigned long long bytes;
+         close(fd);
+         buf[len > 0 ? len : 0] = '\0';
+         if (total_mem > 0 && sscanf(buf, "%llu", &bytes) == 1) {
+             info->kernel_memory_usage = (double)bytes / (double)total_mem * 100.0;
+         }
+     }
+ }
+ 
+ /* Order interned cgroups by path, which puts every parent before its children */
+ static int compare_cgroup_paths(const void *a, const void *b) {
+     return strcmp(cgroup_entries[*(const int*)a].path, cgroup_entries[*(const int*)b].path);
+ }
+ 
+ /*
+  * Fill the snapshot's cgroups with the ones the rows are in and their
+  * ancestors, and turn each row's entry into its index there. Entries no
+  * row uses any more are freed: every process state with an entry has a
+  * row in this tick, so nothing refers to them.
+  */
+ void rollup_cgroups(ProcessList *list, CgroupList *cgroups, unsigned long long total_mem) {
+     cgroups->count = 0;
+     cgroups->paths_used = 0;
+     if (cgroup_every <= 0) {
+         return;
+     }
+     
+     for (int id = 0; id < cgroup_count; id++) {
+         cgroup_entries[id].used = 0;
+     }
+     for (int i = 0; i < list->count; i++) {
+         for (int id = list->cgroup[i]; id >= 0 && !cgroup_entries[id].used;
+              id = cgroup_entries[id].parent) {
+             cgroup_entries[id].used = 1;
+         }
+     }
+     
+     int kept = 0;
+     int freed = 0;
+     for (int id = 0; id < cgroup_count; id++) {
+         CgroupEntry *entry = &cgroup_entries[id];
+         if (entry->path == NULL) {
+             continue;
+         }
+         if (entry->used) {
+             kept_ids[kept++] = id;
+         } else {
+             free(entry->path);
+             entry->path = NULL;
+             free_ids[free_count++] = id;
+             freed = 1;
+         }
+     }
+     if (freed) {
+         index_rebuild(index_capacity);
+     }
+     qsort(kept_ids, kept, sizeof(int), compare_cgroup_paths);
+     
+     if (kept > cgroups->capacity) {
+         cgroups->capacity = kept * 2;
+         cgroups->cgroups = (CgroupInfo*)realloc(cgroups->cgroups, cgroups->capacity * sizeof(CgroupInfo));
+     }
+     for (int i = 0; i < kept; i++) {
+         CgroupEntry *entry = &cgroup_entries[kept_ids[i]];
+         CgroupInfo *info = &cgroups->cgroups[i];
+         size_t len = strlen(entry->path) + 1;
+         if (cgroups->paths_used + len > cgroups->paths_capacity) {
+             cgroups->paths_capacity = (cgroups->paths_used + len) * 2;
+             cgroups->paths = (char*)realloc(cgroups->paths, cgroups->paths_capacity);
+         }
+         memcpy(cgroups->paths + cgroups->paths_used, entry->path, len);
+         
+         entry->index = i;
+         info->path = (int)cgroups->paths_used;
+         info->parent = entry->parent >= 0 ? cgroup_entries[entry->parent].index : -1;
+         info->processes = 0;
+         info->cpu_usage = 0;
+         info->memory_usage = 0;
+         read_cgroup_counters(entry, info, total_mem);
+         cgroups->paths_used += len;
+     }
+     cgroups->count = kept;
+     
+     // Rows first, then every cgroup into its parent, children before parents
+     for (int i = 0; i < list->count; i++) {
+         if (list->cgroup[i] < 0) {
+             continue;
+         }
+         list->cgroup[i] = cgroup_entries[list->cgroup[i]].index;
+         CgroupInfo *info = &cgroups->cgroups[list->cgroup[i]];
+         info->processes++;
+         info->cpu_usage += list->cpu_usage[i];
+         info->memory_usage += list->memory_usage[i];
+     }
+     for (int i = kept - 1; i > 0; i--) {
+         const CgroupInfo *info = &cgroups->cgroups[i];
+         if (info->parent >= 0) {
+             CgroupInfo *parent = &cgroups->cgroups[info->parent];
+             parent->processes += info->processes;
+             parent->cpu_usage += info->cpu_usage;
+             parent->memory_usage += info->memory_usage;
+         }
+     }
+ }
+ #else
+ void rollup_cgroup_init(int real_proc) {
+     (void)real_proc;  // Unused parameter
+ }
+ 
+ int rollup_cgroup_intern(const char *path) {
+     (void)path;  // Unused parameter
+     return -1;
+ }
+ 
+ void rollup_cgroups(ProcessList *list, CgroupList *cgroups, unsigned long long total_mem) {
+     (void)list;       // Unused parameter
+     (void)total_mem;  // Unused parameter
+     cgroups->count = 0;
+     cgroups->paths_used = 0;
+ }
+ #endif
+ 
+ /* Free the rollup state once the sampler has stopped */
+ void rollup_free(void) {
+     free(tree_pending);
+     free(tree_queue);
+     tree_pending = NULL;
+     tree_queue = NULL;
+     tree_capacity = 0;
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     for (int id = 0; id < cgroup_count; id++) {
+         free(cgroup_entries[id].path);
+     }
+     free(cgroup_entries);
+     free(free_ids);
+     free(kept_ids);
+     free(cgroup_index);
+     cgroup_entries = NULL;
+     free_ids = NULL;
+     kept_ids = NULL;
+     cgroup_index = NULL;
+     cgroup_count = 0;
+     cgroup_capacity = 0;
+     free_count = 0;
+     index_capacity = 0;
+     if (cgroup_root_fd >= 0) {
+         close(cgroup_root_fd);
+         cgroup_root_fd = -1;
+     }
+ #endif
+ }
+ 
+ /*
+  * Terminate a process and everything below it in the latest snapshot,
+  * children before their parents so a parent cannot respawn them in the
+  * meantime: like rollup_process_tree(), leaves go first and a process
+  * follows once all of its children have been signalled. Nothing is
+  * signalled if the PID now belongs to a process other than the one that
+  * started at start_time.
+  */
+ int kill_process_tree(int pid, unsigned long long start_time) {
+     Snapshot *snapshot = snapshot_acquire();
+     int root = snapshot != NULL ? find_row_index(&snapshot->list, pid) : -1;
+     int count = 0;
+     
+     if (root >= 0 && start_time != 0 && snapshot->list.start_time[root] != start_time) {
+         snapshot_release(snapshot);
+         return 0;
+     }
+     if (root >= 0) {
+         const ProcessList *list = &snapshot->list;
+         int *pending = (int*)malloc(list->count * sizeof(int));  // Children not yet signalled, -1 outside the subtree
+         int *queue = (int*)malloc(list->count * sizeof(int));
+         if (pending == NULL || queue == NULL) {
+             free(pending);
+             free(queue);
+             snapshot_release(snapshot);
+             return 0;
+         }
+         
+         for (int i = 0; i < list->count; i++) {
+             pending[i] = -1;
+             int steps = 0;
+             for (int p = list->parent[i]; p >= 0 && steps < list->count; p = list->parent[p]) {
+                 if (p == root) {
+                     pending[i] = 0;
+                     break;
+                 }
+                 steps++;  // Guards against a parent cycle in a hand-made fixture
+             }
+         }
+         for (int i = 0; i < list->count; i++) {
+             if (pending[i] >= 0 && list->parent[i] != root) {
+                 pending[list->parent[i]]++;
+             }
+         }
+         
+         int tail = 0;
+         for (int i = 0; i < list->count; i++) {
+             if (pending[i] == 0) {
+                 queue[tail++] = i;
+             }
+         }
+         for (int head = 0; head < tail; head++) {
+             int row = queue[head];
+             count += kill_process(list->pid[row], list->start_time[row]);
+             if (list->parent[row] != root && --pending[list->parent[row]] == 0) {
+                 queue[tail++] = list->parent[row];
+             }
+         }
+         free(pending);
+         free(queue);
+     }
+     if (snapshot != NULL) {
+         snapshot_release(snapshot);
+     }
+     
+     return count + kill_process(pid, start_time);
+ }
+ 
+ /* Terminate every process of the latest snapshot in a cgroup or below it */
+ int kill_cgroup(const char *path) {
+     Snapshot *snapshot = snapshot_acquire();
+     if (snapshot == NULL) {
+         return 0;
+     }
+     
+     // "/" contains everything; "/a" contains "/a/b" but not "/ab"
+     size_t len = strcmp(path, "/") == 0 ? 0 : strlen(path);
+     int count = 0;
+     for (int i = 0; i < snapshot->list.count; i++) {
+         const ProcessList *list = &snapshot->list;
+         if (list->cgroup[i] < 0) {
+             continue;
+         }
+         const char *cgroup = snapshot->cgroups.paths + snapshot->cgroups.cgroups[list->cgroup[i]].path;
+         if (strncmp(cgroup, path, len) == 0 && (cgroup[len] == '\0' || cgroup[len] == '/')) {
+             count += kill_process(list->pid[i], list->start_time[i]);
+         }
+     }
+     
+     snapshot_release(snapshot);
+     return count;
+ }
@@ -0,0 +1,31 @@
+/**
+ * CPU and Memory Usage Tracker - process tree and cgroup rollups
+ * 
+ * Subtree CPU and memory totals over the parent links of the processes
+ * and over the cgroup v2 hierarchy they belong to.
+ */
+
+ #ifndef ROLLUP_H
+ #define ROLLUP_H
+ 
+ #include "sampler.h"
+ 
+ #define CGROUP_UNREAD -2  // A process whose /proc/<pid>/cgroup has not been read yet
+ 
+ /* Rollup settings */
+ extern int cgroup_every;   // Ticks between re-reads of a process's cgroup, 0 disables cgroups
+ 
+ int rollup_parse_option(const char *arg);
+ 
+ /* Building, from the sampler thread */
+ void rollup_process_tree(ProcessList *list);
+ void rollup_cgroup_init(int real_proc);
+ int rollup_cgroup_intern(const char *path);
+ void rollup_cgroups(ProcessList *list, CgroupList *cgroups, unsigned long long total_mem);
+ void rollup_free(void);
+ 
+ /* Subtree actions, from any thread; both return the number of processes signalled */
+ int kill_process_tree(int pid, unsigned long long start_time);
+ int kill_cgroup(const char *path);
+ 
+ #endif /* ROLLUP_H */
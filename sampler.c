@@ -0,0 +1,3285 @@
+/**
+ * CPU and Memory Usage Tracker - sampling core
+ * 
+ * Platform process sampling and snapshot publishing, shared by the
+ * GTK front end and the headless collector. Has no GTK dependency.
+ */
+
+ #include <errno.h>
+ #include <pthread.h>
+ #include <stdatomic.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ #include <unistd.h>
+ 
+ #ifdef _WIN32
+ #include <windows.h>
+ #include <psapi.h>
+ #include <tlhelp32.h>
+ #elif defined(__APPLE__)
+ #include <sys/sysctl.h>
+ #include <sys/types.h>
+ #include <mach/mach.h>
+ #include <mach/task.h>
+ #include <mach/mach_init.h>
+ #include <signal.h>
+ #else /* Linux */
+ #include <dirent.h>
+ #include <fcntl.h>
+ #include <linux/cn_proc.h>
+ #include <linux/connector.h>
+ #include <linux/netlink.h>
+ #include <poll.h>
+ #include <signal.h>
+ #include <stdint.h>
+ #include <sys/resource.h>
+ #include <sys/eventfd.h>
+ #include <sys/socket.h>
+ #include <sys/stat.h>
+ #include <sys/syscall.h>
+ #include <sys/timerfd.h>
+ #include <sys/types.h>
+ #endif
+ 
+ #include "history.h"
+ #include "names.h"
+ #include "profile.h"
+ #include "recording.h"
+ #include "rollup.h"
+ #include "sampler.h"
+ #include "server.h"
+ #include "view.h"
+ #include "watchdog.h"
+ 
+ #define SNAPSHOT_POOL_SIZE 8
+ #define SNAPSHOT_WRITER (1 << 24)
+ #define MAX_BACKOFF 8  // Longest interval the sampler stretches to, in update intervals
+ #define NAMES_COLLECT_TICKS 16  // Ticks between frees of process names no snapshot uses
+ 
+ /* Where a column of a ProcessList lives; group is a RATE_* bit, 0 for the columns every list has */
+ typedef struct {
+     size_t offset;             // Of the column's pointer in ProcessList
+     size_t size;               // Of one value, 1, 4 or 8 bytes
+     unsigned int group;
+ } ProcessColumn;
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ #define FD_CACHE_IDLE_TICKS 5  // Idle ticks before a process may lose its cached descriptors
+ #define SCAN_CHUNK_SIZE 64     // PIDs per unit of work handed to the scan workers
+ #define PROC_EVENTS_RESYNC_TICKS 30  // Ticks between full /proc reads when using proc events
+ #define BITS_PER_WORD (8 * (int)sizeof(unsigned long))
+ #ifndef SYS_pidfd_open
+ #define SYS_pidfd_open 434          // Linux 5.3, the same number on every architecture
+ #endif
+ #ifndef SYS_pidfd_send_signal
+ #define SYS_pidfd_send_signal 424   // Linux 5.1
+ #endif
+ 
+ /* Sampling state kept for a process between ticks */
+ typedef struct {
+     int pid;                         // 0 marks an empty slot
+     unsigned long long starttime;    // Start time in clock ticks, catches PID reuse
+     unsigned long long cpu_ticks;    // utime + stime at the last sample
+     unsigned long long sampled_jiffies;  // Total jiffies when cpu_ticks was read
+     float cpu_usage;                 // CPU usage at the last sample
+     unsigned int idle_ticks;         // Consecutive ticks without CPU time
+     int stat_fd;                     // Cached /proc/<pid>/stat, or -1
+     int statm_fd;                    // Cached /proc/<pid>/statm, or -1
+     int cgroup;                      // Interned cgroup, -1 for none, CGROUP_UNREAD before it is read
+     const char *name;                // Interned name at the last read, NULL for threads
+     unsigned int counters;           // RATE_* bits of the counters below read at the last sample
+     unsigned long long read_bytes;   // From /proc/<pid>/io
+     unsigned long long write_bytes;
+     unsigned long long voluntary_switches;    // From /proc/<pid>/status
+     unsigned long long involuntary_switches;
+     unsigned long long major_faults; // From /proc/<pid>/stat
+ } ProcessState;
+ 
+ /*
+  * Open-addressed (linear probing) table of ProcessState keyed by (pid, starttime).
+  * Slots are hashed by pid alone, since a PID is unique within one tick, so the
+  * previous sample can be found before the start time has been read.
+  * Each tick the live entries are carried from prev_slots into slots, so entries
+  * for processes that were not seen again are dropped when the arrays are swapped.
+  */
+ typedef struct {
+     ProcessState *slots;             // States sampled during the current tick
+     ProcessState *prev_slots;        // States from the previous tick
+     unsigned int capacity;           // Power of two
+     unsigned int prev_capacity;      // Power of two
+     unsigned int count;
+     atomic_int cached_fds;           // Descriptors held open across ticks, plus slots claimed for them
+     unsigned long long prev_total_jiffies;  // Total jiffies across all CPUs, read at the start of the tick
+     unsigned long long total_delta;  // Jiffies elapsed across all CPUs since the last tick
+     int num_cpus;
+ } ProcessStateTable;
+ 
+ /* Fields of /proc/<pid>/stat used by the sampler */
+ typedef struct {
+     char name[256];
+     char state;
+     int ppid;
+     unsigned long long majflt;
+     unsigned long long utime;
+     unsigned long long stime;
+     unsigned long long num_threads;
+     unsigned long long starttime;
+ } ProcStat;
+ 
+ /* Jiffies of one CPU, or of all of them, at the previous tick */
+ typedef struct {
+     unsigned long long busy;         // Everything but idle and iowait
+     unsigned long long total;
+ } CpuTimes;
+ 
+ /* Final stats of a process, read when its exit event arrives */
+ typedef struct {
+     int pid;
+     ProcStat stat;
+     unsigned long long rss;
+ } ExitRecord;
+ 
+ /* Live PID set maintained from proc connector events */
+ typedef struct {
+     int sock;                        // NETLINK_CONNECTOR socket, -1 when not in use
+     int stop_pipe[2];
+     pthread_t thread;
+     pthread_mutex_t lock;            // Protects everything below
+     unsigned long *live;             // Bitmap of live TGIDs
+     int max_pid;
+     int resync;                      // Events were lost, rebuild from /proc
+     int ticks_since_resync;
+     ExitRecord *exited;              // Appended to by the listener
+     int exited_count;
+     int exited_capacity;
+     ExitRecord *draining;            // Turned into rows by the sampler
+     int draining_capacity;
+     int *execs;                      // PIDs that called exec since the last tick, while smaps are read
+     int exec_count;
+     int exec_capacity;
+ } ProcEvents;
+ 
+ /* Cached smaps_rollup totals of one of the processes with the largest RSS */
+ typedef struct {
+     int pid;
+     unsigned long long starttime;    // Catches PID reuse
+     char name[16];                   // Comm when the entry was made; a new one means an exec
+     unsigned long read_tick;         // Tick of the last read, 0 when the entry needs one
+     int valid;                       // The last read succeeded
+     int row;                         // Row of the process in the current tick
+     SmapsInfo totals;
+ } SmapsEntry;
+ 
+ /* Rows and states produced by one scan worker */
+ typedef struct {
+     ProcessList list;          // Rows in the order they were scanned
+     ProcessState *states;      // states[i] is the sampling state behind row i of list
+     int state_capacity;
+     unsigned long long open_ns;   // Time spent per phase during the current tick
+     unsigned long long read_ns;
+     unsigned long long parse_ns;
+ } ScanShard;
+ 
+ /* Where the rows of one chunk of PIDs ended up */
+ typedef struct {
+     int shard;
+     int start;
+     int count;
+ } ScanChunk;
+ 
+ /*
+  * Worker pool for the /proc scan. The PID list is cut into chunks and each
+  * worker starts on an even share, packed as (begin << 32 | end), then steals
+  * from the back of the other shares once its own runs out.
+  */
+ typedef struct {
+     pthread_t *threads;
+     int num_workers;                 // Including the sampler thread itself
+     ScanShard *shards;               // One per worker
+     atomic_ullong *ranges;           // One per worker
+     ScanChunk *chunks;
+     int num_chunks;
+     int chunk_capacity;
+     int *pids;
+     int num_pids;
+     int pid_capacity;
+     unsigned long long total_mem;
+     const ProcessList *previous_rows;  // Last published rows, repeated for cold processes
+     double hot_threshold;            // CPU usage of the hot_processes-th busiest process
+     double *usage_scratch;           // Scratch for update_hot_threshold()
+     int usage_capacity;
+     unsigned long tick;
+     pthread_mutex_t lock;
+     pthread_cond_t start_cond;
+     pthread_cond_t done_cond;
+     unsigned long generation;        // Bumped to start a scan
+     int pending;                     // Workers still scanning
+     int shutdown;
+ } ScanPool;
+ #endif
+ 
+ /* Global variables */
+ atomic_int update_interval_ms = 2000;  // Default update interval
+ size_t history_budget = 0;
+ int rate_columns = 0;
+ static pthread_t update_thread;
+ static int thread_started = 0;
+ static atomic_int running = 1;
+ static void (*publish_callback)(void *data);   // Called after every tick
+ static void *publish_data;
+ static Snapshot *snapshot_pool[SNAPSHOT_POOL_SIZE];   // Only touched by the sampler
+ static _Atomic(Snapshot *) current_snapshot = NULL;
+ static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;  // Only used without a wake_fd
+ static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+ static atomic_int refresh_requested = 0;
+ static unsigned long long last_tick_ns = 0;    // Monotonic time the last tick was due
+ static int scan_budget = 50;                   // --scan-budget, percent of the interval a tick may use
+ static int backoff = 1;                        // Update intervals between ticks, raised while over budget
+ static int dump_stats = 0;                     // --stats
+ static atomic_int sampler_done = 0;            // The sampler stopped on its own, at the end of a replay
+ static const char *record_path = NULL;         // --record
+ static const char *replay_path = NULL;         // --replay
+ static double replay_speed = 1.0;              // Replay time scale, 0 for as fast as possible
+ static double replay_skip = 0;                 // Seconds of the recording to skip
+ static RecordingWriter *recorder = NULL;
+ static Recording *replay = NULL;
+ static unsigned long long replay_timestamp_ns = 0;  // Recorded time of the frame last replayed
+ static pthread_mutex_t consumed_lock = PTHREAD_MUTEX_INITIALIZER;
+ static pthread_cond_t consumed_cond = PTHREAD_COND_INITIALIZER;
+ static unsigned long consumed_sequence = 0;    // Newest snapshot the consumer has taken, under consumed_lock
+ static pthread_mutex_t expanded_lock = PTHREAD_MUTEX_INITIALIZER;
+ static int *expanded_pids = NULL;              // Processes whose threads the UI shows, sorted, under expanded_lock
+ static int expanded_count = 0;
+ static int expanded_capacity = 0;
+ static const ProcessColumn process_columns[] = {
+     { offsetof(ProcessList, pid), sizeof(int), 0 },
+     { offsetof(ProcessList, name), sizeof(const char*), 0 },
+     { offsetof(ProcessList, cpu_usage), sizeof(double), 0 },
+     { offsetof(ProcessList, memory_usage), sizeof(double), 0 },
+     { offsetof(ProcessList, state), sizeof(char), 0 },
+     { offsetof(ProcessList, num_threads), sizeof(int), 0 },
+     { offsetof(ProcessList, first_thread), sizeof(int), 0 },
+     { offsetof(ProcessList, thread_rows), sizeof(int), 0 },
+     { offsetof(ProcessList, start_time), sizeof(unsigned long long), 0 },
+     { offsetof(ProcessList, uid), sizeof(int), 0 },
+     { offsetof(ProcessList, ppid), sizeof(int), 0 },
+     { offsetof(ProcessList, parent), sizeof(int), 0 },
+     { offsetof(ProcessList, cgroup), sizeof(int), 0 },
+     { offsetof(ProcessList, subtree_processes), sizeof(int), 0 },
+     { offsetof(ProcessList, subtree_cpu), sizeof(float), 0 },
+     { offsetof(ProcessList, subtree_memory), sizeof(float), 0 },
+     { offsetof(ProcessList, smaps), sizeof(int), 0 },
+     { offsetof(ProcessList, sampled), sizeof(char), 0 },
+     { offsetof(ProcessList, read_rate), sizeof(float), RATE_IO },
+     { offsetof(ProcessList, write_rate), sizeof(float), RATE_IO },
+     { offsetof(ProcessList, voluntary_switch_rate), sizeof(float), RATE_CTXSW },
+     { offsetof(ProcessList, involuntary_switch_rate), sizeof(float), RATE_CTXSW },
+     { offsetof(ProcessList, major_fault_rate), sizeof(float), RATE_FAULTS }
+ };
+ static ProcessList sort_scratch;               // Rows reordered by sort_process_list(), then swapped in
+ static int *sort_rows = NULL;
+ static int sort_row_capacity = 0;
+ static const int *sort_pids = NULL;            // PIDs the rows are being ordered by
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ static ProcessStateTable process_states;
+ static const char *proc_root = "/proc";  // --proc-root, a real or fixture /proc tree
+ static DIR *proc_dir = NULL;   // Cached proc_root handle, rewound on every scan
+ static long page_size = 4096;
+ static long clock_ticks = 100;  // Jiffies per second, for the rate columns
+ static int fd_cache_limit = 0;  // Max descriptors kept open across ticks, 0 disables the cache
+ static int scan_threads = 1;    // Scan workers including the sampler thread, 0 for one per CPU
+ static ScanPool scan_pool;
+ static int use_proc_events = 0;
+ static ProcEvents proc_events = { .sock = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+ static ProcessStateTable thread_states;  // Per-thread sampling state, keyed by TID
+ static CpuTimes host_times;             // The aggregate cpu line at the previous tick
+ static CpuTimes *cpu_times = NULL;      // Each cpuN line at the previous tick, indexed by N
+ static int cpu_times_capacity = 0;
+ static double thread_threshold = 0;     // --thread-threshold, CPU% above which threads are always read
+ static int *expanded_scratch = NULL;    // This tick's copy of expanded_pids
+ static char *expanded_seen = NULL;
+ static int expanded_scratch_capacity = 0;
+ static int hot_processes = 32;  // Busiest processes read every tick when tiering
+ static int cold_every = 1;      // Ticks between reads of the other processes, 1 disables tiering
+ static int smaps_top = 16;      // --smaps-top, largest processes by RSS whose smaps_rollup is read
+ static int smaps_every = 10;    // --smaps-every, ticks between smaps_rollup reads of one process
+ static SmapsEntry *smaps_cache = NULL;  // Entries of the previous tick, ordered by PID
+ static SmapsEntry *smaps_next = NULL;   // Built for the current tick, then swapped in
+ static int smaps_count = 0;
+ static int timer_fd = -1;      // Drives the ticks when available
+ static int wake_fd = -1;       // eventfd signalled by sampler_wake()
+ #endif
+ 
+ /* Function prototypes */
+ static char *column_values(const ProcessList *list, const ProcessColumn *column);
+ static void process_list_layout(ProcessList *list, int capacity, unsigned int columns);
+ static void process_list_reserve(ProcessList *list, int count);
+ static void process_list_unknown_rates(ProcessList *list, int start, int count, unsigned int groups);
+ static void process_list_set_smaps(ProcessList *list, int row, const SmapsInfo *smaps);
+ static void process_list_append(ProcessList *list, const ProcessList *from, int start, int count);
+ static void gather_values(char *to, const char *from, const int *rows, int count, size_t size);
+ static Snapshot *snapshot_begin(void);
+ static void snapshot_publish(Snapshot *snapshot);
+ static unsigned long oldest_live_sequence(void);
+ static void append_row(ProcessList *list, int pid, const char *name, double cpu, double mem);
+ static void sort_process_list(ProcessList *list);
+ static void update_process_data();
+ static void sampler_wake(void);
+ static void adjust_backoff(unsigned long long tick_ns);
+ static unsigned long long next_deadline_ns(unsigned long long now);
+ static int sampler_wait(void);
+ static int sampler_wait_cond(void);
+ static int wait_consumed(void);
+ static int next_interval_ms(void);
+ static void *update_thread_func(void *data);
+ 
+ /* Platform-specific functions */
+ #ifdef _WIN32
+ static void get_win_processes(ProcessList *list);
+ #elif defined(__APPLE__)
+ static void get_mac_processes(ProcessList *list);
+ #else
+ static void get_linux_processes(ProcessList *list, ProcessList *exited, ThreadList *threads, SystemInfo *system);
+ static void state_table_init(ProcessStateTable *table);
+ static void state_table_free(ProcessStateTable *table);
+ static float cpu_times_usage(CpuTimes *times, unsigned long long busy, unsigned long long total);
+ static void state_table_begin_tick(ProcessStateTable *table, SystemInfo *system);
+ static ProcessState *state_table_lookup(ProcessStateTable *table, int pid);
+ static void state_table_insert(ProcessStateTable *table, const ProcessState *state);
+ static double state_table_account(const ProcessStateTable *table, const ProcessState *prev,
+                                   ProcessState *state, unsigned long long cpu_ticks);
+ static void state_table_rates(const ProcessStateTable *table, const ProcessState *prev,
+                               const ProcessState *state, ProcessList *list, int row);
+ static int state_table_claim_fds(ProcessStateTable *table, int count);
+ static void state_table_close_fds(ProcessStateTable *table, ProcessState *state);
+ static void state_table_end_tick(ProcessStateTable *table);
+ static int find_proc_field(const char *buf, const char *key, unsigned long long *value);
+ static void read_rate_counters(ScanShard *shard, char *path, size_t len, ProcessState *state,
+                                const ProcStat *stat, unsigned long long *mark);
+ static void shard_add(ScanShard *shard, const ProcessState *state, const char *name, double cpu, double mem);
+ static int find_row(const ProcessList *list, int pid);
+ static double kth_largest(double *values, int n, int k);
+ static void update_hot_threshold(const ProcessList *list);
+ static void add_thread(ThreadList *threads, int pid, int tid, const ProcStat *stat, double cpu);
+ static void scan_task_dir(ProcessList *list, int row, ThreadList *threads);
+ static void collect_threads(ProcessList *list, ThreadList *threads);
+ static double *usage_values(int count);
+ static int parse_smaps_rollup(const char *buf, SmapsInfo *totals);
+ static void read_smaps_rollup(SmapsEntry *entry);
+ static SmapsEntry *smaps_find(int pid);
+ static void collect_smaps(ProcessList *list);
+ static unsigned long long process_start_time(int pid);
+ static int parse_proc_cgroup(char *buf);
+ static void collect_cgroups(ProcessList *list);
+ static int fd_cache_max_limit(void);
+ static void close_linux_sampler(void);
+ #endif
+ 
+ /* Apply one sampler command-line option; returns 0 if the option is not a sampler one */
+ int parse_sampler_option(const char *arg) {
+     // --sort, --filter, --filter-regex, --user and --top set the initial view spec
+     if (view_parse_option(arg)) {
+         return 1;
+     }
+     // --cgroup-every and --cgroup-root set up the cgroup rollups
+     if (rollup_parse_option(arg)) {
+         return 1;
+     }
+     // --watch, --watch-dry-run and --watch-log set up the watchdog rules
+     if (watchdog_parse_option(arg)) {
+         return 1;
+     }
+     // --serve serves the snapshots over a Unix socket or a loopback port
+     if (server_parse_option(arg)) {
+         return 1;
+     }
+     // --history-budget=MB: memory for per-process history, 0 disables it
+     if (strncmp(arg, "--history-budget=", 17) == 0) {
+         history_budget = (size_t)strtoul(arg + 17, NULL, 10) << 20;
+         return 1;
+     }
+     // --stats: print the self-profiling histograms when the sampler stops
+     if (strcmp(arg, "--stats") == 0) {
+         dump_stats = 1;
+         return 1;
+     }
+     // --scan-budget=PCT: back off while a tick takes more than PCT% of the interval, 0 never backs off
+     if (strncmp(arg, "--scan-budget=", 14) == 0) {
+         scan_budget = atoi(arg + 14);
+         return 1;
+     }
+     // --record=FILE: record every snapshot to FILE
+     if (strncmp(arg, "--record=", 9) == 0) {
+         record_path = arg + 9;
+         return 1;
+     }
+     // --replay=FILE: publish the snapshots recorded in FILE instead of sampling
+     if (strncmp(arg, "--replay=", 9) == 0) {
+         replay_path = arg + 9;
+         return 1;
+     }
+     // --replay-skip=S: start the replay S seconds into the recording
+     if (strncmp(arg, "--replay-skip=", 14) == 0) {
+         replay_skip = atof(arg + 14);
+         return 1;
+     }
+     // --replay-speed=X: replay X times faster than recorded, 0 for as fast as possible
+     if (strncmp(arg, "--replay-speed=", 15) == 0) {
+         replay_speed = atof(arg + 15);
+         return 1;
+     }
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     // --fd-cache[=N]: keep up to N /proc descriptors open across ticks
+     if (strncmp(arg, "--fd-cache", 10) == 0 && (arg[10] == '\0' || arg[10] == '=')) {
+         int max_limit = fd_cache_max_limit();
+         fd_cache_limit = max_limit;
+         if (arg[10] == '=' && atoi(arg + 11) < max_limit) {
+             fd_cache_limit = atoi(arg + 11);
+         }
+         return 1;
+     }
+     // --scan-threads=N: scan /proc on N threads, 0 for one per CPU
+     if (strncmp(arg, "--scan-threads=", 15) == 0) {
+         scan_threads = atoi(arg + 15);
+         return 1;
+     }
+     // --proc-events: track process lifecycles through the netlink proc connector
+     if (strcmp(arg, "--proc-events") == 0) {
+         use_proc_events = 1;
+         return 1;
+     }
+     // --cold-every=N: read all but the busiest processes only every N ticks
+     if (strncmp(arg, "--cold-every=", 13) == 0) {
+         cold_every = atoi(arg + 13) > 1 ? atoi(arg + 13) : 1;
+         return 1;
+     }
+     // --hot-processes=K: the busiest K processes are read every tick with --cold-every
+     if (strncmp(arg, "--hot-processes=", 16) == 0) {
+         hot_processes = atoi(arg + 16);
+         return 1;
+     }
+     // --thread-threshold=PCT: also read the threads of processes above PCT% CPU, not just expanded ones
+     if (strncmp(arg, "--thread-threshold=", 19) == 0) {
+         thread_threshold = atof(arg + 19);
+         return 1;
+     }
+     // --smaps-top=N: read smaps_rollup of the N processes with the largest RSS, 0 disables it
+     if (strncmp(arg, "--smaps-top=", 12) == 0) {
+         smaps_top = atoi(arg + 12);
+         return 1;
+     }
+     // --smaps-every=T: read smaps_rollup of each of those processes every T ticks
+     if (strncmp(arg, "--smaps-every=", 14) == 0) {
+         smaps_every = atoi(arg + 14) > 1 ? atoi(arg + 14) : 1;
+         return 1;
+     }
+     // --rates=LIST: fill the rate columns named in LIST, any of io, ctxsw and faults, or all
+     if (strncmp(arg, "--rates=", 8) == 0) {
+         static const struct { const char *name; int columns; } rate_names[] = {
+             { "io", RATE_IO }, { "ctxsw", RATE_CTXSW }, { "faults", RATE_FAULTS },
+             { "all", RATE_IO | RATE_CTXSW | RATE_FAULTS }
+         };
+         int columns = 0;
+         for (const char *p = arg + 8; *p != '\0'; ) {
+             size_t len = strcspn(p, ",");
+             int found = 0;
+             for (int i = 0; i < (int)(sizeof(rate_names) / sizeof(rate_names[0])); i++) {
+                 if (strlen(rate_names[i].name) == len && strncmp(p, rate_names[i].name, len) == 0) {
+                     columns |= rate_names[i].columns;
+                     found = 1;
+                 }
+             }
+             if (!found) {
+                 return 0;
+             }
+             p += len;
+             p += *p == ',';
+         }
+         rate_columns = columns;
+         return 1;
+     }
+     // --proc-root=DIR: read processes from DIR instead of /proc, e.g. a benchmark fixture
+     if (strncmp(arg, "--proc-root=", 12) == 0) {
+         proc_root = arg + 12;
+         return 1;
+     }
+ #else
+     (void)arg;  // Unused parameter
+ #endif
+     return 0;
+ }
+ 
+ /* Set up the sampler state without starting the thread; returns 0 if a recording cannot be opened */
+ int sampler_init(void) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     state_table_init(&process_states);
+     state_table_init(&thread_states);
+     timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+     wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+     if (timer_fd < 0 || wake_fd < 0) {
+         // Fall back to the condition variable
+         if (timer_fd >= 0) {
+             close(timer_fd);
+         }
+         if (wake_fd >= 0) {
+             close(wake_fd);
+         }
+         timer_fd = -1;
+         wake_fd = -1;
+     }
+ #endif
+     if (history_budget > 0 && !history_init(history_budget)) {
+         fprintf(stderr, "Cannot allocate the process history, continuing without it\n");
+     }
+     if (replay_path != NULL && (replay = recording_open(replay_path)) == NULL) {
+         return 0;
+     }
+     unsigned long long first_timestamp_ns;
+     if (replay != NULL && replay_skip > 0 && recording_peek_timestamp(replay, &first_timestamp_ns)) {
+         recording_seek(replay, first_timestamp_ns + (unsigned long long)(replay_skip * 1e9));
+     }
+     if (record_path != NULL && (recorder = recording_create(record_path)) == NULL) {
+         if (replay != NULL) {
+             recording_close(replay);
+             replay = NULL;
+         }
+         return 0;
+     }
+     return 1;
+ }
+ 
+ /* Start the sampler thread; on_publish runs on it after every tick. Returns 0 if a recording cannot be opened */
+ int start_sampler(void (*on_publish)(void *data), void *data) {
+     publish_callback = on_publish;
+     publish_data = data;
+     
+     if (!sampler_init()) {
+         return 0;
+     }
+     pthread_create(&update_thread, NULL, update_thread_func, NULL);
+     thread_started = 1;
+     if (!server_start()) {
+         fprintf(stderr, "Continuing without the metrics server\n");
+     }
+     return 1;
+ }
+ 
+ /* Run one tick on the calling thread, for callers that drive the sampler without start_sampler() */
+ void sampler_tick(void) {
+     update_process_data();
+ }
+ 
+ /* A column's values, or NULL if the list doesn't have the column */
+ static char *column_values(const ProcessList *list, const ProcessColumn *column) {
+     char *values;
+     memcpy(&values, (const char*)list + column->offset, sizeof(values));  // The member is a typed pointer
+     return values;
+ }
+ 
+ /*
+  * Lay a list's columns out in a new block with room for capacity rows and
+  * the given rate groups, keeping its rows. Rows start out with unknown
+  * rates in the groups the list gains.
+  */
+ static void process_list_layout(ProcessList *list, int capacity, unsigned int columns) {
+     size_t size = 0;
+     for (size_t c = 0; c < sizeof(process_columns) / sizeof(process_columns[0]); c++) {
+         if ((process_columns[c].group & ~columns) == 0) {
+             size += (process_columns[c].size * capacity + 7) & ~(size_t)7;  // Keeps every column aligned
+         }
+     }
+     
+     char *block = (char*)malloc(size > 0 ? size : 1);
+     char *next = block;
+     for (size_t c = 0; c < sizeof(process_columns) / sizeof(process_columns[0]); c++) {
+         const ProcessColumn *column = &process_columns[c];
+         char *old = column_values(list, column);
+         char *values = NULL;
+         if ((column->group & ~columns) == 0) {
+             values = next;
+             next += (column->size * capacity + 7) & ~(size_t)7;
+             if (old != NULL && list->count > 0) {
+                 memcpy(values, old, column->size * list->count);
+             }
+         }
+         memcpy((char*)list + column->offset, &values, sizeof(values));
+     }
+     free(list->block);
+     list->block = block;
+     list->capacity = capacity;
+     unsigned int gained = columns & ~list->columns;
+     list->columns = columns;
+     process_list_unknown_rates(list, 0, list->count, gained);
+ }
+ 
+ /* Make room for count rows in all, doubling the block */
+ static void process_list_reserve(ProcessList *list, int count) {
+     if (count > list->capacity || list->block == NULL) {
+         int capacity = list->capacity > 0 ? list->capacity : 128;
+         while (capacity < count) {
+             capacity *= 2;
+         }
+         process_list_layout(list, capacity, list->columns);
+     }
+ }
+ 
+ /* Mark the rates of some rows unknown in the given groups */
+ static void process_list_unknown_rates(ProcessList *list, int start, int count, unsigned int groups) {
+     for (int i = start; i < start + count; i++) {
+         if (groups & RATE_IO) {
+             list->read_rate[i] = -1;
+             list->write_rate[i] = -1;
+         }
+         if (groups & RATE_CTXSW) {
+             list->voluntary_switch_rate[i] = -1;
+             list->involuntary_switch_rate[i] = -1;
+         }
+         if (groups & RATE_FAULTS) {
+             list->major_fault_rate[i] = -1;
+         }
+     }
+ }
+ 
+ /* Give a row a memory breakdown, added to the list's side table */
+ static void process_list_set_smaps(ProcessList *list, int row, const SmapsInfo *smaps) {
+     if (list->smaps_count >= list->smaps_capacity) {
+         list->smaps_capacity = list->smaps_capacity > 0 ? list->smaps_capacity * 2 : 32;
+         list->smaps_info = (SmapsInfo*)realloc(list->smaps_info, list->smaps_capacity * sizeof(SmapsInfo));
+     }
+     list->smaps_info[list->smaps_count] = *smaps;
+     list->smaps[row] = list->smaps_count++;
+ }
+ 
+ /* Empty a list for refilling, keeping its block */
+ void process_list_clear(ProcessList *list) {
+     list->count = 0;
+     list->smaps_count = 0;
+ }
+ 
+ /* Give a list exactly the rate column groups in columns */
+ void process_list_set_columns(ProcessList *list, unsigned int columns) {
+     if (columns != list->columns) {
+         process_list_layout(list, list->capacity, columns);
+     }
+ }
+ 
+ /* Free a list's block and side table */
+ void process_list_free(ProcessList *list) {
+     free(list->block);
+     free(list->smaps_info);
+     memset(list, 0, sizeof(ProcessList));
+ }
+ 
+ /* Append rows [start, start + count) of another list; rates it has no columns for are unknown */
+ static void process_list_append(ProcessList *list, const ProcessList *from, int start, int count) {
+     process_list_reserve(list, list->count + count);
+     for (size_t c = 0; c < sizeof(process_columns) / sizeof(process_columns[0]); c++) {
+         const ProcessColumn *column = &process_columns[c];
+         char *values = column_values(list, column);
+         const char *source = column_values(from, column);
+         if (values != NULL && source != NULL) {
+             memcpy(values + list->count * column->size, source + start * column->size, count * column->size);
+         }
+     }
+     process_list_unknown_rates(list, list->count, count, list->columns & ~from->columns);
+     for (int i = 0; i < count && from->smaps_count > 0; i++) {
+         if (from->smaps[start + i] >= 0) {
+             process_list_set_smaps(list, list->count + i, &from->smaps_info[from->smaps[start + i]]);
+         }
+     }
+     list->count += count;
+ }
+ 
+ /* Copy the values of some rows into consecutive slots; columns are 1, 4 or 8 bytes wide */
+ static void gather_values(char *to, const char *from, const int *rows, int count, size_t size) {
+     switch (size) {
+     case 1:
+         for (int i = 0; i < count; i++) {
+             to[i] = from[rows[i]];
+         }
+         break;
+     case 4:
+         for (int i = 0; i < count; i++) {
+             memcpy(to + (size_t)i * 4, from + (size_t)rows[i] * 4, 4);
+         }
+         break;
+     default:
+         for (int i = 0; i < count; i++) {
+             memcpy(to + (size_t)i * 8, from + (size_t)rows[i] * 8, 8);
+         }
+         break;
+     }
+ }
+ 
+ /* Append the given rows of another list in that order; rates it has no columns for are unknown */
+ void process_list_gather(ProcessList *list, const ProcessList *from, const int *rows, int count) {
+     process_list_reserve(list, list->count + count);
+     for (size_t c = 0; c < sizeof(process_columns) / sizeof(process_columns[0]); c++) {
+         const ProcessColumn *column = &process_columns[c];
+         char *values = column_values(list, column);
+         const char *source = column_values(from, column);
+         if (values != NULL && source != NULL) {
+             gather_values(values + list->count * column->size, source, rows, count, column->size);
+         }
+     }
+     process_list_unknown_rates(list, list->count, count, list->columns & ~from->columns);
+     for (int i = 0; i < count && from->smaps_count > 0; i++) {
+         if (from->smaps[rows[i]] >= 0) {
+             process_list_set_smaps(list, list->count + i, &from->smaps_info[from->smaps[rows[i]]]);
+         }
+     }
+     list->count += count;
+ }
+ 
+ /* Add a process to the list */
+ void add_process(ProcessList *list, int pid, const char *name, double cpu, double mem) {
+     append_row(list, pid, names_intern(name), cpu, mem);
+ }
+ 
+ /* Add a row whose name is already interned */
+ static void append_row(ProcessList *list, int pid, const char *name, double cpu, double mem) {
+     process_list_reserve(list, list->count + 1);
+     int row = list->count++;
+     list->pid[row] = pid;
+     list->name[row] = name;
+     list->cpu_usage[row] = cpu;
+     list->memory_usage[row] = mem;
+     list->state[row] = 0;
+     list->num_threads[row] = 0;
+     list->first_thread[row] = 0;
+     list->thread_rows[row] = 0;
+     list->start_time[row] = 0;
+     list->uid[row] = -1;
+     list->ppid[row] = 0;
+     list->parent[row] = -1;
+     list->cgroup[row] = -1;
+     list->subtree_processes[row] = 1;
+     list->subtree_cpu[row] = (float)cpu;
+     list->subtree_memory[row] = (float)mem;
+     list->smaps[row] = -1;
+     list->sampled[row] = 1;
+     process_list_unknown_rates(list, row, 1, list->columns);
+ }
+ 
+ /* Take a reference to the latest snapshot, or NULL if none has been published yet */
+ Snapshot *snapshot_acquire(void) {
+     for (;;) {
+         Snapshot *snapshot = atomic_load(&current_snapshot);
+         if (snapshot == NULL) {
+             return NULL;
+         }
+         
+         // The reference only counts if the snapshot was still current after taking it
+         atomic_fetch_add(&snapshot->refs, 1);
+         if (atomic_load(&current_snapshot) == snapshot) {
+             return snapshot;
+         }
+         atomic_fetch_sub(&snapshot->refs, 1);
+     }
+ }
+ 
+ /* Drop a reference taken with snapshot_acquire() */
+ void snapshot_release(Snapshot *snapshot) {
+     atomic_fetch_sub(&snapshot->refs, 1);
+ }
+ 
+ /* Claim a snapshot no reader holds for the sampler to fill; NULL if all are in use */
+ static Snapshot *snapshot_begin(void) {
+     Snapshot *current = atomic_load(&current_snapshot);
+     
+     for (int i = 0; i < SNAPSHOT_POOL_SIZE; i++) {
+         Snapshot *snapshot = snapshot_pool[i];
+         
+         if (snapshot == NULL) {
+             snapshot = (Snapshot*)calloc(1, sizeof(Snapshot));  // Lists get their blocks on first use
+             atomic_init(&snapshot->refs, SNAPSHOT_WRITER);
+             snapshot_pool[i] = snapshot;
+             return snapshot;
+         }
+         
+         int expected = 0;
+         if (snapshot != current &&
+             atomic_compare_exchange_strong(&snapshot->refs, &expected, SNAPSHOT_WRITER)) {
+             return snapshot;
+         }
+     }
+     
+     return NULL;
+ }
+ 
+ /* Make a filled snapshot the current one */
+ static void snapshot_publish(Snapshot *snapshot) {
+     Snapshot *previous = atomic_load(&current_snapshot);
+     
+     snapshot->sequence = previous != NULL ? previous->sequence + 1 : 1;
+     atomic_store(&current_snapshot, snapshot);
+     atomic_fetch_sub(&snapshot->refs, SNAPSHOT_WRITER);
+ }
+ 
+ /* Sequence of the oldest snapshot a reader may still hold */
+ static unsigned long oldest_live_sequence(void) {
+     Snapshot *current = atomic_load(&current_snapshot);
+     unsigned long oldest = current != NULL ? current->sequence : 0;
+     
+     // A reader that takes a reference after this check finds the snapshot no longer current and drops it unread
+     for (int i = 0; i < SNAPSHOT_POOL_SIZE; i++) {
+         Snapshot *snapshot = snapshot_pool[i];
+         if (snapshot != NULL && atomic_load(&snapshot->refs) > 0 && snapshot->sequence < oldest) {
+             oldest = snapshot->sequence;
+         }
+     }
+     return oldest;
+ }
+ 
+ /* Free the snapshot pool once the sampler and all readers are done */
+ void free_snapshots(void) {
+     atomic_store(&current_snapshot, NULL);
+     for (int i = 0; i < SNAPSHOT_POOL_SIZE; i++) {
+         if (snapshot_pool[i] != NULL) {
+             process_list_free(&snapshot_pool[i]->list);
+             process_list_free(&snapshot_pool[i]->exited);
+             process_list_free(&snapshot_pool[i]->view);
+             free(snapshot_pool[i]->cgroups.cgroups);
+             free(snapshot_pool[i]->cgroups.paths);
+             free(snapshot_pool[i]->threads.threads);
+             free(snapshot_pool[i]->system.cpu_usage);
+             free(snapshot_pool[i]);
+             snapshot_pool[i] = NULL;
+         }
+     }
+     names_free();
+ }
+ 
+ /* Compare two rows by PID */
+ static int compare_pids(const void *a, const void *b) {
+     int pid_a = sort_pids[*(const int*)a];
+     int pid_b = sort_pids[*(const int*)b];
+     return (pid_a > pid_b) - (pid_a < pid_b);
+ }
+ 
+ /* Order rows by PID; /proc already lists them in order, so usually this is one pass */
+ static void sort_process_list(ProcessList *list) {
+     int sorted = 1;
+     for (int i = 1; i < list->count && sorted; i++) {
+         sorted = list->pid[i] >= list->pid[i - 1];
+     }
+     if (sorted) {
+         return;
+     }
+     
+     if (list->count > sort_row_capacity) {
+         sort_row_capacity = list->count * 2;
+         sort_rows = (int*)realloc(sort_rows, sort_row_capacity * sizeof(int));
+     }
+     for (int i = 0; i < list->count; i++) {
+         sort_rows[i] = i;
+     }
+     sort_pids = list->pid;
+     qsort(sort_rows, list->count, sizeof(int), compare_pids);
+     
+     // Gather the rows in order into the scratch list and swap the two
+     process_list_clear(&sort_scratch);
+     process_list_set_columns(&sort_scratch, list->columns);
+     process_list_gather(&sort_scratch, list, sort_rows, list->count);
+     ProcessList swap = *list;
+     *list = sort_scratch;
+     sort_scratch = swap;
+ }
+ 
+ /* Update process data into a fresh snapshot and publish it */
+ static void update_process_data() {
+     unsigned long long start = profile_now();
+     Snapshot *snapshot = snapshot_begin();
+     if (snapshot == NULL) {
+         return;  // Every snapshot is held by a reader; try again next tick
+     }
+     
+     /* Clear the previous contents; the view spec is fixed for the tick before the scan needs it */
+     int view_active = view_begin_tick();
+     process_list_clear(&snapshot->list);
+     process_list_clear(&snapshot->exited);
+     process_list_set_columns(&snapshot->list, replay != NULL ? 0 : rate_columns);  // Recordings carry no rates
+     snapshot->threads.count = 0;
+     snapshot->cgroups.count = 0;
+     snapshot->system.num_cpus = 0;
+     snapshot->system.total_cpu_usage = -1;
+     snapshot->system.mem_total_kb = 0;
+     snapshot->system.mem_available_kb = 0;
+     snapshot->system.mem_cached_kb = 0;
+     snapshot->system.swap_total_kb = 0;
+     snapshot->system.swap_free_kb = 0;
+     
+     if (replay != NULL) {
+         /* Take the next recorded frame, with its recorded time */
+         if (!recording_next(replay, &snapshot->list, &snapshot->exited, &snapshot->timestamp_ns)) {
+             atomic_fetch_sub(&snapshot->refs, SNAPSHOT_WRITER);  // Nothing to publish
+             atomic_store(&sampler_done, 1);
+             return;
+         }
+         replay_timestamp_ns = snapshot->timestamp_ns;
+     } else {
+         /* Get platform-specific process data */
+ #ifdef _WIN32
+         get_win_processes(&snapshot->list);
+ #elif defined(__APPLE__)
+         get_mac_processes(&snapshot->list);
+ #else
+         get_linux_processes(&snapshot->list, &snapshot->exited, &snapshot->threads, &snapshot->system);
+ #endif
+         if (!atomic_load(&running)) {
+             atomic_fetch_sub(&snapshot->refs, SNAPSHOT_WRITER);  // Stopped mid-scan, nothing to publish
+             return;
+         }
+         
+         struct timespec now;
+         clock_gettime(CLOCK_REALTIME, &now);
+         snapshot->timestamp_ns = (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+     }
+     
+     unsigned long long mark = profile_now();
+     sort_process_list(&snapshot->list);
+     
+     /* Link rows to their parents and cgroups and sum up both hierarchies, before the view copies rows */
+     unsigned long long rollup_start = profile_now();
+     rollup_process_tree(&snapshot->list);
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     if (replay == NULL) {
+         rollup_cgroups(&snapshot->list, &snapshot->cgroups, scan_pool.total_mem);
+     }
+ #endif
+     unsigned long long rollup_ns = profile_now() - rollup_start;
+     profile_record(PROFILE_ROLLUP, rollup_ns);
+     
+     /* Watchdog rules act on the rows of this tick, before anything else sees them */
+     unsigned long long watchdog_ns = 0;
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     if (replay == NULL && watchdog_rule_count > 0) {
+         unsigned long long watchdog_start = profile_now();
+         watchdog_tick(&snapshot->list, scan_pool.total_mem);
+         watchdog_ns = profile_now() - watchdog_start;
+         profile_record(PROFILE_WATCHDOG, watchdog_ns);
+     }
+ #endif
+     
+     snapshot->has_view = view_active;
+     process_list_clear(&snapshot->view);
+     process_list_set_columns(&snapshot->view, snapshot->list.columns);
+     if (view_active) {
+         view_select(&snapshot->list, &snapshot->view);
+     }
+     history_record(&snapshot->list, snapshot->timestamp_ns);
+     if (recorder != NULL) {
+         recording_append(recorder, snapshot);
+     }
+     snapshot_publish(snapshot);
+     
+     /* Keep the names of this snapshot's rows, and free those no readable snapshot uses */
+     names_mark(&snapshot->list, snapshot->sequence);
+     names_mark(&snapshot->exited, snapshot->sequence);
+     if (snapshot->sequence % NAMES_COLLECT_TICKS == 0) {
+         names_collect(oldest_live_sequence());
+     }
+     
+     unsigned long long end = profile_now();
+     profile_record(PROFILE_PUBLISH, end - mark - rollup_ns - watchdog_ns);
+     profile_record(PROFILE_TICK, end - start);
+     if (replay == NULL && end - start > (unsigned long long)atomic_load(&update_interval_ms) * 1000000ULL) {
+         profile_overrun();
+     }
+     if (replay == NULL) {
+         adjust_backoff(end - start);
+     }
+ }
+ 
+ /*
+  * Stretch the interval to as many update intervals as a tick needs to stay
+  * within scan_budget percent of it, and come back down one step per tick.
+  */
+ static void adjust_backoff(unsigned long long tick_ns) {
+     unsigned long long budget_ns = (unsigned long long)atomic_load(&update_interval_ms) * 10000ULL * scan_budget;
+     if (budget_ns == 0) {
+         backoff = 1;
+         return;
+     }
+     
+     unsigned long long needed = (tick_ns + budget_ns - 1) / budget_ns;
+     if (needed > MAX_BACKOFF) {
+         needed = MAX_BACKOFF;
+     }
+     if ((int)needed > backoff) {
+         backoff = (int)needed;
+     } else if (backoff > 1 && (int)needed < backoff) {
+         backoff--;
+     }
+ }
+ 
+ /*
+  * Monotonic time the next tick is due. Live ticks stay on a fixed grid of
+  * (backed-off) intervals from the previous one, skipping slots a long tick
+  * overran, so the period never drifts. Replays catch up instead of skipping.
+  */
+ static unsigned long long next_deadline_ns(unsigned long long now) {
+     unsigned long long interval_ns = (unsigned long long)next_interval_ms() * 1000000ULL;
+     
+     if (replay != NULL) {
+         return last_tick_ns + interval_ns;
+     }
+     interval_ns *= (unsigned long long)backoff;
+     if (interval_ns == 0) {
+         return now;
+     }
+     
+     unsigned long long deadline = last_tick_ns + interval_ns;
+     if (deadline <= now) {
+         deadline += (now - deadline) / interval_ns * interval_ns + interval_ns;
+     }
+     return deadline;
+ }
+ 
+ /*
+  * Wait until the next tick is due; returns 0 once shutting down. Wakeups from
+  * sampler_wake() re-check the flags and re-arm the timer, so a refresh,
+  * interval change or shutdown takes effect immediately.
+  */
+ static int sampler_wait(void) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     if (timer_fd < 0) {
+         return sampler_wait_cond();
+     }
+     
+     for (;;) {
+         if (!atomic_load(&running)) {
+             return 0;
+         }
+         unsigned long long now = profile_now();
+         if (atomic_exchange(&refresh_requested, 0)) {
+             last_tick_ns = now;  // A refresh restarts the grid
+             return 1;
+         }
+         unsigned long long deadline = next_deadline_ns(now);
+         if (deadline <= now) {
+             last_tick_ns = deadline;
+             return 1;
+         }
+         
+         struct itimerspec spec;
+         memset(&spec, 0, sizeof(spec));
+         spec.it_value.tv_sec = (time_t)(deadline / 1000000000ULL);
+         spec.it_value.tv_nsec = (long)(deadline % 1000000000ULL);
+         timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+         
+         struct pollfd fds[2] = { { timer_fd, POLLIN, 0 }, { wake_fd, POLLIN, 0 } };
+         if (poll(fds, 2, -1) < 0) {
+             continue;  // EINTR
+         }
+         uint64_t count;
+         if (fds[1].revents & POLLIN) {
+             ssize_t ignored = read(wake_fd, &count, sizeof(count));
+             (void)ignored;
+         }
+         if ((fds[0].revents & POLLIN) && read(timer_fd, &count, sizeof(count)) == sizeof(count)) {
+             last_tick_ns = deadline;
+             return atomic_load(&running);
+         }
+     }
+ #else
+     return sampler_wait_cond();
+ #endif
+ }
+ 
+ /* sampler_wait() on a condition variable, where there is no timerfd */
+ static int sampler_wait_cond(void) {
+     pthread_mutex_lock(&wake_lock);
+     for (;;) {
+         if (!atomic_load(&running)) {
+             break;
+         }
+         unsigned long long now = profile_now();
+         if (atomic_exchange(&refresh_requested, 0)) {
+             last_tick_ns = now;
+             break;
+         }
+         unsigned long long deadline = next_deadline_ns(now);
+         if (deadline <= now) {
+             last_tick_ns = deadline;
+             break;
+         }
+         
+         // Condition variables time out on the wall clock; convert the monotonic deadline
+         struct timespec wall;
+         clock_gettime(CLOCK_REALTIME, &wall);
+         unsigned long long wall_deadline = (unsigned long long)wall.tv_sec * 1000000000ULL +
+                                            (unsigned long long)wall.tv_nsec + (deadline - now);
+         wall.tv_sec = (time_t)(wall_deadline / 1000000000ULL);
+         wall.tv_nsec = (long)(wall_deadline % 1000000000ULL);
+         if (pthread_cond_timedwait(&wake_cond, &wake_lock, &wall) == ETIMEDOUT && profile_now() >= deadline) {
+             last_tick_ns = deadline;
+             break;
+         }
+     }
+     int keep_running = atomic_load(&running);
+     pthread_mutex_unlock(&wake_lock);
+     
+     return keep_running;
+ }
+ 
+ /* Wake the sampler to re-check its flags */
+ static void sampler_wake(void) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     if (wake_fd >= 0) {
+         uint64_t one = 1;
+         ssize_t ignored = write(wake_fd, &one, sizeof(one));
+         (void)ignored;
+         return;
+     }
+ #endif
+     pthread_mutex_lock(&wake_lock);
+     pthread_cond_signal(&wake_cond);
+     pthread_mutex_unlock(&wake_lock);
+ }
+ 
+ /* Show or hide a process's threads; the sampler reads the threads of shown processes every tick */
+ void set_threads_expanded(int pid, int expanded) {
+     pthread_mutex_lock(&expanded_lock);
+     int low = 0;
+     int high = expanded_count;
+     while (low < high) {
+         int mid = low + (high - low) / 2;
+         if (expanded_pids[mid] < pid) {
+             low = mid + 1;
+         } else {
+             high = mid;
+         }
+     }
+     int found = low < expanded_count && expanded_pids[low] == pid;
+     
+     if (expanded && !found) {
+         if (expanded_count >= expanded_capacity) {
+             expanded_capacity = expanded_capacity > 0 ? expanded_capacity * 2 : 16;
+             expanded_pids = (int*)realloc(expanded_pids, expanded_capacity * sizeof(int));
+         }
+         memmove(expanded_pids + low + 1, expanded_pids + low, (expanded_count - low) * sizeof(int));
+         expanded_pids[low] = pid;
+         expanded_count++;
+     } else if (!expanded && found) {
+         memmove(expanded_pids + low, expanded_pids + low + 1, (expanded_count - low - 1) * sizeof(int));
+         expanded_count--;
+     }
+     pthread_mutex_unlock(&expanded_lock);
+ }
+ 
+ /* Ask the sampler to scan now instead of waiting out the interval */
+ void request_refresh(void) {
+     atomic_store(&refresh_requested, 1);
+     sampler_wake();
+ }
+ 
+ /* Change the update interval; a sampler waiting on the old one re-arms at once */
+ void set_update_interval(int interval_ms) {
+     atomic_store(&update_interval_ms, interval_ms);
+     sampler_wake();
+ }
+ 
+ /* Tell the sampler to exit and wait for it; snapshots stay readable until free_snapshots() */
+ void stop_sampler(void) {
+     server_stop();
+     atomic_store(&running, 0);
+     sampler_wake();
+     pthread_mutex_lock(&consumed_lock);
+     pthread_cond_signal(&consumed_cond);
+     pthread_mutex_unlock(&consumed_lock);
+     
+     if (thread_started) {
+         pthread_join(update_thread, NULL);
+         thread_started = 0;
+     }
+     history_free();
+     view_free();
+     rollup_free();
+     watchdog_free();
+     if (recorder != NULL) {
+         recording_finish(recorder);
+         recorder = NULL;
+     }
+     if (replay != NULL) {
+         recording_close(replay);
+         replay = NULL;
+     }
+     process_list_free(&sort_scratch);
+     free(sort_rows);
+     sort_rows = NULL;
+     sort_row_capacity = 0;
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     close_linux_sampler();
+ #endif
+     if (dump_stats) {
+         profile_dump(stderr);
+     }
+ }
+ 
+ /* Update thread function */
+ static void *update_thread_func(void *data) {
+     (void)data;  // Unused parameter
+     
+     last_tick_ns = profile_now();
+     do {
+         update_process_data();
+         publish_callback(publish_data);
+     } while (!atomic_load(&sampler_done) && wait_consumed() && sampler_wait());
+     
+     return NULL;
+ }
+ 
+ /*
+  * While replaying, wait until the consumer has taken the snapshot just
+  * published, so a consumer slower than the replay still sees every frame;
+  * returns 0 once shutting down. Live sampling never waits.
+  */
+ static int wait_consumed(void) {
+     if (replay == NULL) {
+         return 1;
+     }
+     
+     unsigned long published = atomic_load(&current_snapshot)->sequence;
+     pthread_mutex_lock(&consumed_lock);
+     while (atomic_load(&running) && consumed_sequence < published) {
+         pthread_cond_wait(&consumed_cond, &consumed_lock);
+     }
+     pthread_mutex_unlock(&consumed_lock);
+     return atomic_load(&running);
+ }
+ 
+ /* Tell a replaying sampler that the consumer has taken a snapshot, so the next frame can follow */
+ void snapshot_consumed(const Snapshot *snapshot) {
+     pthread_mutex_lock(&consumed_lock);
+     if (snapshot->sequence > consumed_sequence) {
+         consumed_sequence = snapshot->sequence;
+     }
+     pthread_cond_signal(&consumed_cond);
+     pthread_mutex_unlock(&consumed_lock);
+ }
+ 
+ /* Time until the next tick: the update interval, or the recorded gap to the next frame when replaying */
+ static int next_interval_ms(void) {
+     if (replay == NULL) {
+         return atomic_load(&update_interval_ms);
+     }
+     
+     unsigned long long next;
+     if (replay_speed <= 0 || !recording_peek_timestamp(replay, &next) || next <= replay_timestamp_ns) {
+         return 0;
+     }
+     return (int)((next - replay_timestamp_ns) / 1e6 / replay_speed);
+ }
+ 
+ /* Whether the sampler has stopped on its own, after the last frame of a replay */
+ int sampler_finished(void) {
+     return atomic_load(&sampler_done);
+ }
+ 
+ /* Terminate a process; returns 0 if it is gone */
+ int kill_process(int pid, unsigned long long start_time) {
+ #ifdef _WIN32
+     (void)start_time;  // Unused parameter
+     
+     HANDLE handle = OpenProcess(PROCESS_TERMINATE, FALSE, pid);
+     if (handle == NULL) {
+         return 0;
+     }
+     BOOL terminated = TerminateProcess(handle, 0);
+     CloseHandle(handle);
+     return terminated != 0;
+ #else
+     return signal_process(pid, start_time, SIGTERM);
+ #endif
+ }
+ 
+ #ifndef _WIN32
+ /*
+  * Send a signal to a process; returns 0 with errno set if it failed. On
+  * Linux it goes through a pidfd: the pidfd holds whichever process had the
+  * PID when it was opened, and if the process that has it afterwards started
+  * at start_time, that is the same one, so the signal cannot reach a process
+  * that reused the PID. Kernels without pidfds fall back to kill() after the
+  * same check.
+  */
+ int signal_process(int pid, unsigned long long start_time, int sig) {
+ #if defined(__APPLE__)
+     (void)start_time;  // Unused parameter
+     
+     return kill(pid, sig) == 0;
+ #else
+     int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+     if (pidfd < 0 && errno != ENOSYS) {
+         return 0;
+     }
+     if (start_time != 0 && process_start_time(pid) != start_time) {
+         if (pidfd >= 0) {
+             close(pidfd);
+         }
+         errno = ESRCH;
+         return 0;
+     }
+     
+     int result = pidfd >= 0 ? (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0) : kill(pid, sig);
+     int saved_errno = errno;
+     if (pidfd >= 0) {
+         close(pidfd);
+     }
+     errno = saved_errno;
+     return result == 0;
+ #endif
+ }
+ 
+ /* Set a process's nice value after the same start time check; returns 0 with errno set if it failed */
+ int renice_process(int pid, unsigned long long start_time, int nice) {
+ #if !defined(__APPLE__)
+     // There is no pidfd form of setpriority(), so only the check is race-free
+     if (start_time != 0 && process_start_time(pid) != start_time) {
+         errno = ESRCH;
+         return 0;
+     }
+ #else
+     (void)start_time;  // Unused parameter
+ #endif
+     return setpriority(PRIO_PROCESS, (id_t)pid, nice) == 0;
+ }
+ #endif
+ 
+ #ifdef _WIN32
+ /* Get Windows processes */
+ static void get_win_processes(ProcessList *list) {
+     HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+     if (snapshot == INVALID_HANDLE_VALUE) {
+         return;
+     }
+     
+     PROCESSENTRY32 process;
+     process.dwSize = sizeof(PROCESSENTRY32);
+     
+     if (!Process32First(snapshot, &process)) {
+         CloseHandle(snapshot);
+         return;
+     }
+     
+     do {
+         HANDLE handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, process.th32ProcessID);
+         if (handle) {
+             PROCESS_MEMORY_COUNTERS pmc;
+             if (GetProcessMemoryInfo(handle, &pmc, sizeof(pmc))) {
+                 // Get system memory info for percentage calculation
+                 MEMORYSTATUSEX memInfo;
+                 memInfo.dwLength = sizeof(MEMORYSTATUSEX);
+                 GlobalMemoryStatusEx(&memInfo);
+                 
+                 // Calculate memory usage percentage
+                 double memUsage = (double)pmc.WorkingSetSize / (double)memInfo.ullTotalPhys * 100.0;
+                 
+                 // TODO: Calculate CPU usage (requires multiple sampling)
+                 double cpuUsage = 0.0;  // Placeholder
+                 
+                 add_process(list, process.th32ProcessID, process.szExeFile, cpuUsage, memUsage);
+                 list->ppid[list->count - 1] = (int)process.th32ParentProcessID;
+             }
+             CloseHandle(handle);
+         }
+     } while (Process32Next(snapshot, &process));
+     
+     CloseHandle(snapshot);
+ }
+ #elif defined(__APPLE__)
+ /* Get macOS processes */
+ static void get_mac_processes(ProcessList *list) {
+     // Get all BSD processes
+     int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0 };
+     size_t size;
+     
+     if (sysctl(mib, 4, NULL, &size, NULL, 0) < 0) {
+         return;
+     }
+     
+     struct kinfo_proc *processes = malloc(size);
+     if (processes == NULL) {
+         return;
+     }
+     
+     if (sysctl(mib, 4, processes, &size, NULL, 0) < 0) {
+         free(processes);
+         return;
+     }
+     
+     // Calculate number of processes
+     int count = size / sizeof(struct kinfo_proc);
+     
+     // Get host port for memory info
+     host_t host = mach_host_self();
+     vm_size_t page_size;
+     mach_msg_type_number_t count_info;
+     vm_statistics_data_t vm_stats;
+     mach_port_t host_port;
+     
+     host_port = mach_host_self();
+     count_info = HOST_VM_INFO_COUNT;
+     
+     if (host_page_size(host, &page_size) != KERN_SUCCESS) {
+         page_size = 4096;  // Default page size if we can't get it
+     }
+     
+     if (host_statistics(host_port, HOST_VM_INFO, (host_info_t)&vm_stats, &count_info) != KERN_SUCCESS) {
+         free(processes);
+         return;
+     }
+     
+     // Total physical memory (approximate)
+     int64_t total_mem = (int64_t)page_size * 
+                       (vm_stats.free_count + vm_stats.active_count + 
+                        vm_stats.inactive_count + vm_stats.wire_count);
+     
+     for (int i = 0; i < count; i++) {
+         pid_t pid = processes[i].kp_proc.p_pid;
+         
+         if (pid == 0) continue;  // Skip kernel_task
+         
+         // Get process info
+         task_t task;
+         if (task_for_pid(mach_task_self(), pid, &task) == KERN_SUCCESS) {
+             struct task_basic_info task_info;
+             mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+             
+             if (task_info(task, TASK_BASIC_INFO, (task_info_t)&task_info, &count) == KERN_SUCCESS) {
+                 // Calculate memory usage
+                 double mem_usage = (double)task_info.resident_size / (double)total_mem * 100.0;
+                 
+                 // Get process name
+                 char name[256];
+                 proc_name(pid, name, sizeof(name));
+                 
+                 // TODO: Calculate CPU usage (requires multiple sampling)
+                 double cpu_usage = 0.0;  // Placeholder
+                 
+                 add_process(list, pid, name, cpu_usage, mem_usage);
+                 list->ppid[list->count - 1] = processes[i].kp_eproc.e_ppid;
+             }
+             
+             mach_port_deallocate(mach_task_self(), task);
+         }
+     }
+     
+     free(processes);
+ }
+ #else
+ /* Open a file below /proc relative to the cached /proc descriptor */
+ static int open_proc_file(const char *path) {
+     return openat(dirfd(proc_dir), path, O_RDONLY | O_CLOEXEC);
+ }
+ 
+ /* Read a /proc file from the start with a single pread(); returns its length or -1 */
+ static ssize_t read_proc_fd(int fd, char *buf, size_t size) {
+     ssize_t len = pread(fd, buf, size - 1, 0);
+     if (len < 0) {
+         return -1;
+     }
+     
+     buf[len] = '\0';
+     return len;
+ }
+ 
+ /* Read a file below /proc with one open and one read; returns its length or -1 */
+ static ssize_t read_proc_file(const char *path, char *buf, size_t size) {
+     int fd = open_proc_file(path);
+     if (fd < 0) {
+         return -1;
+     }
+     
+     ssize_t len = read_proc_fd(fd, buf, size);
+     close(fd);
+     return len;
+ }
+ 
+ /* Parse an unsigned decimal and step over the separator after it; NULL if there are no digits */
+ static const char *scan_ull(const char *p, unsigned long long *value) {
+     unsigned long long v = 0;
+     
+     if (p == NULL || *p < '0' || *p > '9') {
+         return NULL;
+     }
+     while (*p >= '0' && *p <= '9') {
+         v = v * 10 + (unsigned long long)(*p - '0');
+         p++;
+     }
+     
+     *value = v;
+     return *p != '\0' ? p + 1 : p;
+ }
+ 
+ /* Skip n space-separated fields */
+ static const char *skip_fields(const char *p, int n) {
+     if (p == NULL) {
+         return NULL;
+     }
+     while (n-- > 0) {
+         while (*p != ' ' && *p != '\0') {
+             p++;
+         }
+         if (*p == '\0') {
+             return NULL;
+         }
+         p++;
+     }
+     return p;
+ }
+ 
+ /*
+  * Parse /proc/<pid>/stat. comm is wrapped in parentheses but may itself contain
+  * spaces and parentheses, so it ends at the last ')' in the buffer.
+  */
+ static int parse_proc_stat(const char *buf, size_t len, ProcStat *stat) {
+     const char *lparen = memchr(buf, '(', len);
+     const char *rparen = buf + len;
+     
+     while (rparen > buf && *rparen != ')') {
+         rparen--;
+     }
+     if (lparen == NULL || rparen <= lparen || rparen + 2 > buf + len) {
+         return 0;
+     }
+     
+     size_t name_len = (size_t)(rparen - lparen - 1);
+     if (name_len >= sizeof(stat->name)) {
+         name_len = sizeof(stat->name) - 1;
+     }
+     memcpy(stat->name, lparen + 1, name_len);
+     stat->name[name_len] = '\0';
+     
+     const char *p = rparen + 2;    // Field 3 (state)
+     stat->state = *p;
+     unsigned long long ppid = 0;
+     p = scan_ull(skip_fields(p, 1), &ppid);
+     stat->ppid = (int)ppid;
+     p = skip_fields(p, 7);         // pgrp .. cminflt
+     p = scan_ull(p, &stat->majflt);
+     p = skip_fields(p, 1);         // cmajflt
+     p = scan_ull(p, &stat->utime);
+     p = scan_ull(p, &stat->stime);
+     p = skip_fields(p, 4);         // cutime .. nice
+     p = scan_ull(p, &stat->num_threads);
+     p = skip_fields(p, 1);         // itrealvalue
+     p = scan_ull(p, &stat->starttime);
+     
+     return p != NULL;
+ }
+ 
+ /* Start time of the process that has a PID now, read from the real /proc whatever --proc-root says; 0 if none */
+ static unsigned long long process_start_time(int pid) {
+     char path[32];
+     char buf[1024];
+     ProcStat stat;
+     
+     snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+     int fd = open(path, O_RDONLY | O_CLOEXEC);
+     if (fd < 0) {
+         return 0;
+     }
+     ssize_t len = read_proc_fd(fd, buf, sizeof(buf));
+     close(fd);
+     return len > 0 && parse_proc_stat(buf, (size_t)len, &stat) ? stat.starttime : 0;
+ }
+ 
+ /* Hash a pid to a slot index; capacity must be a power of two */
+ static unsigned int state_hash(int pid, unsigned int capacity) {
+     unsigned long long h = (unsigned long long)(unsigned int)pid * 0x9E3779B97F4A7C15ULL;
+     return (unsigned int)(h >> 32) & (capacity - 1);
+ }
+ 
+ /* Initialize the per-process state table */
+ static void state_table_init(ProcessStateTable *table) {
+     table->capacity = 1024;
+     table->prev_capacity = 1024;
+     table->slots = (ProcessState*)calloc(table->capacity, sizeof(ProcessState));
+     table->prev_slots = (ProcessState*)calloc(table->prev_capacity, sizeof(ProcessState));
+     table->count = 0;
+     atomic_init(&table->cached_fds, 0);
+     table->prev_total_jiffies = 0;
+     table->total_delta = 0;
+     table->num_cpus = 1;
+ }
+ 
+ /* Close the cached descriptors of every occupied slot */
+ static void state_table_close_all(ProcessStateTable *table, ProcessState *slots, unsigned int capacity) {
+     for (unsigned int i = 0; i < capacity; i++) {
+         if (slots[i].pid != 0) {
+             state_table_close_fds(table, &slots[i]);
+         }
+     }
+ }
+ 
+ /* Free the per-process state table */
+ static void state_table_free(ProcessStateTable *table) {
+     state_table_close_all(table, table->slots, table->capacity);
+     state_table_close_all(table, table->prev_slots, table->prev_capacity);
+     free(table->slots);
+     free(table->prev_slots);
+     table->slots = NULL;
+     table->prev_slots = NULL;
+     table->capacity = 0;
+     table->prev_capacity = 0;
+     table->count = 0;
+ }
+ 
+ /* Double the current slot array; only happens when the process count grows */
+ static void state_table_grow(ProcessStateTable *table) {
+     unsigned int capacity = table->capacity * 2;
+     ProcessState *slots = (ProcessState*)calloc(capacity, sizeof(ProcessState));
+     
+     for (unsigned int i = 0; i < table->capacity; i++) {
+         if (table->slots[i].pid == 0) {
+             continue;
+         }
+         unsigned int j = state_hash(table->slots[i].pid, capacity);
+         while (slots[j].pid != 0) {
+             j = (j + 1) & (capacity - 1);
+         }
+         slots[j] = table->slots[i];
+     }
+     
+     free(table->slots);
+     table->slots = slots;
+     table->capacity = capacity;
+ }
+ 
+ /* Busy share of a CPU's jiffies since the previous tick, recording them for the next; -1 on the first tick */
+ static float cpu_times_usage(CpuTimes *times, unsigned long long busy, unsigned long long total) {
+     float usage = -1;
+     if (times->total != 0 && total > times->total) {
+         unsigned long long busy_delta = busy > times->busy ? busy - times->busy : 0;
+         usage = (float)((double)busy_delta * 100.0 / (double)(total - times->total));
+     }
+     times->busy = busy;
+     times->total = total;
+     return usage;
+ }
+ 
+ /*
+  * Read /proc/stat once per tick: the total jiffies the process table measures
+  * CPU usage against, and the busy share of each CPU for the host panel.
+  */
+ static void state_table_begin_tick(ProcessStateTable *table, SystemInfo *system) {
+     static char buf[65536];  // Large enough for the cpu lines of 1000+ CPUs
+     unsigned long long total = 0;
+     int num_cpus = 0;
+     
+     ssize_t len = read_proc_file("stat", buf, sizeof(buf));
+     if (len <= 0) {
+         table->total_delta = 0;
+         return;
+     }
+     
+     // The cpu lines come first: the aggregate "cpu" line, then one "cpuN" line per online CPU
+     const char *line = buf;
+     while (strncmp(line, "cpu", 3) == 0) {
+         const char *p = line + 3;
+         unsigned long long id = 0;
+         if (*p != ' ') {
+             p = scan_ull(p, &id);  // Steps over the space after the number
+         }
+         while (p != NULL && *p == ' ') {
+             p++;
+         }
+         
+         // user nice system idle iowait irq softirq steal; guest is already part of user
+         unsigned long long line_total = 0, idle = 0, value;
+         for (int i = 0; i < 8 && p != NULL; i++) {
+             p = scan_ull(p, &value);
+             if (p != NULL) {
+                 line_total += value;
+                 idle += i == 3 || i == 4 ? value : 0;
+             }
+         }
+         
+         if (line[3] == ' ') {
+             total = line_total;
+             system->total_cpu_usage = cpu_times_usage(&host_times, line_total - idle, line_total);
+         } else if (id < 65536) {
+             num_cpus++;
+             // CPU numbers have gaps where CPUs are offline
+             if ((int)id >= cpu_times_capacity) {
+                 int capacity = cpu_times_capacity > 0 ? cpu_times_capacity : 64;
+                 while ((int)id >= capacity) {
+                     capacity *= 2;
+                 }
+                 cpu_times = (CpuTimes*)realloc(cpu_times, capacity * sizeof(CpuTimes));
+                 memset(cpu_times + cpu_times_capacity, 0, (capacity - cpu_times_capacity) * sizeof(CpuTimes));
+                 cpu_times_capacity = capacity;
+             }
+             if ((int)id >= system->cpu_capacity) {
+                 system->cpu_capacity = cpu_times_capacity;
+                 system->cpu_usage = (float*)realloc(system->cpu_usage, system->cpu_capacity * sizeof(float));
+             }
+             for (; system->num_cpus <= (int)id; system->num_cpus++) {
+                 system->cpu_usage[system->num_cpus] = -1;
+             }
+             system->cpu_usage[id] = cpu_times_usage(&cpu_times[id], line_total - idle, line_total);
+         }
+         
+         line = strchr(line, '\n');
+         if (line == NULL) {
+             break;
+         }
+         line++;
+     }
+     
+     if (num_cpus > 0) {
+         table->num_cpus = num_cpus;
+     }
+     
+     // The first tick has nothing to compare against
+     if (table->prev_total_jiffies != 0 && total > table->prev_total_jiffies) {
+         table->total_delta = total - table->prev_total_jiffies;
+     } else {
+         table->total_delta = 0;
+     }
+     table->prev_total_jiffies = total;
+ }
+ 
+ /* Find the previous tick's state for a PID, which may belong to an earlier process */
+ static ProcessState *state_table_lookup(ProcessStateTable *table, int pid) {
+     unsigned int mask = table->prev_capacity - 1;
+     
+     for (unsigned int i = state_hash(pid, table->prev_capacity);
+          table->prev_slots[i].pid != 0;
+          i = (i + 1) & mask) {
+         if (table->prev_slots[i].pid == pid) {
+             return &table->prev_slots[i];
+         }
+     }
+     return NULL;
+ }
+ 
+ /* Carry a process's state into the current tick, keeping the load factor under 1/2 */
+ static void state_table_insert(ProcessStateTable *table, const ProcessState *state) {
+     if ((table->count + 1) * 2 > table->capacity) {
+         state_table_grow(table);
+     }
+     
+     unsigned int mask = table->capacity - 1;
+     unsigned int i = state_hash(state->pid, table->capacity);
+     while (table->slots[i].pid != 0) {
+         i = (i + 1) & mask;
+     }
+     
+     table->slots[i] = *state;
+     table->count++;
+ }
+ 
+ /*
+  * Record this tick's CPU time in a process's new state and return its CPU usage
+  * since it was last sampled, where 100% is one fully busy core. prev is the
+  * previous state for the same PID, if any; it only counts when the start time
+  * matches too. Only reads the table, so scan workers may call it concurrently.
+  */
+ static double state_table_account(const ProcessStateTable *table, const ProcessState *prev,
+                                   ProcessState *state, unsigned long long cpu_ticks) {
+     unsigned long long prev_ticks = 0;
+     unsigned long long total_delta = table->total_delta;
+     
+     state->idle_ticks = 0;
+     state->cgroup = CGROUP_UNREAD;
+     if (prev != NULL && prev->starttime == state->starttime) {
+         prev_ticks = prev->cpu_ticks;
+         state->idle_ticks = prev->idle_ticks;
+         state->cgroup = prev->cgroup;
+         // A tiered process may last have been sampled several ticks ago
+         total_delta = table->prev_total_jiffies > prev->sampled_jiffies ?
+                       table->prev_total_jiffies - prev->sampled_jiffies : 0;
+     }
+     state->cpu_ticks = cpu_ticks;
+     state->sampled_jiffies = table->prev_total_jiffies;
+     state->cpu_usage = 0;
+     
+     if (cpu_ticks <= prev_ticks) {
+         state->idle_ticks++;
+         return 0.0;
+     }
+     state->idle_ticks = 0;
+     
+     if (total_delta == 0 || table->total_delta == 0) {
+         return 0.0;
+     }
+     
+     // A process not seen last tick started since then, so all of its ticks count
+     double usage = (double)(cpu_ticks - prev_ticks) * 100.0 * table->num_cpus / (double)total_delta;
+     double max_usage = 100.0 * table->num_cpus;
+     state->cpu_usage = (float)(usage < max_usage ? usage : max_usage);
+     return state->cpu_usage;
+ }
+ 
+ /* Per-second rate of a counter over an interval */
+ static float counter_rate(unsigned long long now, unsigned long long before, double seconds) {
+     return now > before ? (float)((double)(now - before) / seconds) : 0.0f;
+ }
+ 
+ /*
+  * Fill a row's rate columns from the counters read into a process's new state,
+  * over the same interval as its CPU usage: since prev was sampled, or across
+  * the last tick for a process that started since then. Columns whose counters
+  * were not read both times are left at -1.
+  */
+ static void state_table_rates(const ProcessStateTable *table, const ProcessState *prev,
+                               const ProcessState *state, ProcessList *list, int row) {
+     static const ProcessState started = { 0 };  // A new process's counters were all zero
+     const ProcessState *before = &started;
+     unsigned int known = state->counters & list->columns;
+     unsigned long long jiffies = table->total_delta;
+     
+     if (prev != NULL && prev->starttime == state->starttime) {
+         before = prev;
+         known &= prev->counters;
+         jiffies = table->prev_total_jiffies > prev->sampled_jiffies ?
+                   table->prev_total_jiffies - prev->sampled_jiffies : 0;
+     }
+     if (known == 0 || jiffies == 0 || table->total_delta == 0) {
+         return;
+     }
+     
+     double seconds = (double)jiffies / table->num_cpus / (double)clock_ticks;
+     if (known & RATE_IO) {
+         list->read_rate[row] = counter_rate(state->read_bytes, before->read_bytes, seconds);
+         list->write_rate[row] = counter_rate(state->write_bytes, before->write_bytes, seconds);
+     }
+     if (known & RATE_CTXSW) {
+         list->voluntary_switch_rate[row] = counter_rate(state->voluntary_switches, before->voluntary_switches,
+                                                         seconds);
+         list->involuntary_switch_rate[row] = counter_rate(state->involuntary_switches, before->involuntary_switches,
+                                                           seconds);
+     }
+     if (known & RATE_FAULTS) {
+         list->major_fault_rate[row] = counter_rate(state->major_faults, before->major_faults, seconds);
+     }
+ }
+ 
+ /* Claim cache slots for count descriptors; returns 0, claiming none, if the cache has no room */
+ static int state_table_claim_fds(ProcessStateTable *table, int count) {
+     int cached = atomic_load(&table->cached_fds);
+     // Scan threads race for the last slots, so the check and the claim are one step
+     while (cached + count <= fd_cache_limit) {
+         if (atomic_compare_exchange_weak(&table->cached_fds, &cached, cached + count)) {
+             return 1;
+         }
+     }
+     return 0;
+ }
+ 
+ /* Close a state's cached descriptors, if it has any */
+ static void state_table_close_fds(ProcessStateTable *table, ProcessState *state) {
+     if (state->stat_fd >= 0) {
+         close(state->stat_fd);
+         atomic_fetch_sub(&table->cached_fds, 1);
+     }
+     if (state->statm_fd >= 0) {
+         close(state->statm_fd);
+         atomic_fetch_sub(&table->cached_fds, 1);
+     }
+     state->stat_fd = -1;
+     state->statm_fd = -1;
+ }
+ 
+ /*
+  * Swap in this tick's states. States of processes that were not seen again
+  * are dropped here, closing any descriptors they still hold.
+  */
+ static void state_table_end_tick(ProcessStateTable *table) {
+     ProcessState *slots = table->prev_slots;
+     unsigned int capacity = table->prev_capacity;
+     
+     state_table_close_all(table, slots, capacity);
+     
+     table->prev_slots = table->slots;
+     table->prev_capacity = table->capacity;
+     
+     // Keep both arrays the same size so the next tick does not have to grow again
+     if (capacity < table->prev_capacity) {
+         free(slots);
+         capacity = table->prev_capacity;
+         slots = (ProcessState*)calloc(capacity, sizeof(ProcessState));
+     } else {
+         memset(slots, 0, capacity * sizeof(ProcessState));
+     }
+     
+     table->slots = slots;
+     table->capacity = capacity;
+     table->count = 0;
+ }
+ 
+ /* Raise the descriptor limit as far as allowed and return how many the fd cache may use */
+ static int fd_cache_max_limit(void) {
+     struct rlimit limit;
+     
+     if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+         return 0;
+     }
+     if (limit.rlim_cur < limit.rlim_max) {
+         limit.rlim_cur = limit.rlim_max;
+         if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+             getrlimit(RLIMIT_NOFILE, &limit);
+         }
+     }
+     
+     // Leave headroom for GTK, X11 and everything else the process opens
+     if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > (1 << 20)) {
+         return 1 << 20;
+     }
+     return limit.rlim_cur > 256 ? (int)(limit.rlim_cur - 256) : 0;
+ }
+ 
+ /* Write "<pid>/stat" into path and return the length of the pid prefix */
+ static size_t format_stat_path(char *path, int pid) {
+     char digits[12];
+     size_t len = 0;
+     
+     do {
+         digits[len++] = (char)('0' + pid % 10);
+         pid /= 10;
+     } while (pid > 0);
+     
+     for (size_t i = 0; i < len; i++) {
+         path[i] = digits[len - 1 - i];
+     }
+     memcpy(path + len, "/stat", 6);
+     return len;
+ }
+ 
+ /* Read one process into a scan shard; runs on the scan workers */
+ static void scan_process(ScanShard *shard, int pid) {
+     char path[32];
+     char buf[1024];
+     
+     // "<pid>/statm" is the stat path plus one character
+     size_t len = format_stat_path(path, pid);
+     
+     ProcessState *prev = state_table_lookup(&process_states, pid);
+     int stat_fd = -1;
+     int statm_fd = -1;
+     ssize_t stat_len = -1;
+     unsigned long long mark = profile_now();
+     
+     // A cold process off its turn keeps its state and repeats its last row
+     if (prev != NULL && cold_every > 1 && scan_pool.previous_rows != NULL &&
+         prev->cpu_usage < scan_pool.hot_threshold &&
+         ((unsigned long)pid + scan_pool.tick) % (unsigned long)cold_every != 0) {
+         const ProcessList *previous = scan_pool.previous_rows;
+         int row = find_row(previous, pid);
+         if (row >= 0) {
+             ProcessState state = *prev;
+             prev->stat_fd = -1;
+             prev->statm_fd = -1;
+             shard_add(shard, &state, previous->name[row], previous->cpu_usage[row], previous->memory_usage[row]);
+             ProcessList *list = &shard->list;
+             int added = list->count - 1;
+             list->state[added] = previous->state[row];
+             list->num_threads[added] = previous->num_threads[row];
+             list->uid[added] = previous->uid[row];
+             list->ppid[added] = previous->ppid[row];
+             list->sampled[added] = 0;
+             for (size_t c = 0; c < sizeof(process_columns) / sizeof(process_columns[0]); c++) {
+                 const ProcessColumn *column = &process_columns[c];
+                 char *values = column_values(list, column);
+                 const char *source = column_values(previous, column);
+                 if (column->group != 0 && values != NULL && source != NULL) {
+                     memcpy(values + added * column->size, source + row * column->size, column->size);
+                 }
+             }
+             return;
+         }
+     }
+     
+     // Refresh cached descriptors in place; once the process is gone they fail with ESRCH
+     if (prev != NULL && prev->stat_fd >= 0) {
+         stat_len = read_proc_fd(prev->stat_fd, buf, sizeof(buf));
+         profile_lap(&mark, &shard->read_ns);
+         if (stat_len > 0) {
+             stat_fd = prev->stat_fd;
+             statm_fd = prev->statm_fd;
+             prev->stat_fd = -1;
+             prev->statm_fd = -1;
+         } else {
+             state_table_close_fds(&process_states, prev);
+             profile_lap(&mark, &shard->open_ns);
+         }
+     }
+     
+     // Otherwise open the file, and keep it open while the cache has room for it and statm
+     int spare_slot = 0;  // Claimed with the stat slot for statm, given back if statm isn't kept
+     if (stat_fd < 0) {
+         stat_fd = open_proc_file(path);
+         profile_lap(&mark, &shard->open_ns);
+         if (stat_fd < 0) {
+             return;  // The process exited while we were scanning
+         }
+         stat_len = read_proc_fd(stat_fd, buf, sizeof(buf));
+         profile_lap(&mark, &shard->read_ns);
+         if (state_table_claim_fds(&process_states, 2)) {
+             spare_slot = 1;
+         } else {
+             close(stat_fd);
+             stat_fd = -1;
+             profile_lap(&mark, &shard->open_ns);
+         }
+     }
+     
+     // The name, CPU times and start time all come from /proc/[pid]/stat
+     ProcStat stat;
+     ProcessState state;
+     state.pid = pid;
+     state.stat_fd = stat_fd;
+     state.statm_fd = statm_fd;
+     if (stat_len <= 0 || !parse_proc_stat(buf, (size_t)stat_len, &stat)) {
+         if (spare_slot) {
+             atomic_fetch_sub(&process_states.cached_fds, 1);
+         }
+         state_table_close_fds(&process_states, &state);
+         return;
+     }
+     state.starttime = stat.starttime;
+     double cpu_usage = state_table_account(&process_states, prev, &state, stat.utime + stat.stime);
+     // Names only change on exec or a comm write, so the interned copy is nearly always reused
+     state.name = prev != NULL && prev->name != NULL && strcmp(prev->name, stat.name) == 0 ?
+                  prev->name : names_intern(stat.name);
+     profile_lap(&mark, &shard->parse_ns);
+     
+     // /proc/<pid>/stat is owned by the process's effective user
+     struct stat owner;
+     int uid = -1;
+     if (view_needs_uid() && fstatat(dirfd(proc_dir), path, &owner, 0) == 0) {
+         uid = (int)owner.st_uid;
+     }
+     profile_lap(&mark, &shard->read_ns);
+     
+     // Get memory usage
+     unsigned long long size, rss = 0;
+     ssize_t statm_len = -1;
+     if (state.statm_fd < 0) {
+         path[len + 5] = 'm';
+         path[len + 6] = '\0';
+         int fd = open_proc_file(path);
+         if (fd >= 0 && state.stat_fd >= 0 && (spare_slot || state_table_claim_fds(&process_states, 1))) {
+             state.statm_fd = fd;
+             spare_slot = 0;
+         }
+         profile_lap(&mark, &shard->open_ns);
+         if (fd >= 0) {
+             statm_len = read_proc_fd(fd, buf, sizeof(buf));
+             profile_lap(&mark, &shard->read_ns);
+         }
+         if (fd >= 0 && state.statm_fd != fd) {
+             close(fd);
+             profile_lap(&mark, &shard->open_ns);
+         }
+     } else {
+         statm_len = read_proc_fd(state.statm_fd, buf, sizeof(buf));
+         profile_lap(&mark, &shard->read_ns);
+     }
+     if (spare_slot) {
+         atomic_fetch_sub(&process_states.cached_fds, 1);  // statm could not be opened
+     }
+     if (statm_len > 0 && scan_ull(scan_ull(buf, &size), &rss) != NULL) {
+         rss *= (unsigned long long)page_size;  // Convert to bytes
+     }
+     profile_lap(&mark, &shard->parse_ns);
+     
+     read_rate_counters(shard, path, len, &state, &stat, &mark);
+     
+     // Give cache slots held by idle processes back to busier ones when the cache is full
+     if (state.stat_fd >= 0 && state.idle_ticks >= FD_CACHE_IDLE_TICKS &&
+         atomic_load(&process_states.cached_fds) + 2 > fd_cache_limit) {
+         state_table_close_fds(&process_states, &state);
+     }
+     
+     // Calculate memory usage percentage
+     double mem_usage = 0.0;
+     if (scan_pool.total_mem > 0) {
+         mem_usage = (double)rss / (double)scan_pool.total_mem * 100.0;
+     }
+     
+     shard_add(shard, &state, state.name, cpu_usage, mem_usage);
+     int row = shard->list.count - 1;
+     shard->list.state[row] = stat.state;
+     shard->list.num_threads[row] = (int)stat.num_threads;
+     shard->list.uid[row] = uid;
+     shard->list.ppid[row] = stat.ppid;
+     state_table_rates(&process_states, prev, &state, &shard->list, row);
+ }
+ 
+ /* Value of a "key: value" line of a /proc status-style file; returns 0 if it is missing */
+ static int find_proc_field(const char *buf, const char *key, unsigned long long *value) {
+     const char *p = strstr(buf, key);
+     if (p == NULL) {
+         return 0;
+     }
+     p += strlen(key);
+     while (*p == ' ' || *p == '\t') {
+         p++;
+     }
+     return scan_ull(p, value) != NULL;
+ }
+ 
+ /*
+  * Read the counters behind the enabled rate columns into a process's new state.
+  * path holds "<pid>/stat" or "<pid>/statm" and is reused for the other files;
+  * a file that cannot be read, such as another user's io, leaves its bit clear.
+  */
+ static void read_rate_counters(ScanShard *shard, char *path, size_t len, ProcessState *state,
+                                const ProcStat *stat, unsigned long long *mark) {
+     char buf[4096];  // status runs past a kilobyte
+     unsigned long long first, second;
+     
+     state->counters = 0;
+     if (rate_columns & RATE_FAULTS) {
+         state->major_faults = stat->majflt;
+         state->counters |= RATE_FAULTS;
+     }
+     if (rate_columns & RATE_IO) {
+         memcpy(path + len, "/io", 4);
+         ssize_t io_len = read_proc_file(path, buf, sizeof(buf));
+         profile_lap(mark, &shard->read_ns);
+         if (io_len > 0 && find_proc_field(buf, "\nread_bytes:", &first) &&
+             find_proc_field(buf, "\nwrite_bytes:", &second)) {
+             state->read_bytes = first;
+             state->write_bytes = second;
+             state->counters |= RATE_IO;
+         }
+         profile_lap(mark, &shard->parse_ns);
+     }
+     if (rate_columns & RATE_CTXSW) {
+         memcpy(path + len, "/status", 8);
+         ssize_t status_len = read_proc_file(path, buf, sizeof(buf));
+         profile_lap(mark, &shard->read_ns);
+         if (status_len > 0 && find_proc_field(buf, "\nvoluntary_ctxt_switches:", &first) &&
+             find_proc_field(buf, "\nnonvoluntary_ctxt_switches:", &second)) {
+             state->voluntary_switches = first;
+             state->involuntary_switches = second;
+             state->counters |= RATE_CTXSW;
+         }
+         profile_lap(mark, &shard->parse_ns);
+     }
+ }
+ 
+ /* Add a row and its sampling state to a scan shard, keeping states[i] paired with row i; name is interned */
+ static void shard_add(ScanShard *shard, const ProcessState *state, const char *name, double cpu, double mem) {
+     if (shard->list.count >= shard->state_capacity) {
+         shard->state_capacity = shard->state_capacity > 0 ? shard->state_capacity * 2 : 256;
+         shard->states = (ProcessState*)realloc(shard->states, shard->state_capacity * sizeof(ProcessState));
+     }
+     shard->states[shard->list.count] = *state;
+     append_row(&shard->list, state->pid, name, cpu, mem);
+     shard->list.start_time[shard->list.count - 1] = state->starttime;
+ }
+ 
+ /* Row of a PID in a PID-ordered list, or -1 */
+ static int find_row(const ProcessList *list, int pid) {
+     int low = 0;
+     int high = list->count - 1;
+     while (low <= high) {
+         int mid = low + (high - low) / 2;
+         if (list->pid[mid] == pid) {
+             return mid;
+         }
+         if (list->pid[mid] < pid) {
+             low = mid + 1;
+         } else {
+             high = mid - 1;
+         }
+     }
+     return -1;
+ }
+ 
+ /* The k-th largest of n values (k counts from 1) by quickselect; reorders the values */
+ static double kth_largest(double *values, int n, int k) {
+     int low = 0;
+     int high = n - 1;
+     int target = k - 1;
+     
+     while (low < high) {
+         double pivot = values[low + (high - low) / 2];
+         int i = low;
+         int j = high;
+         while (i <= j) {
+             while (values[i] > pivot) {
+                 i++;
+             }
+             while (values[j] < pivot) {
+                 j--;
+             }
+             if (i <= j) {
+                 double swap = values[i];
+                 values[i] = values[j];
+                 values[j] = swap;
+                 i++;
+                 j--;
+             }
+         }
+         if (target <= j) {
+             high = j;
+         } else if (target >= i) {
+             low = i;
+         } else {
+             break;
+         }
+     }
+     return values[target];
+ }
+ 
+ /* Scratch array of at least `count` values for kth_largest() */
+ static double *usage_values(int count) {
+     if (count > scan_pool.usage_capacity) {
+         scan_pool.usage_capacity = count * 2;
+         scan_pool.usage_scratch = (double*)realloc(scan_pool.usage_scratch, scan_pool.usage_capacity * sizeof(double));
+     }
+     return scan_pool.usage_scratch;
+ }
+ 
+ /*
+  * Pick the CPU usage a process needs to be read every tick: that of the
+  * hot_processes-th busiest, but never zero, so idle processes are always cold.
+  */
+ static void update_hot_threshold(const ProcessList *list) {
+     if (hot_processes <= 0) {
+         scan_pool.hot_threshold = 1e300;
+         return;
+     }
+     if (list->count <= hot_processes) {
+         scan_pool.hot_threshold = -1;
+         return;
+     }
+     double *values = usage_values(list->count);
+     for (int i = 0; i < list->count; i++) {
+         values[i] = list->cpu_usage[i];
+     }
+     double threshold = kth_largest(values, list->count, hot_processes);
+     scan_pool.hot_threshold = threshold > 0 ? threshold : 1e-9;
+ }
+ 
+ /*
+  * Take a chunk index from a packed (begin << 32 | end) range: from the front
+  * when it is the worker's own range, from the back when stealing. Both ends
+  * share one word, so the owner and a thief can never take the same chunk.
+  */
+ static int scan_range_take(atomic_ullong *range, int steal) {
+     unsigned long long r = atomic_load(range);
+     
+     for (;;) {
+         unsigned int begin = (unsigned int)(r >> 32);
+         unsigned int end = (unsigned int)r;
+         if (begin >= end) {
+             return -1;
+         }
+         
+         unsigned long long next = steal
+             ? ((unsigned long long)begin << 32) | (end - 1)
+             : ((unsigned long long)(begin + 1) << 32) | end;
+         if (atomic_compare_exchange_weak(range, &r, next)) {
+             return steal ? (int)end - 1 : (int)begin;
+         }
+     }
+ }
+ 
+ /* Scan chunks from this worker's range, then steal from the others until all are taken */
+ static void scan_worker_run(int id) {
+     ScanShard *shard = &scan_pool.shards[id];
+     process_list_clear(&shard->list);
+     process_list_set_columns(&shard->list, rate_columns);
+     shard->open_ns = 0;
+     shard->read_ns = 0;
+     shard->parse_ns = 0;
+     
+     while (atomic_load(&running)) {
+         int chunk = scan_range_take(&scan_pool.ranges[id], 0);
+         for (int i = 1; chunk < 0 && i < scan_pool.num_workers; i++) {
+             chunk = scan_range_take(&scan_pool.ranges[(id + i) % scan_pool.num_workers], 1);
+         }
+         if (chunk < 0) {
+             break;
+         }
+         
+         int start = shard->list.count;
+         int end = (chunk + 1) * SCAN_CHUNK_SIZE;
+         if (end > scan_pool.num_pids) {
+             end = scan_pool.num_pids;
+         }
+         for (int i = chunk * SCAN_CHUNK_SIZE; i < end; i++) {
+             scan_process(shard, scan_pool.pids[i]);
+         }
+         
+         scan_pool.chunks[chunk].shard = id;
+         scan_pool.chunks[chunk].start = start;
+         scan_pool.chunks[chunk].count = shard->list.count - start;
+     }
+ }
+ 
+ /* Scan worker thread: waits for a new generation, scans, reports back */
+ static void *scan_worker_func(void *data) {
+     int id = (int)(intptr_t)data;
+     unsigned long seen = 0;
+     
+     pthread_mutex_lock(&scan_pool.lock);
+     for (;;) {
+         while (scan_pool.generation == seen && !scan_pool.shutdown) {
+             pthread_cond_wait(&scan_pool.start_cond, &scan_pool.lock);
+         }
+         if (scan_pool.shutdown) {
+             break;
+         }
+         seen = scan_pool.generation;
+         pthread_mutex_unlock(&scan_pool.lock);
+         
+         scan_worker_run(id);
+         
+         pthread_mutex_lock(&scan_pool.lock);
+         if (--scan_pool.pending == 0) {
+             pthread_cond_signal(&scan_pool.done_cond);
+         }
+     }
+     pthread_mutex_unlock(&scan_pool.lock);
+     
+     return NULL;
+ }
+ 
+ /* Start the scan workers; the sampler thread itself acts as worker 0 */
+ static void scan_pool_init(int num_workers) {
+     if (num_workers <= 0) {
+         num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+     }
+     if (num_workers < 1) {
+         num_workers = 1;
+     }
+     
+     scan_pool.num_workers = num_workers;
+     scan_pool.shards = (ScanShard*)calloc(num_workers, sizeof(ScanShard));
+     scan_pool.ranges = (atomic_ullong*)calloc(num_workers, sizeof(atomic_ullong));
+     scan_pool.threads = (pthread_t*)calloc(num_workers, sizeof(pthread_t));  // Shard lists get blocks on first use
+     
+     pthread_mutex_init(&scan_pool.lock, NULL);
+     pthread_cond_init(&scan_pool.start_cond, NULL);
+     pthread_cond_init(&scan_pool.done_cond, NULL);
+     scan_pool.generation = 0;
+     scan_pool.shutdown = 0;
+     
+     for (int i = 1; i < num_workers; i++) {
+         if (pthread_create(&scan_pool.threads[i], NULL, scan_worker_func, (void*)(intptr_t)i) != 0) {
+             scan_pool.num_workers = i;  // Run with the workers we have
+             break;
+         }
+     }
+ }
+ 
+ /* Stop the scan workers and free their shards */
+ static void scan_pool_shutdown(void) {
+     if (scan_pool.shards == NULL) {
+         return;
+     }
+     
+     pthread_mutex_lock(&scan_pool.lock);
+     scan_pool.shutdown = 1;
+     pthread_cond_broadcast(&scan_pool.start_cond);
+     pthread_mutex_unlock(&scan_pool.lock);
+     
+     for (int i = 1; i < scan_pool.num_workers; i++) {
+         pthread_join(scan_pool.threads[i], NULL);
+     }
+     for (int i = 0; i < scan_pool.num_workers; i++) {
+         process_list_free(&scan_pool.shards[i].list);
+         free(scan_pool.shards[i].states);
+     }
+     
+     pthread_mutex_destroy(&scan_pool.lock);
+     pthread_cond_destroy(&scan_pool.start_cond);
+     pthread_cond_destroy(&scan_pool.done_cond);
+     free(scan_pool.shards);
+     free(scan_pool.ranges);
+     free(scan_pool.threads);
+     free(scan_pool.chunks);
+     free(scan_pool.pids);
+     free(scan_pool.usage_scratch);
+     memset(&scan_pool, 0, sizeof(scan_pool));
+ }
+ 
+ /* Append a PID to the list the scan workers will read */
+ static void scan_add_pid(int pid) {
+     if (scan_pool.num_pids >= scan_pool.pid_capacity) {
+         scan_pool.pid_capacity = scan_pool.pid_capacity > 0 ? scan_pool.pid_capacity * 2 : 1024;
+         scan_pool.pids = (int*)realloc(scan_pool.pids, scan_pool.pid_capacity * sizeof(int));
+     }
+     scan_pool.pids[scan_pool.num_pids++] = pid;
+ }
+ 
+ /* Collect the PIDs listed in /proc */
+ static void collect_proc_pids(void) {
+     struct dirent *entry;
+     
+     rewinddir(proc_dir);
+     scan_pool.num_pids = 0;
+     while ((entry = readdir(proc_dir)) != NULL) {
+         // Check if the name is a number (pid)
+         size_t len = 0;
+         int pid = 0;
+         while (entry->d_name[len] >= '0' && entry->d_name[len] <= '9') {
+             pid = pid * 10 + (entry->d_name[len] - '0');
+             len++;
+         }
+         if (len == 0 || entry->d_name[len] != '\0' || len > 10) {
+             continue;
+         }
+         scan_add_pid(pid);
+     }
+ }
+ 
+ /* Read the final stats of an exiting process while it is still a zombie */
+ static void proc_events_record_exit(int pid) {
+     char path[32];
+     char buf[1024];
+     ExitRecord record;
+     
+     size_t len = format_stat_path(path, pid);
+     ssize_t stat_len = read_proc_file(path, buf, sizeof(buf));
+     if (stat_len <= 0 || !parse_proc_stat(buf, (size_t)stat_len, &record.stat)) {
+         return;  // Already reaped
+     }
+     
+     unsigned long long size;
+     record.pid = pid;
+     record.rss = 0;
+     path[len + 5] = 'm';
+     path[len + 6] = '\0';
+     if (read_proc_file(path, buf, sizeof(buf)) > 0 && scan_ull(scan_ull(buf, &size), &record.rss) != NULL) {
+         record.rss *= (unsigned long long)page_size;  // Convert to bytes
+     }
+     
+     pthread_mutex_lock(&proc_events.lock);
+     if (proc_events.exited_count >= proc_events.exited_capacity) {
+         proc_events.exited_capacity = proc_events.exited_capacity > 0 ? proc_events.exited_capacity * 2 : 64;
+         proc_events.exited = (ExitRecord*)realloc(proc_events.exited,
+                                                   proc_events.exited_capacity * sizeof(ExitRecord));
+     }
+     proc_events.exited[proc_events.exited_count++] = record;
+     pthread_mutex_unlock(&proc_events.lock);
+ }
+ 
+ /* Apply one proc connector event to the live PID set */
+ static void proc_events_handle(const struct proc_event *event) {
+     int pid = -1;
+     int alive = 0;
+     
+     switch (event->what) {
+     case PROC_EVENT_FORK:
+         // Thread creation is reported as a fork too; only new thread groups are processes
+         if (event->event_data.fork.child_pid == event->event_data.fork.child_tgid) {
+             pid = event->event_data.fork.child_tgid;
+             alive = 1;
+         }
+         break;
+     case PROC_EVENT_EXEC:
+         pid = event->event_data.exec.process_tgid;
+         alive = 1;
+         if (smaps_top > 0) {
+             pthread_mutex_lock(&proc_events.lock);
+             if (proc_events.exec_count >= proc_events.exec_capacity) {
+                 proc_events.exec_capacity = proc_events.exec_capacity > 0 ? proc_events.exec_capacity * 2 : 64;
+                 proc_events.execs = (int*)realloc(proc_events.execs, proc_events.exec_capacity * sizeof(int));
+             }
+             proc_events.execs[proc_events.exec_count++] = pid;
+             pthread_mutex_unlock(&proc_events.lock);
+         }
+         break;
+     case PROC_EVENT_EXIT:
+         if (event->event_data.exit.process_pid == event->event_data.exit.process_tgid) {
+             pid = event->event_data.exit.process_tgid;
+             proc_events_record_exit(pid);
+         }
+         break;
+     default:
+         break;
+     }
+     
+     if (pid <= 0 || pid >= proc_events.max_pid) {
+         return;
+     }
+     
+     pthread_mutex_lock(&proc_events.lock);
+     if (alive) {
+         proc_events.live[pid / BITS_PER_WORD] |= 1UL << (pid % BITS_PER_WORD);
+     } else {
+         proc_events.live[pid / BITS_PER_WORD] &= ~(1UL << (pid % BITS_PER_WORD));
+     }
+     pthread_mutex_unlock(&proc_events.lock);
+ }
+ 
+ /* Proc connector listener thread */
+ static void *proc_events_thread_func(void *data) {
+     (void)data;  // Unused parameter
+     
+     // Aligned for the netlink headers that are read out of it
+     union {
+         struct nlmsghdr header;
+         char bytes[16384];
+     } buf;
+     struct pollfd fds[2] = {
+         { .fd = proc_events.sock, .events = POLLIN },
+         { .fd = proc_events.stop_pipe[0], .events = POLLIN },
+     };
+     
+     for (;;) {
+         if (poll(fds, 2, -1) < 0) {
+             if (errno == EINTR) {
+                 continue;
+             }
+             break;
+         }
+         if (fds[1].revents != 0) {
+             break;  // Shutting down
+         }
+         
+         ssize_t len = recv(proc_events.sock, &buf, sizeof(buf), 0);
+         if (len < 0) {
+             if (errno == ENOBUFS) {
+                 // The socket overflowed and events were lost; rebuild from /proc
+                 pthread_mutex_lock(&proc_events.lock);
+                 proc_events.resync = 1;
+                 pthread_mutex_unlock(&proc_events.lock);
+             } else if (errno != EINTR && errno != EAGAIN) {
+                 break;
+             }
+             continue;
+         }
+         
+         for (struct nlmsghdr *header = &buf.header; NLMSG_OK(header, (unsigned int)len);
+              header = NLMSG_NEXT(header, len)) {
+             if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP) {
+                 continue;
+             }
+             const struct cn_msg *msg = (const struct cn_msg*)NLMSG_DATA(header);
+             if (msg->id.idx == CN_IDX_PROC && msg->id.val == CN_VAL_PROC) {
+                 proc_events_handle((const struct proc_event*)msg->data);
+             }
+         }
+     }
+     
+     return NULL;
+ }
+ 
+ /* Read the highest PID the kernel hands out */
+ static int read_pid_max(void) {
+     char buf[32];
+     unsigned long long pid_max = 0;
+     
+     if (read_proc_file("sys/kernel/pid_max", buf, sizeof(buf)) <= 0 || scan_ull(buf, &pid_max) == NULL ||
+         pid_max == 0 || pid_max > (1ULL << 22)) {
+         return 1 << 22;  // PID_MAX_LIMIT on 64-bit kernels
+     }
+     return (int)pid_max;
+ }
+ 
+ /*
+  * Subscribe to fork/exec/exit events from the kernel proc connector and start
+  * the listener thread. Needs CAP_NET_ADMIN; returns 0 if the subscription
+  * is refused, in which case every tick keeps reading /proc.
+  */
+ static int proc_events_start(void) {
+     int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+     if (sock < 0) {
+         perror("Cannot open proc connector socket");
+         return 0;
+     }
+     
+     struct sockaddr_nl addr;
+     memset(&addr, 0, sizeof(addr));
+     addr.nl_family = AF_NETLINK;
+     addr.nl_groups = CN_IDX_PROC;
+     if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+         perror("Cannot bind proc connector socket");
+         close(sock);
+         return 0;
+     }
+     
+     // Event bursts from fork storms should not overflow the socket
+     int rcvbuf = 4 << 20;
+     if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+         setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+     }
+     
+     union {
+         struct nlmsghdr header;
+         char bytes[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+     } request;
+     memset(&request, 0, sizeof(request));
+     struct cn_msg *msg = (struct cn_msg*)NLMSG_DATA(&request.header);
+     enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+     request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+     request.header.nlmsg_type = NLMSG_DONE;
+     request.header.nlmsg_pid = (unsigned int)getpid();
+     msg->id.idx = CN_IDX_PROC;
+     msg->id.val = CN_VAL_PROC;
+     msg->len = sizeof(op);
+     memcpy(msg->data, &op, sizeof(op));
+     if (send(sock, &request, request.header.nlmsg_len, 0) < 0) {
+         perror("Cannot subscribe to proc events");
+         close(sock);
+         return 0;
+     }
+     
+     proc_events.max_pid = read_pid_max() + 1;
+     proc_events.live = (unsigned long*)calloc((proc_events.max_pid + BITS_PER_WORD - 1) / BITS_PER_WORD,
+                                               sizeof(unsigned long));
+     proc_events.resync = 1;  // The first tick fills the set from /proc
+     proc_events.sock = sock;
+     if (pipe(proc_events.stop_pipe) < 0 ||
+         pthread_create(&proc_events.thread, NULL, proc_events_thread_func, NULL) != 0) {
+         perror("Cannot start proc event listener");
+         close(sock);
+         free(proc_events.live);
+         proc_events.live = NULL;
+         proc_events.sock = -1;
+         return 0;
+     }
+     
+     return 1;
+ }
+ 
+ /* Stop the listener thread and unsubscribe */
+ static void proc_events_stop(void) {
+     if (proc_events.sock < 0) {
+         return;
+     }
+     
+     if (write(proc_events.stop_pipe[1], "", 1) < 0) {
+         perror("Cannot stop proc event listener");
+     }
+     pthread_join(proc_events.thread, NULL);
+     close(proc_events.stop_pipe[0]);
+     close(proc_events.stop_pipe[1]);
+     close(proc_events.sock);
+     proc_events.sock = -1;
+     free(proc_events.live);
+     free(proc_events.exited);
+     free(proc_events.draining);
+     free(proc_events.execs);
+     proc_events.live = NULL;
+     proc_events.exited = NULL;
+     proc_events.draining = NULL;
+     proc_events.execs = NULL;
+     proc_events.exec_count = 0;
+     proc_events.exec_capacity = 0;
+ }
+ 
+ /*
+  * Fill the scan's PID list. With the proc connector the list comes from the
+  * event-maintained set, and /proc is only read on every PROC_EVENTS_RESYNC_TICKS
+  * tick or after events were lost. The resync holds the lock while reading
+  * /proc, so events that race with it are applied after it and are not lost.
+  */
+ static void collect_pids(void) {
+     if (proc_events.sock < 0) {
+         collect_proc_pids();
+         return;
+     }
+     
+     pthread_mutex_lock(&proc_events.lock);
+     if (proc_events.resync || ++proc_events.ticks_since_resync >= PROC_EVENTS_RESYNC_TICKS) {
+         collect_proc_pids();
+         memset(proc_events.live, 0,
+                (proc_events.max_pid + BITS_PER_WORD - 1) / BITS_PER_WORD * sizeof(unsigned long));
+         for (int i = 0; i < scan_pool.num_pids; i++) {
+             int pid = scan_pool.pids[i];
+             if (pid < proc_events.max_pid) {
+                 proc_events.live[pid / BITS_PER_WORD] |= 1UL << (pid % BITS_PER_WORD);
+             }
+         }
+         proc_events.resync = 0;
+         proc_events.ticks_since_resync = 0;
+     } else {
+         // Walking the bitmap yields the PIDs in ascending order, like /proc
+         int words = (proc_events.max_pid + BITS_PER_WORD - 1) / BITS_PER_WORD;
+         scan_pool.num_pids = 0;
+         for (int w = 0; w < words; w++) {
+             unsigned long bits = proc_events.live[w];
+             while (bits != 0) {
+                 scan_add_pid(w * BITS_PER_WORD + __builtin_ctzl(bits));
+                 bits &= bits - 1;
+             }
+         }
+     }
+     pthread_mutex_unlock(&proc_events.lock);
+ }
+ 
+ /* Append a thread row */
+ static void add_thread(ThreadList *threads, int pid, int tid, const ProcStat *stat, double cpu) {
+     if (threads->count >= threads->capacity) {
+         threads->capacity = threads->capacity > 0 ? threads->capacity * 2 : 256;
+         threads->threads = (ThreadInfo*)realloc(threads->threads, threads->capacity * sizeof(ThreadInfo));
+     }
+     
+     ThreadInfo *thread = &threads->threads[threads->count++];
+     thread->pid = pid;
+     thread->tid = tid;
+     size_t len = strlen(stat->name);
+     if (len >= sizeof(thread->name)) {
+         len = sizeof(thread->name) - 1;
+     }
+     memcpy(thread->name, stat->name, len);
+     thread->name[len] = '\0';
+     thread->state = stat->state;
+     thread->cpu_usage = cpu;
+ }
+ 
+ /* Order thread rows by TID */
+ static int compare_tids(const void *a, const void *b) {
+     int tid_a = ((const ThreadInfo*)a)->tid;
+     int tid_b = ((const ThreadInfo*)b)->tid;
+     return (tid_a > tid_b) - (tid_a < tid_b);
+ }
+ 
+ /*
+  * Read /proc/<pid>/task/<tid>/stat for every thread of a process. Threads go
+  * through the same delta engine as processes, with their own state table
+  * keyed by (tid, starttime).
+  */
+ static void scan_task_dir(ProcessList *list, int row, ThreadList *threads) {
+     char path[32];
+     char buf[1024];
+     
+     size_t len = format_stat_path(path, list->pid[row]);
+     memcpy(path + len, "/task", 6);
+     int task_fd = openat(dirfd(proc_dir), path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+     if (task_fd < 0) {
+         return;
+     }
+     DIR *task_dir = fdopendir(task_fd);
+     if (task_dir == NULL) {
+         close(task_fd);
+         return;
+     }
+     
+     struct dirent *entry;
+     while ((entry = readdir(task_dir)) != NULL) {
+         size_t digits = 0;
+         int tid = 0;
+         while (entry->d_name[digits] >= '0' && entry->d_name[digits] <= '9') {
+             tid = tid * 10 + (entry->d_name[digits] - '0');
+             digits++;
+         }
+         if (digits == 0 || entry->d_name[digits] != '\0' || digits > 10) {
+             continue;
+         }
+         
+         format_stat_path(path, tid);
+         int fd = openat(task_fd, path, O_RDONLY | O_CLOEXEC);
+         if (fd < 0) {
+             continue;  // The thread exited
+         }
+         ssize_t stat_len = read_proc_fd(fd, buf, sizeof(buf));
+         close(fd);
+         
+         ProcStat stat;
+         if (stat_len <= 0 || !parse_proc_stat(buf, (size_t)stat_len, &stat)) {
+             continue;
+         }
+         ProcessState state;
+         memset(&state, 0, sizeof(state));
+         state.pid = tid;
+         state.starttime = stat.starttime;
+         state.stat_fd = -1;
+         state.statm_fd = -1;
+         double cpu_usage = state_table_account(&thread_states, state_table_lookup(&thread_states, tid),
+                                                &state, stat.utime + stat.stime);
+         state_table_insert(&thread_states, &state);
+         add_thread(threads, list->pid[row], tid, &stat, cpu_usage);
+     }
+     closedir(task_dir);
+     
+     list->thread_rows[row] = threads->count - list->first_thread[row];
+     ThreadInfo *rows = threads->threads + list->first_thread[row];
+     for (int i = 1; i < list->thread_rows[row]; i++) {
+         if (rows[i].tid < rows[i - 1].tid) {
+             qsort(rows, list->thread_rows[row], sizeof(ThreadInfo), compare_tids);
+             break;
+         }
+     }
+ }
+ 
+ /*
+  * Read the threads of the processes the UI has expanded and of those above
+  * thread_threshold, so the cost follows what is shown rather than the total
+  * thread count. Expanded PIDs that are gone are dropped from the set.
+  */
+ static void collect_threads(ProcessList *list, ThreadList *threads) {
+     threads->count = 0;
+     
+     pthread_mutex_lock(&expanded_lock);
+     int count = expanded_count;
+     if (count > expanded_scratch_capacity) {
+         expanded_scratch_capacity = count * 2;
+         expanded_scratch = (int*)realloc(expanded_scratch, expanded_scratch_capacity * sizeof(int));
+         expanded_seen = (char*)realloc(expanded_seen, expanded_scratch_capacity);
+     }
+     if (count > 0) {
+         memcpy(expanded_scratch, expanded_pids, count * sizeof(int));
+         memset(expanded_seen, 0, count);
+     }
+     pthread_mutex_unlock(&expanded_lock);
+     if (count == 0 && thread_threshold <= 0) {
+         return;  // Nothing to read; rows already say they have no thread rows
+     }
+     
+     // Threads use the process table's jiffies for this tick
+     thread_states.prev_total_jiffies = process_states.prev_total_jiffies;
+     thread_states.total_delta = process_states.total_delta;
+     thread_states.num_cpus = process_states.num_cpus;
+     
+     for (int i = 0; i < list->count; i++) {
+         list->first_thread[i] = threads->count;
+         
+         int wanted = thread_threshold > 0 && list->cpu_usage[i] >= thread_threshold;
+         int low = 0;
+         int high = count - 1;
+         while (low <= high) {
+             int mid = low + (high - low) / 2;
+             if (expanded_scratch[mid] == list->pid[i]) {
+                 expanded_seen[mid] = 1;
+                 wanted = 1;
+                 break;
+             }
+             if (expanded_scratch[mid] < list->pid[i]) {
+                 low = mid + 1;
+             } else {
+                 high = mid - 1;
+             }
+         }
+         if (wanted) {
+             scan_task_dir(list, i, threads);
+         }
+     }
+     state_table_end_tick(&thread_states);
+     
+     for (int i = 0; i < count; i++) {
+         if (!expanded_seen[i]) {
+             set_threads_expanded(expanded_scratch[i], 0);
+         }
+     }
+ }
+ 
+ /* Parse the totals of /proc/<pid>/smaps_rollup, in kB; returns 0 if there is no Pss line */
+ static int parse_smaps_rollup(const char *buf, SmapsInfo *totals) {
+     unsigned long long rss = 0, pss = 0, private_clean = 0, private_dirty = 0, swap = 0, anon = 0;
+     int have_pss = 0;
+     
+     // "Key:   value kB" lines after the "[rollup]" header line
+     for (const char *line = buf; *line != '\0'; ) {
+         const char *end = strchr(line, '\n');
+         const char *colon = strchr(line, ':');
+         unsigned long long value;
+         
+         if (colon != NULL && (end == NULL || colon < end)) {
+             size_t key = (size_t)(colon - line);
+             const char *p = colon + 1;
+             while (*p == ' ') {
+                 p++;
+             }
+             if (scan_ull(p, &value) != NULL) {
+                 if (key == 3 && strncmp(line, "Rss", 3) == 0) {
+                     rss = value;
+                 } else if (key == 3 && strncmp(line, "Pss", 3) == 0) {
+                     pss = value;
+                     have_pss = 1;
+                 } else if (key == 13 && strncmp(line, "Private_Clean", 13) == 0) {
+                     private_clean = value;
+                 } else if (key == 13 && strncmp(line, "Private_Dirty", 13) == 0) {
+                     private_dirty = value;
+                 } else if (key == 4 && strncmp(line, "Swap", 4) == 0) {
+                     swap = value;
+                 } else if (key == 9 && strncmp(line, "Anonymous", 9) == 0) {
+                     anon = value;
+                 }
+             }
+         }
+         if (end == NULL) {
+             break;
+         }
+         line = end + 1;
+     }
+     
+     totals->pss_kb = pss;
+     totals->uss_kb = private_clean + private_dirty;
+     totals->swap_kb = swap;
+     totals->anon_kb = anon;
+     totals->file_kb = rss > anon ? rss - anon : 0;
+     return have_pss;
+ }
+ 
+ /* Read smaps_rollup into an entry; a failed read is not retried until the entry is due again */
+ static void read_smaps_rollup(SmapsEntry *entry) {
+     char path[32];
+     char buf[4096];
+     
+     size_t len = format_stat_path(path, entry->pid);
+     memcpy(path + len, "/smaps_rollup", 14);
+     entry->valid = read_proc_file(path, buf, sizeof(buf)) > 0 && parse_smaps_rollup(buf, &entry->totals);
+     entry->read_tick = scan_pool.tick;
+ }
+ 
+ /* Previous tick's smaps entry of a PID, or NULL */
+ static SmapsEntry *smaps_find(int pid) {
+     int low = 0;
+     int high = smaps_count - 1;
+     while (low <= high) {
+         int mid = low + (high - low) / 2;
+         if (smaps_cache[mid].pid == pid) {
+             return &smaps_cache[mid];
+         }
+         if (smaps_cache[mid].pid < pid) {
+             low = mid + 1;
+         } else {
+             high = mid - 1;
+         }
+     }
+     return NULL;
+ }
+ 
+ /* Order smaps entries by PID */
+ static int compare_smaps_pids(const void *a, const void *b) {
+     int pa = ((const SmapsEntry*)a)->pid;
+     int pb = ((const SmapsEntry*)b)->pid;
+     return (pa > pb) - (pa < pb);
+ }
+ 
+ /*
+  * Fill the PSS, USS, swap, anon and file columns of the smaps_top processes
+  * with the largest RSS. smaps_rollup walks every mapping of a process, so
+  * each of them is read only every smaps_every ticks, with the reads spread
+  * evenly across ticks, and the totals are cached in between. A cached entry
+  * is dropped when its PID is reused, when the comm changes, or when the proc
+  * connector reports an exec.
+  */
+ static void collect_smaps(ProcessList *list) {
+     if (smaps_top <= 0 || list->count == 0) {
+         return;
+     }
+     unsigned long long mark = profile_now();
+     if (smaps_cache == NULL) {
+         smaps_cache = (SmapsEntry*)malloc(smaps_top * sizeof(SmapsEntry));
+         smaps_next = (SmapsEntry*)malloc(smaps_top * sizeof(SmapsEntry));
+     }
+     
+     // Processes that exec'd since the last tick have a new address space
+     if (proc_events.sock >= 0) {
+         pthread_mutex_lock(&proc_events.lock);
+         for (int i = 0; i < proc_events.exec_count; i++) {
+             SmapsEntry *entry = smaps_find(proc_events.execs[i]);
+             if (entry != NULL) {
+                 entry->read_tick = 0;
+                 entry->valid = 0;
+             }
+         }
+         proc_events.exec_count = 0;
+         pthread_mutex_unlock(&proc_events.lock);
+     }
+     
+     // The memory column is RSS over total memory, so it ranks processes by RSS
+     double threshold = 0;
+     if (list->count > smaps_top) {
+         double *values = usage_values(list->count);
+         for (int i = 0; i < list->count; i++) {
+             values[i] = list->memory_usage[i];
+         }
+         threshold = kth_largest(values, list->count, smaps_top);
+     }
+     
+     int count = 0;
+     for (int i = 0; i < list->count && count < smaps_top; i++) {
+         if (list->memory_usage[i] <= 0 || list->memory_usage[i] < threshold) {
+             continue;  // Kernel threads have no mappings
+         }
+         
+         const ProcessState *state = state_table_lookup(&process_states, list->pid[i]);
+         const SmapsEntry *cached = smaps_find(list->pid[i]);
+         SmapsEntry *entry = &smaps_next[count++];
+         if (cached != NULL && state != NULL && cached->starttime == state->starttime &&
+             strncmp(cached->name, list->name[i], sizeof(cached->name) - 1) == 0) {
+             *entry = *cached;
+         } else {
+             memset(entry, 0, sizeof(SmapsEntry));
+             entry->pid = list->pid[i];
+             entry->starttime = state != NULL ? state->starttime : 0;
+             strncpy(entry->name, list->name[i], sizeof(entry->name) - 1);  // The memset left the terminator
+         }
+         entry->row = i;
+     }
+     qsort(smaps_next, count, sizeof(SmapsEntry), compare_smaps_pids);
+     
+     // Read the stalest entries that are due, enough per tick to go round every smaps_every ticks
+     int budget = (count + smaps_every - 1) / smaps_every;
+     for (int n = 0; n < budget; n++) {
+         SmapsEntry *stalest = NULL;
+         for (int i = 0; i < count; i++) {
+             SmapsEntry *entry = &smaps_next[i];
+             if (entry->read_tick != 0 && scan_pool.tick - entry->read_tick < (unsigned long)smaps_every) {
+                 continue;
+             }
+             if (stalest == NULL || entry->read_tick < stalest->read_tick) {
+                 stalest = entry;
+             }
+         }
+         if (stalest == NULL) {
+             break;
+         }
+         read_smaps_rollup(stalest);
+     }
+     
+     for (int i = 0; i < count; i++) {
+         const SmapsEntry *entry = &smaps_next[i];
+         if (entry->valid) {
+             process_list_set_smaps(list, entry->row, &entry->totals);
+         }
+     }
+     
+     SmapsEntry *swap = smaps_cache;
+     smaps_cache = smaps_next;
+     smaps_next = swap;
+     smaps_count = count;
+     profile_record(PROFILE_SMAPS, profile_now() - mark);
+ }
+ 
+ /* Intern the cgroup v2 path of a /proc/<pid>/cgroup file, the "0::" line; -1 without one */
+ static int parse_proc_cgroup(char *buf) {
+     for (char *line = buf; line != NULL && *line != '\0'; ) {
+         char *end = strchr(line, '\n');
+         if (end != NULL) {
+             *end = '\0';
+         }
+         if (strncmp(line, "0::", 3) == 0) {
+             return rollup_cgroup_intern(line + 3);
+         }
+         line = end != NULL ? end + 1 : NULL;
+     }
+     return -1;  // Only cgroup v1 hierarchies
+ }
+ 
+ /*
+  * Give every row its interned cgroup. Processes rarely move between cgroups,
+  * so /proc/<pid>/cgroup is read when a process is first seen and then only
+  * every cgroup_every ticks, spread evenly across ticks; in between the
+  * process state keeps the entry.
+  */
+ static void collect_cgroups(ProcessList *list) {
+     char path[32];
+     char buf[4096];
+     
+     if (cgroup_every <= 0) {
+         return;
+     }
+     for (int i = 0; i < list->count; i++) {
+         ProcessState *state = state_table_lookup(&process_states, list->pid[i]);
+         if (state == NULL) {
+             continue;
+         }
+         if (state->cgroup == CGROUP_UNREAD ||
+             ((unsigned long)list->pid[i] + scan_pool.tick) % (unsigned long)cgroup_every == 0) {
+             size_t len = format_stat_path(path, list->pid[i]);
+             memcpy(path + len, "/cgroup", 8);
+             state->cgroup = read_proc_file(path, buf, sizeof(buf)) > 0 ? parse_proc_cgroup(buf) : -1;
+         }
+         list->cgroup[i] = state->cgroup;
+     }
+ }
+ 
+ /*
+  * Add the processes that exited since the last tick to the exited list, with
+  * CPU usage over their last interval from the same delta engine as live ones.
+  */
+ static void collect_exited(ProcessList *exited) {
+     if (proc_events.sock < 0) {
+         return;
+     }
+     
+     // Swap buffers so the listener can keep appending while these are processed
+     pthread_mutex_lock(&proc_events.lock);
+     ExitRecord *records = proc_events.exited;
+     int count = proc_events.exited_count;
+     proc_events.exited = proc_events.draining;
+     proc_events.draining = records;
+     int capacity = proc_events.exited_capacity;
+     proc_events.exited_capacity = proc_events.draining_capacity;
+     proc_events.draining_capacity = capacity;
+     proc_events.exited_count = 0;
+     pthread_mutex_unlock(&proc_events.lock);
+     
+     for (int i = 0; i < count; i++) {
+         const ExitRecord *record = &records[i];
+         ProcessState state;
+         state.pid = record->pid;
+         state.starttime = record->stat.starttime;
+         
+         double cpu_usage = state_table_account(&process_states, state_table_lookup(&process_states, record->pid),
+                                                &state, record->stat.utime + record->stat.stime);
+         double mem_usage = 0.0;
+         if (scan_pool.total_mem > 0) {
+             mem_usage = (double)record->rss / (double)scan_pool.total_mem * 100.0;
+         }
+         add_process(exited, record->pid, record->stat.name, cpu_usage, mem_usage);
+         exited->ppid[exited->count - 1] = record->stat.ppid;
+     }
+ }
+ 
+ /* Release everything the Linux sampler keeps between ticks */
+ static void close_linux_sampler(void) {
+     proc_events_stop();
+     scan_pool_shutdown();
+     if (timer_fd >= 0) {
+         close(timer_fd);
+         close(wake_fd);
+         timer_fd = -1;
+         wake_fd = -1;
+     }
+     state_table_free(&process_states);
+     state_table_free(&thread_states);
+     free(expanded_scratch);
+     free(expanded_seen);
+     expanded_scratch = NULL;
+     expanded_seen = NULL;
+     expanded_scratch_capacity = 0;
+     free(cpu_times);
+     cpu_times = NULL;
+     cpu_times_capacity = 0;
+     free(smaps_cache);
+     free(smaps_next);
+     smaps_cache = NULL;
+     smaps_next = NULL;
+     smaps_count = 0;
+     if (proc_dir != NULL) {
+         closedir(proc_dir);
+         proc_dir = NULL;
+     }
+ }
+ 
+ /* Get Linux processes */
+ static void get_linux_processes(ProcessList *list, ProcessList *exited, ThreadList *threads, SystemInfo *system) {
+     char buf[4096];  // meminfo runs past a kilobyte
+     
+     // Open /proc once; files are opened relative to it
+     if (proc_dir == NULL) {
+         proc_dir = opendir(proc_root);
+         if (proc_dir == NULL) {
+             perror(proc_root);
+             return;
+         }
+         page_size = sysconf(_SC_PAGESIZE);
+         clock_ticks = sysconf(_SC_CLK_TCK) > 0 ? sysconf(_SC_CLK_TCK) : 100;
+         scan_pool_init(scan_threads);
+         if (use_proc_events && strcmp(proc_root, "/proc") != 0) {
+             fprintf(stderr, "Proc events only describe the real /proc, ignoring them for %s\n", proc_root);
+         } else if (use_proc_events && !proc_events_start()) {
+             fprintf(stderr, "Proc events unavailable, reading /proc on every refresh\n");
+         }
+         rollup_cgroup_init(strcmp(proc_root, "/proc") == 0);
+         watchdog_init(strcmp(proc_root, "/proc") == 0);
+     }
+     
+     // Get system memory info
+     scan_pool.total_mem = 0;
+     if (read_proc_file("meminfo", buf, sizeof(buf)) > 0 && strncmp(buf, "MemTotal:", 9) == 0) {
+         const char *p = buf + 9;
+         while (*p == ' ') {
+             p++;
+         }
+         if (scan_ull(p, &system->mem_total_kb) != NULL) {
+             scan_pool.total_mem = system->mem_total_kb * 1024;  // Convert to bytes
+         }
+         unsigned long long buffers = 0;
+         find_proc_field(buf, "\nMemAvailable:", &system->mem_available_kb);
+         find_proc_field(buf, "\nBuffers:", &buffers);
+         find_proc_field(buf, "\nCached:", &system->mem_cached_kb);
+         system->mem_cached_kb += buffers;
+         find_proc_field(buf, "\nSwapTotal:", &system->swap_total_kb);
+         find_proc_field(buf, "\nSwapFree:", &system->swap_free_kb);
+     }
+     
+     state_table_begin_tick(&process_states, system);
+     Snapshot *previous = atomic_load(&current_snapshot);  // Never recycled while it is current
+     scan_pool.previous_rows = previous != NULL ? &previous->list : NULL;
+     scan_pool.tick++;
+     unsigned long long mark = profile_now();
+     collect_pids();
+     profile_record(PROFILE_READDIR, profile_now() - mark);
+     
+     // Split the PIDs into chunks and hand each worker an even share to start from
+     scan_pool.num_chunks = (scan_pool.num_pids + SCAN_CHUNK_SIZE - 1) / SCAN_CHUNK_SIZE;
+     if (scan_pool.num_chunks > scan_pool.chunk_capacity) {
+         scan_pool.chunk_capacity = scan_pool.num_chunks * 2;
+         scan_pool.chunks = (ScanChunk*)realloc(scan_pool.chunks, scan_pool.chunk_capacity * sizeof(ScanChunk));
+     }
+     int num_workers = scan_pool.num_chunks > 1 ? scan_pool.num_workers : 1;
+     for (int i = 0; i < num_workers; i++) {
+         unsigned long long begin = (unsigned long long)scan_pool.num_chunks * i / num_workers;
+         unsigned long long end = (unsigned long long)scan_pool.num_chunks * (i + 1) / num_workers;
+         atomic_store(&scan_pool.ranges[i], (begin << 32) | end);
+     }
+     
+     // Scan on this thread, with the pool helping when there is more than one chunk
+     if (num_workers > 1) {
+         pthread_mutex_lock(&scan_pool.lock);
+         scan_pool.generation++;
+         scan_pool.pending = num_workers - 1;
+         pthread_cond_broadcast(&scan_pool.start_cond);
+         pthread_mutex_unlock(&scan_pool.lock);
+     }
+     scan_worker_run(0);
+     if (num_workers > 1) {
+         pthread_mutex_lock(&scan_pool.lock);
+         while (scan_pool.pending > 0) {
+             pthread_cond_wait(&scan_pool.done_cond, &scan_pool.lock);
+         }
+         pthread_mutex_unlock(&scan_pool.lock);
+     }
+     
+     unsigned long long open_ns = 0, read_ns = 0, parse_ns = 0;
+     for (int i = 0; i < num_workers; i++) {
+         open_ns += scan_pool.shards[i].open_ns;
+         read_ns += scan_pool.shards[i].read_ns;
+         parse_ns += scan_pool.shards[i].parse_ns;
+     }
+     profile_record(PROFILE_OPEN, open_ns);
+     profile_record(PROFILE_READ, read_ns);
+     profile_record(PROFILE_PARSE, parse_ns);
+     
+     // A scan cut short by stop_sampler() is dropped, with the descriptors its states took over
+     if (!atomic_load(&running)) {
+         for (int i = 0; i < num_workers; i++) {
+             ScanShard *shard = &scan_pool.shards[i];
+             for (int j = 0; j < shard->list.count; j++) {
+                 state_table_close_fds(&process_states, &shard->states[j]);
+             }
+         }
+         return;
+     }
+     
+     // Merge the shards back in /proc order and carry their states into the table
+     for (int c = 0; c < scan_pool.num_chunks; c++) {
+         const ScanChunk *chunk = &scan_pool.chunks[c];
+         const ScanShard *shard = &scan_pool.shards[chunk->shard];
+         
+         process_list_append(list, &shard->list, chunk->start, chunk->count);
+         
+         for (int i = 0; i < chunk->count; i++) {
+             state_table_insert(&process_states, &shard->states[chunk->start + i]);
+         }
+     }
+     
+     collect_exited(exited);
+     state_table_end_tick(&process_states);
+     collect_threads(list, threads);
+     collect_smaps(list);
+     collect_cgroups(list);
+     if (cold_every > 1) {
+         update_hot_threshold(list);
+     }
+ }
+ #endif
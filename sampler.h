@@ -0,0 +1,174 @@
+/**
+ * CPU and Memory Usage Tracker - sampling core interface
+ * 
+ * The sampler thread scans processes every update interval and publishes
+ * each result as an immutable, reference-counted snapshot.
+ */
+
+ #ifndef SAMPLER_H
+ #define SAMPLER_H
+ 
+ #include <stdatomic.h>
+ #include <stddef.h>
+ 
+ /* Rate columns, each turned on by --rates and costing nothing when off */
+ #define RATE_IO 0x1                // read_rate and write_rate, one more file read per process
+ #define RATE_CTXSW 0x2             // The context switch rates, one more file read per process
+ #define RATE_FAULTS 0x4            // major_fault_rate, from the stat file already read
+ 
+ /* Type definitions */
+ typedef struct {
+     unsigned long long pss_kb;   // Proportional set size, from smaps_rollup like the rest
+     unsigned long long uss_kb;   // Unique set size, private clean plus private dirty
+     unsigned long long swap_kb;
+     unsigned long long anon_kb;  // Resident anonymous memory
+     unsigned long long file_kb;  // Resident file-backed and shared memory
+ } SmapsInfo;
+ 
+ /*
+  * Process rows, stored column by column: row i is pid[i], name[i] and so
+  * on, so sorting, filtering and diffing only read the columns they use.
+  * All the columns of a list share one block, which the list keeps while it
+  * is big enough, so lists refilled every tick stop allocating once grown.
+  * The rate columns are only there for the RATE_* groups in `columns` and
+  * are NULL otherwise. Few processes have a memory breakdown, so rows
+  * point into a side table for it rather than carrying its columns. A
+  * zeroed list is an empty one.
+  */
+ typedef struct {
+     int count;
+     int capacity;
+     unsigned int columns;      // RATE_* groups of rate columns the list has
+     void *block;               // Holds every column
+     int *pid;
+     const char **name;         // Interned and shared by every row of the process, see names.h
+     double *cpu_usage;
+     double *memory_usage;
+     char *state;               // R, S, D, Z, ... or 0 where unknown
+     int *num_threads;          // 0 where unknown
+     int *first_thread;         // The process's rows in Snapshot.threads
+     int *thread_rows;          // 0 unless its threads were scanned
+     unsigned long long *start_time;  // Clock ticks after boot; with the PID it identifies the process, 0 where unknown
+     int *uid;                  // Owner, only read while a view spec filters by user; -1 where unknown
+     int *ppid;                 // Parent PID, 0 where unknown
+     int *parent;               // Row of the parent process, -1 for roots
+     int *cgroup;               // Index in Snapshot.cgroups, -1 where unknown
+     int *subtree_processes;    // The process and all of its descendants
+     float *subtree_cpu;        // CPU and memory usage summed over them, only ever displayed
+     float *subtree_memory;
+     int *smaps;                // Entry in smaps_info, -1 unless the process's smaps_rollup was read
+     char *sampled;             // 0 where a cold process repeats its previous row, see --cold-every
+     float *read_rate;          // RATE_IO: storage bytes per second from /proc/<pid>/io; rates are -1 where not read
+     float *write_rate;
+     float *voluntary_switch_rate;    // RATE_CTXSW: context switches per second from /proc/<pid>/status
+     float *involuntary_switch_rate;
+     float *major_fault_rate;   // RATE_FAULTS: major page faults per second
+     SmapsInfo *smaps_info;
+     int smaps_count;
+     int smaps_capacity;
+ } ProcessList;
+ 
+ typedef struct {
+     int pid;                   // Owning process
+     int tid;
+     char name[16];             // Kernel comm, at most 15 characters
+     char state;
+     double cpu_usage;
+ } ThreadInfo;
+ 
+ typedef struct {
+     ThreadInfo *threads;
+     int count;
+     int capacity;
+ } ThreadList;
+ 
+ typedef struct {
+     int path;                  // Offset of the path in CgroupList.paths, "/" being the root
+     int parent;                // Index of the parent cgroup, -1 for the root
+     int processes;             // Processes in this cgroup and below it
+     double cpu_usage;          // Summed over those processes
+     double memory_usage;
+     double kernel_cpu_usage;   // From the cgroup's cpu.stat, -1 where unknown
+     double kernel_memory_usage;  // From memory.current, which also counts page cache; -1 where unknown
+ } CgroupInfo;
+ 
+ typedef struct {
+     CgroupInfo *cgroups;       // Ordered by path, so every parent comes before its children
+     int count;
+     int capacity;
+     char *paths;               // NUL-terminated paths, one after another
+     size_t paths_used;
+     size_t paths_capacity;
+ } CgroupList;
+ 
+ /* Host-wide usage, from /proc/stat and /proc/meminfo; zero where not read */
+ typedef struct {
+     int num_cpus;              // Entries of cpu_usage, indexed by CPU number
+     int cpu_capacity;
+     float *cpu_usage;          // Busy percent of each CPU since the previous tick, -1 for offline or unknown
+     float total_cpu_usage;     // Busy percent across all CPUs, -1 where unknown
+     unsigned long long mem_total_kb;
+     unsigned long long mem_available_kb;
+     unsigned long long mem_cached_kb;    // Page cache and buffers
+     unsigned long long swap_total_kb;
+     unsigned long long swap_free_kb;
+ } SystemInfo;
+ 
+ /*
+  * A published set of process rows. The sampler fills a free snapshot and
+  * publishes it by swapping current_snapshot; readers hold a reference while
+  * they use one. Snapshots are recycled rather than freed, so a reader that
+  * races with a swap only ever touches the refcount of a live buffer.
+  * Rows are ordered by PID.
+  */
+ typedef struct {
+     ProcessList list;
+     ProcessList exited;        // Processes seen exiting since the previous snapshot
+     ThreadList threads;        // Threads of expanded and busy processes, grouped by process, ordered by TID
+     ProcessList view;          // Rows selected by the view spec, in its order, when has_view is set
+     int has_view;              // 0 when the spec selects all of list, as it is
+     CgroupList cgroups;        // Cgroups of the processes in list, and their ancestors
+     SystemInfo system;
+     unsigned long sequence;    // Bumped on every publish
+     unsigned long long timestamp_ns;  // Wall-clock time of the publish
+     atomic_int refs;           // Reader references, plus SNAPSHOT_WRITER while being filled
+ } Snapshot;
+ 
+ 
+ /* Sampler settings */
+ extern atomic_int update_interval_ms;  // Change it through set_update_interval() once the sampler runs
+ extern size_t history_budget;   // Bytes of per-process history to keep, 0 disables it
+ extern int rate_columns;        // RATE_* bits of the rate columns to fill
+ 
+ /* Sampler lifecycle */
+ int parse_sampler_option(const char *arg);
+ int start_sampler(void (*on_publish)(void *data), void *data);
+ int sampler_init(void);
+ void sampler_tick(void);
+ void request_refresh(void);
+ void set_update_interval(int interval_ms);
+ void set_threads_expanded(int pid, int expanded);
+ int sampler_finished(void);
+ void stop_sampler(void);
+ 
+ /* Snapshot access, safe from any thread */
+ Snapshot *snapshot_acquire(void);
+ void snapshot_release(Snapshot *snapshot);
+ void snapshot_consumed(const Snapshot *snapshot);
+ void free_snapshots(void);
+ 
+ /* Process lists */
+ void add_process(ProcessList *list, int pid, const char *name, double cpu, double mem);
+ void process_list_clear(ProcessList *list);
+ void process_list_set_columns(ProcessList *list, unsigned int columns);
+ void process_list_gather(ProcessList *list, const ProcessList *from, const int *rows, int count);
+ void process_list_free(ProcessList *list);
+ 
+ /* Process control; a nonzero start_time must still match, so a reused PID is never hit */
+ int kill_process(int pid, unsigned long long start_time);
+ #ifndef _WIN32
+ int signal_process(int pid, unsigned long long start_time, int sig);
+ int renice_process(int pid, unsigned long long start_time, int nice);
+ #endif
+ 
+ #endif /* SAMPLER_H */
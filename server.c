@@ -0,0 +1,797 @@
+/**
+ * CPU and Memory Usage Tracker - metrics server
+ * 
+ * One thread runs an epoll loop over the listening socket and every
+ * connection, so a scrape never touches the sampler or the GTK thread; it
+ * only takes its own reference to the current snapshot. Each response body
+ * is built at most once per snapshot, the first time it is asked for, and
+ * every connection sending it writes straight from that one shared buffer.
+ */
+
+ #include <errno.h>
+ #include <stdarg.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ #include <fcntl.h>
+ #include <netinet/in.h>
+ #include <pthread.h>
+ #include <strings.h>
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/socket.h>
+ #include <sys/stat.h>
+ #include <sys/uio.h>
+ #include <sys/un.h>
+ #include <unistd.h>
+ #endif
+ 
+ #include "binary.h"
+ #include "sampler.h"
+ #include "server.h"
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ #define SERVER_MAX_CLIENTS 64     // Connections beyond this are closed straight away
+ #define SERVER_REQUEST_MAX 4096   // Longest request head
+ #define SERVER_HEAD_MAX 512       // Longest response head, or whole error response
+ #define SERVER_MAX_EVENTS 32
+ 
+ /* Responses built from a snapshot */
+ typedef enum {
+     BODY_METRICS,                 // Prometheus text exposition
+     BODY_SNAPSHOT,                // Binary snapshot format
+     BODY_N_KINDS
+ } BodyKind;
+ 
+ /* A response body, shared by every connection sending it; only the server thread touches it */
+ typedef struct {
+     BodyKind kind;
+     int refs;                     // The cache, plus each connection still sending it
+     unsigned long sequence;       // Snapshot it was built from
+     char *data;
+     size_t length;
+     size_t capacity;
+     int failed;                   // Growing it failed while it was built; data still holds what fit
+ } Body;
+ 
+ /* One connection */
+ typedef struct {
+     int fd;
+     int slot;                     // Index in clients
+     unsigned int events;          // What epoll waits for, EPOLLIN or EPOLLOUT
+     char request[SERVER_REQUEST_MAX];
+     size_t request_length;
+     char head[SERVER_HEAD_MAX];   // Status line and headers of the response being sent
+     size_t head_length;
+     Body *body;                   // NULL for a response without a shared body
+     size_t sent;                  // Bytes of head and body written so far
+     int keep_alive;
+ } Client;
+ #endif
+ 
+ /* Global variables */
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ static const char *unix_path = NULL;   // --serve=unix:PATH
+ static int tcp_port = 0;               // --serve=[127.0.0.1:]PORT
+ static int listen_fd = -1;
+ static int epoll_fd = -1;
+ static int stop_fd = -1;               // eventfd that ends the server loop
+ static pthread_t server_thread;
+ static int server_started = 0;
+ static Body *cached_bodies[BODY_N_KINDS];  // Latest body of each kind
+ static Body *spare_bodies[BODY_N_KINDS];   // A released body, reused for the next build
+ static Client *clients[SERVER_MAX_CLIENTS];
+ #endif
+ 
+ /* Function prototypes */
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ static void *server_thread_func(void *data);
+ static void accept_clients(void);
+ static void client_close(Client *client);
+ static void client_watch(Client *client, unsigned int events);
+ static void read_request(Client *client);
+ static void start_response(Client *client);
+ static void respond_text(Client *client, const char *status, const char *text);
+ static void send_response(Client *client);
+ static Body *body_acquire(BodyKind kind, const char **error);
+ static void body_release(Body *body);
+ static char *body_reserve(Body *body, size_t size);
+ static void append_format(Body *body, const char *format, ...);
+ static void build_host_metrics(Body *body, const SystemInfo *system);
+ static void build_metrics(Body *body, const Snapshot *snapshot);
+ static void build_snapshot(Body *body, const Snapshot *snapshot);
+ #endif
+ 
+ /* Apply one server command-line option; returns 0 if the option is not a server one */
+ int server_parse_option(const char *arg) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     // --serve=unix:PATH|[127.0.0.1:]PORT: serve metrics on a Unix socket or a loopback port
+     if (strncmp(arg, "--serve=", 8) == 0) {
+         const char *address = arg + 8;
+         if (strncmp(address, "unix:", 5) == 0 && address[5] != '\0') {
+             unix_path = address + 5;
+             return 1;
+         }
+         if (strncmp(address, "127.0.0.1:", 10) == 0 || strncmp(address, "localhost:", 10) == 0) {
+             address += 10;
+         }
+         char *end;
+         long port = strtol(address, &end, 10);
+         if (end == address || *end != '\0' || port <= 0 || port > 65535) {
+             return 0;
+         }
+         tcp_port = (int)port;
+         return 1;
+     }
+ #else
+     (void)arg;  // Unused parameter
+ #endif
+     return 0;
+ }
+ 
+ /* Open the socket and start the server thread, if --serve was given; returns 0 if it cannot listen */
+ int server_start(void) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     if (unix_path == NULL && tcp_port == 0) {
+         return 1;
+     }
+     
+     if (unix_path != NULL) {
+         struct sockaddr_un address;
+         memset(&address, 0, sizeof(address));
+         address.sun_family = AF_UNIX;
+         if (strlen(unix_path) >= sizeof(address.sun_path)) {
+             fprintf(stderr, "Socket path too long: %s\n", unix_path);
+             return 0;
+         }
+         strcpy(address.sun_path, unix_path);
+         
+         // A socket left behind by an earlier run is replaced, anything else is not
+         struct stat existing;
+         if (lstat(unix_path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+             unlink(unix_path);
+         }
+         listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+         if (listen_fd >= 0 && bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+             fprintf(stderr, "Cannot listen on %s: %s\n", unix_path, strerror(errno));
+             close(listen_fd);
+             listen_fd = -1;
+             return 0;
+         }
+     } else {
+         // Loopback only: the metrics name every process on the machine
+         struct sockaddr_in address;
+         memset(&address, 0, sizeof(address));
+         address.sin_family = AF_INET;
+         address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+         address.sin_port = htons((unsigned short)tcp_port);
+         int reuse = 1;
+         listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+         if (listen_fd >= 0) {
+             setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+         }
+         if (listen_fd >= 0 && bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+             fprintf(stderr, "Cannot listen on 127.0.0.1:%d: %s\n", tcp_port, strerror(errno));
+             close(listen_fd);
+             listen_fd = -1;
+             return 0;
+         }
+     }
+     if (listen_fd < 0 || listen(listen_fd, SERVER_MAX_CLIENTS) != 0) {
+         fprintf(stderr, "Cannot start the metrics server: %s\n", strerror(errno));
+         server_stop();
+         return 0;
+     }
+     
+     epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+     stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+     struct epoll_event listen_event = { .events = EPOLLIN, .data.ptr = &listen_fd };
+     struct epoll_event stop_event = { .events = EPOLLIN, .data.ptr = &stop_fd };
+     if (epoll_fd < 0 || stop_fd < 0 ||
+         epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event) != 0 ||
+         epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &stop_event) != 0) {
+         fprintf(stderr, "Cannot start the metrics server: %s\n", strerror(errno));
+         server_stop();
+         return 0;
+     }
+     
+     pthread_create(&server_thread, NULL, server_thread_func, NULL);
+     server_started = 1;
+ #endif
+     return 1;
+ }
+ 
+ /* Stop the server thread and close every connection */
+ void server_stop(void) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     if (server_started) {
+         unsigned long long one = 1;
+         if (write(stop_fd, &one, sizeof(one)) < 0) {
+             // The counter can only overflow, and then the loop is woken anyway
+         }
+         pthread_join(server_thread, NULL);
+         server_started = 0;
+     }
+     
+     for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+         if (clients[i] != NULL) {
+             client_close(clients[i]);
+         }
+     }
+     for (int i = 0; i < BODY_N_KINDS; i++) {
+         body_release(cached_bodies[i]);
+         cached_bodies[i] = NULL;
+         if (spare_bodies[i] != NULL) {
+             free(spare_bodies[i]->data);
+             free(spare_bodies[i]);
+             spare_bodies[i] = NULL;
+         }
+     }
+     if (listen_fd >= 0) {
+         close(listen_fd);
+         listen_fd = -1;
+         if (unix_path != NULL) {
+             unlink(unix_path);
+         }
+     }
+     if (epoll_fd >= 0) {
+         close(epoll_fd);
+         epoll_fd = -1;
+     }
+     if (stop_fd >= 0) {
+         close(stop_fd);
+         stop_fd = -1;
+     }
+ #endif
+ }
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ /* Server thread: accept, read requests and write responses until stopped */
+ static void *server_thread_func(void *data) {
+     (void)data;  // Unused parameter
+     
+     struct epoll_event events[SERVER_MAX_EVENTS];
+     for (;;) {
+         int count = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, -1);
+         if (count < 0 && errno != EINTR) {
+             return NULL;
+         }
+         for (int i = 0; i < count; i++) {
+             if (events[i].data.ptr == &stop_fd) {
+                 return NULL;
+             }
+             if (events[i].data.ptr == &listen_fd) {
+                 accept_clients();
+                 continue;
+             }
+             
+             Client *client = (Client*)events[i].data.ptr;
+             if (events[i].events & EPOLLOUT) {
+                 send_response(client);
+             } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                 read_request(client);
+             }
+         }
+     }
+ }
+ 
+ /* Accept every pending connection, closing those beyond SERVER_MAX_CLIENTS */
+ static void accept_clients(void) {
+     for (;;) {
+         int fd = accept(listen_fd, NULL, NULL);
+         if (fd < 0) {
+             if (errno == EINTR) {
+                 continue;
+             }
+             return;  // EAGAIN once none are left
+         }
+         fcntl(fd, F_SETFL, O_NONBLOCK);
+         fcntl(fd, F_SETFD, FD_CLOEXEC);
+         
+         int slot = 0;
+         while (slot < SERVER_MAX_CLIENTS && clients[slot] != NULL) {
+             slot++;
+         }
+         Client *client = slot < SERVER_MAX_CLIENTS ? (Client*)calloc(1, sizeof(Client)) : NULL;
+         struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+         if (client == NULL || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+             free(client);
+             close(fd);
+             continue;
+         }
+         client->fd = fd;
+         client->slot = slot;
+         client->events = EPOLLIN;
+         clients[slot] = client;
+     }
+ }
+ 
+ /* Close a connection and drop its hold on the body it was sending */
+ static void client_close(Client *client) {
+     close(client->fd);  // Also takes it out of the epoll set
+     body_release(client->body);
+     clients[client->slot] = NULL;
+     free(client);
+ }
+ 
+ /* Switch a connection between waiting for a request and waiting to send */
+ static void client_watch(Client *client, unsigned int events) {
+     if (client->events != events) {
+         struct epoll_event event = { .events = events, .data.ptr = client };
+         epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+         client->events = events;
+     }
+ }
+ 
+ /* Read what has arrived of a request, and answer once its head is complete */
+ static void read_request(Client *client) {
+     for (;;) {
+         size_t room = sizeof(client->request) - 1 - client->request_length;
+         if (room == 0) {
+             client->keep_alive = 0;
+             respond_text(client, "431 Request Header Fields Too Large", "Request too large\n");
+             return;
+         }
+         ssize_t n = read(client->fd, client->request + client->request_length, room);
+         if (n < 0 && errno == EINTR) {
+             continue;
+         }
+         if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+             return;  // The rest comes later
+         }
+         if (n <= 0) {
+             client_close(client);
+             return;
+         }
+         
+         client->request_length += (size_t)n;
+         client->request[client->request_length] = '\0';
+         if (strstr(client->request, "\r\n\r\n") != NULL) {
+             start_response(client);
+             return;
+         }
+     }
+ }
+ 
+ /* Answer a complete request head; anything sent after it on the connection is dropped */
+ static void start_response(Client *client) {
+     char method[8];
+     char path[128];
+     int minor;
+     if (sscanf(client->request, "%7s %127s HTTP/1.%d", method, path, &minor) != 3) {
+         client->keep_alive = 0;
+         respond_text(client, "400 Bad Request", "Bad request\n");
+         return;
+     }
+     
+     // HTTP/1.1 keeps the connection unless the client asks to close it
+     client->keep_alive = minor >= 1;
+     for (const char *line = strstr(client->request, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+         if (strncasecmp(line + 2, "Connection:", 11) == 0) {
+             const char *value = line + 13;
+             while (*value == ' ') {
+                 value++;
+             }
+             client->keep_alive = strncasecmp(value, "close", 5) != 0 && minor >= 1;
+         }
+     }
+     char *query = strchr(path, '?');
+     if (query != NULL) {
+         *query = '\0';
+     }
+     
+     int head_only = strcmp(method, "HEAD") == 0;
+     if (!head_only && strcmp(method, "GET") != 0) {
+         respond_text(client, "405 Method Not Allowed", "Only GET and HEAD are supported\n");
+         return;
+     }
+     BodyKind kind;
+     const char *content_type;
+     if (strcmp(path, "/metrics") == 0) {
+         kind = BODY_METRICS;
+         content_type = "text/plain; version=0.0.4; charset=utf-8";
+     } else if (strcmp(path, "/snapshot") == 0) {
+         kind = BODY_SNAPSHOT;
+         content_type = "application/octet-stream";
+     } else {
+         respond_text(client, "404 Not Found", "Try /metrics or /snapshot\n");
+         return;
+     }
+     
+     const char *error = NULL;
+     Body *body = body_acquire(kind, &error);
+     if (body == NULL) {
+         respond_text(client, "503 Service Unavailable", error);
+         return;
+     }
+     client->head_length = (size_t)snprintf(client->head, sizeof(client->head),
+                                            "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                                            "Connection: %s\r\n\r\n",
+                                            content_type, body->length, client->keep_alive ? "keep-alive" : "close");
+     if (head_only) {
+         body_release(body);
+         body = NULL;
+     }
+     client->body = body;
+     client->sent = 0;
+     client->request_length = 0;
+     send_response(client);
+ }
+ 
+ /* Answer with a short text that fits in the head buffer */
+ static void respond_text(Client *client, const char *status, const char *text) {
+     client->head_length = (size_t)snprintf(client->head, sizeof(client->head),
+                                            "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n"
+                                            "Connection: %s\r\n\r\n%s",
+                                            status, strlen(text), client->keep_alive ? "keep-alive" : "close", text);
+     client->body = NULL;
+     client->sent = 0;
+     client->request_length = 0;
+     send_response(client);
+ }
+ 
+ /* Write as much of the response as the socket takes; wait for it to drain for the rest */
+ static void send_response(Client *client) {
+     size_t body_length = client->body != NULL ? client->body->length : 0;
+     while (client->sent < client->head_length + body_length) {
+         struct iovec iov[2];
+         int count = 0;
+         if (client->sent < client->head_length) {
+             iov[count].iov_base = client->head + client->sent;
+             iov[count].iov_len = client->head_length - client->sent;
+             count++;
+         }
+         if (body_length > 0) {
+             size_t offset = client->sent > client->head_length ? client->sent - client->head_length : 0;
+             iov[count].iov_base = client->body->data + offset;
+             iov[count].iov_len = body_length - offset;
+             count++;
+         }
+         
+         // MSG_NOSIGNAL: a scraper that hangs up must not raise SIGPIPE in the GUI
+         struct msghdr message;
+         memset(&message, 0, sizeof(message));
+         message.msg_iov = iov;
+         message.msg_iovlen = (size_t)count;
+         ssize_t n = sendmsg(client->fd, &message, MSG_NOSIGNAL);
+         if (n < 0 && errno == EINTR) {
+             continue;
+         }
+         if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+             client_watch(client, EPOLLOUT);
+             return;
+         }
+         if (n < 0) {
+             client_close(client);
+             return;
+         }
+         client->sent += (size_t)n;
+     }
+     
+     body_release(client->body);
+     client->body = NULL;
+     if (!client->keep_alive) {
+         client_close(client);
+         return;
+     }
+     client_watch(client, EPOLLIN);
+ }
+ 
+ /*
+  * Take a reference to the body of a kind for the current snapshot, building
+  * it on first use. Returns NULL with the reason in *error when there is no
+  * snapshot yet or memory ran out building the body; the cached body of the
+  * previous snapshot is kept then.
+  */
+ static Body *body_acquire(BodyKind kind, const char **error) {
+     Snapshot *snapshot = snapshot_acquire();
+     if (snapshot == NULL) {
+         *error = "No snapshot has been taken yet\n";
+         return NULL;
+     }
+     
+     Body *body = cached_bodies[kind];
+     if (body == NULL || body->sequence != snapshot->sequence) {
+         body = spare_bodies[kind];
+         spare_bodies[kind] = NULL;
+         if (body == NULL && (body = (Body*)calloc(1, sizeof(Body))) == NULL) {
+             snapshot_release(snapshot);
+             *error = "Out of memory\n";
+             return NULL;
+         }
+         body->kind = kind;
+         body->refs = 1;
+         body->sequence = snapshot->sequence;
+         body->length = 0;
+         body->failed = 0;
+         if (kind == BODY_METRICS) {
+             build_metrics(body, snapshot);
+         } else {
+             build_snapshot(body, snapshot);
+         }
+         if (body->failed) {
+             spare_bodies[kind] = body;  // Keeps what it grew to for the next try
+             snapshot_release(snapshot);
+             *error = "Out of memory\n";
+             return NULL;
+         }
+         body_release(cached_bodies[kind]);
+         cached_bodies[kind] = body;
+     }
+     snapshot_release(snapshot);
+     
+     body->refs++;
+     return body;
+ }
+ 
+ /* Drop a reference to a body; the last one keeps it as the spare of its kind */
+ static void body_release(Body *body) {
+     if (body == NULL || --body->refs > 0) {
+         return;
+     }
+     if (spare_bodies[body->kind] == NULL) {
+         spare_bodies[body->kind] = body;
+         return;
+     }
+     free(body->data);
+     free(body);
+ }
+ 
+ /*
+  * Room for size more bytes at the end of a body; the caller advances its
+  * length. Returns NULL, marking the body failed, if it cannot grow.
+  */
+ static char *body_reserve(Body *body, size_t size) {
+     if (body->failed) {
+         return NULL;
+     }
+     if (body->length + size > body->capacity) {
+         size_t capacity = body->capacity > 0 ? body->capacity : 65536;
+         while (body->length + size > capacity) {
+             capacity *= 2;
+         }
+         char *data = (char*)realloc(body->data, capacity);
+         if (data == NULL) {
+             body->failed = 1;
+             return NULL;
+         }
+         body->data = data;
+         body->capacity = capacity;
+     }
+     return body->data + body->length;
+ }
+ 
+ /* Append formatted text, growing the body when it doesn't fit in the room left */
+ static void append_format(Body *body, const char *format, ...) {
+     va_list args;
+     char *p = body_reserve(body, 256);
+     if (p == NULL) {
+         return;
+     }
+     size_t room = body->capacity - body->length;
+     va_start(args, format);
+     int length = vsnprintf(p, room, format, args);
+     va_end(args);
+     if (length < 0) {
+         return;
+     }
+     if ((size_t)length >= room) {
+         p = body_reserve(body, (size_t)length + 1);
+         if (p == NULL) {
+             return;
+         }
+         va_start(args, format);
+         vsnprintf(p, (size_t)length + 1, format, args);
+         va_end(args);
+     }
+     body->length += (size_t)length;
+ }
+ 
+ /* Append a metric family's HELP and TYPE lines */
+ static void append_family(Body *body, const char *metric, const char *help) {
+     char *p = body_reserve(body, 2 * strlen(metric) + strlen(help) + 32);
+     if (p == NULL) {
+         return;
+     }
+     body->length += (size_t)sprintf(p, "# HELP %s %s\n# TYPE %s gauge\n", metric, help, metric);
+ }
+ 
+ /* Append one sample with a single label, escaping the label value as the exposition format requires */
+ static void append_sample(Body *body, const char *metric, const char *labels, const char *value_label,
+                           const char *value_text, double value, int decimals) {
+     size_t value_length = value_text != NULL ? 2 * strlen(value_text) : 0;  // Every character escaped
+     char *start = body_reserve(body, strlen(metric) + strlen(labels) + strlen(value_label) + value_length + 64);
+     if (start == NULL) {
+         return;
+     }
+     char *p = start + sprintf(start, "%s{%s", metric, labels);
+     if (value_text != NULL) {
+         p += sprintf(p, "%s=\"", value_label);
+         for (const char *s = value_text; *s != '\0'; s++) {
+             if (*s == '\\' || *s == '"') {
+                 *p++ = '\\';
+                 *p++ = *s;
+             } else if (*s == '\n') {
+                 *p++ = '\\';
+                 *p++ = 'n';
+             } else {
+                 *p++ = *s;
+             }
+         }
+         *p++ = '"';
+     }
+     p += sprintf(p, "} %.*f\n", decimals, value);
+     body->length += (size_t)(p - start);
+ }
+ 
+ /* Append one sample of a process, labelled with its PID and name */
+ static void append_process_sample(Body *body, const char *metric, const ProcessList *list, int row, double value,
+                                   int decimals) {
+     char labels[32];
+     snprintf(labels, sizeof(labels), "pid=\"%d\",", list->pid[row]);
+     append_sample(body, metric, labels, "name", list->name[row], value, decimals);
+ }
+ 
+ /* Host-wide CPU and memory, where the platform reads them */
+ static void build_host_metrics(Body *body, const SystemInfo *system) {
+     if (system->num_cpus > 0) {
+         append_family(body, "cmt_host_cpu_percent", "Busy share of every CPU since the previous refresh.");
+         if (system->total_cpu_usage >= 0) {
+             append_format(body, "cmt_host_cpu_percent %.2f\n", system->total_cpu_usage);
+         }
+         append_family(body, "cmt_host_cpu_core_percent", "Busy share of one CPU since the previous refresh.");
+         for (int i = 0; i < system->num_cpus; i++) {
+             if (system->cpu_usage[i] >= 0) {
+                 char labels[32];
+                 snprintf(labels, sizeof(labels), "cpu=\"%d\"", i);
+                 append_sample(body, "cmt_host_cpu_core_percent", labels, "", NULL, system->cpu_usage[i], 2);
+             }
+         }
+     }
+     if (system->mem_total_kb > 0) {
+         append_format(body,
+                       "# HELP cmt_host_memory_bytes Host memory by kind, from /proc/meminfo.\n"
+                       "# TYPE cmt_host_memory_bytes gauge\n"
+                       "cmt_host_memory_bytes{kind=\"total\"} %llu\n"
+                       "cmt_host_memory_bytes{kind=\"available\"} %llu\n"
+                       "cmt_host_memory_bytes{kind=\"cached\"} %llu\n"
+                       "cmt_host_memory_bytes{kind=\"swap_total\"} %llu\n"
+                       "cmt_host_memory_bytes{kind=\"swap_free\"} %llu\n",
+                       system->mem_total_kb * 1024, system->mem_available_kb * 1024,
+                       system->mem_cached_kb * 1024, system->swap_total_kb * 1024,
+                       system->swap_free_kb * 1024);
+     }
+ }
+ 
+ /* Append a rate column as a metric family, for the processes where it is known; a replayed list has none */
+ static void append_rate_family(Body *body, const ProcessList *list, const char *metric, const char *help,
+                                const float *rates) {
+     append_family(body, metric, help);
+     for (int i = 0; i < list->count && rates != NULL; i++) {
+         if (rates[i] >= 0) {
+             append_process_sample(body, metric, list, i, rates[i], 2);
+         }
+     }
+ }
+ 
+ /* Prometheus text exposition of every live process, and of the cgroups when they are read */
+ static void build_metrics(Body *body, const Snapshot *snapshot) {
+     const ProcessList *list = &snapshot->list;
+     append_format(body,
+                   "# HELP cmt_snapshot_sequence Sequence number of the snapshot.\n"
+                   "# TYPE cmt_snapshot_sequence counter\n"
+                   "cmt_snapshot_sequence %lu\n"
+                   "# HELP cmt_snapshot_timestamp_seconds Time the snapshot was taken.\n"
+                   "# TYPE cmt_snapshot_timestamp_seconds gauge\n"
+                   "cmt_snapshot_timestamp_seconds %.3f\n"
+                   "# HELP cmt_processes Number of processes.\n"
+                   "# TYPE cmt_processes gauge\n"
+                   "cmt_processes %d\n",
+                   snapshot->sequence, snapshot->timestamp_ns / 1e9, list->count);
+     build_host_metrics(body, &snapshot->system);
+     
+     append_family(body, "cmt_process_cpu_percent", "CPU usage since the previous refresh, in percent of one CPU.");
+     for (int i = 0; i < list->count; i++) {
+         append_process_sample(body, "cmt_process_cpu_percent", list, i, list->cpu_usage[i], 2);
+     }
+     append_family(body, "cmt_process_memory_percent", "Resident memory, in percent of physical memory.");
+     for (int i = 0; i < list->count; i++) {
+         append_process_sample(body, "cmt_process_memory_percent", list, i, list->memory_usage[i], 2);
+     }
+     append_family(body, "cmt_process_threads", "Number of threads.");
+     for (int i = 0; i < list->count; i++) {
+         if (list->num_threads[i] > 0) {
+             append_process_sample(body, "cmt_process_threads", list, i, list->num_threads[i], 0);
+         }
+     }
+     append_family(body, "cmt_process_pss_bytes", "Proportional set size, for the processes whose smaps_rollup is read.");
+     for (int i = 0; i < list->count; i++) {
+         if (list->smaps[i] >= 0) {
+             append_process_sample(body, "cmt_process_pss_bytes", list, i,
+                                   (double)list->smaps_info[list->smaps[i]].pss_kb * 1024, 0);
+         }
+     }
+     append_family(body, "cmt_process_swap_bytes", "Swapped out memory, for the processes whose smaps_rollup is read.");
+     for (int i = 0; i < list->count; i++) {
+         if (list->smaps[i] >= 0) {
+             append_process_sample(body, "cmt_process_swap_bytes", list, i,
+                                   (double)list->smaps_info[list->smaps[i]].swap_kb * 1024, 0);
+         }
+     }
+     if (rate_columns & RATE_IO) {
+         append_rate_family(body, list, "cmt_process_read_bytes_per_second", "Bytes read from storage per second.",
+                            list->read_rate);
+         append_rate_family(body, list, "cmt_process_write_bytes_per_second", "Bytes written to storage per second.",
+                            list->write_rate);
+     }
+     if (rate_columns & RATE_CTXSW) {
+         append_rate_family(body, list, "cmt_process_voluntary_context_switches_per_second",
+                            "Voluntary context switches per second.", list->voluntary_switch_rate);
+         append_rate_family(body, list, "cmt_process_involuntary_context_switches_per_second",
+                            "Involuntary context switches per second.", list->involuntary_switch_rate);
+     }
+     if (rate_columns & RATE_FAULTS) {
+         append_rate_family(body, list, "cmt_process_major_faults_per_second", "Major page faults per second.",
+                            list->major_fault_rate);
+     }
+     
+     const CgroupList *cgroups = &snapshot->cgroups;
+     if (cgroups->count == 0) {
+         return;
+     }
+     append_family(body, "cmt_cgroup_processes", "Processes in the cgroup and below it.");
+     for (int i = 0; i < cgroups->count; i++) {
+         append_sample(body, "cmt_cgroup_processes", "", "cgroup", cgroups->paths + cgroups->cgroups[i].path,
+                       cgroups->cgroups[i].processes, 0);
+     }
+     append_family(body, "cmt_cgroup_cpu_percent", "CPU usage of the processes in the cgroup and below it.");
+     for (int i = 0; i < cgroups->count; i++) {
+         append_sample(body, "cmt_cgroup_cpu_percent", "", "cgroup", cgroups->paths + cgroups->cgroups[i].path,
+                       cgroups->cgroups[i].cpu_usage, 2);
+     }
+     append_family(body, "cmt_cgroup_memory_percent", "Resident memory of the processes in the cgroup and below it.");
+     for (int i = 0; i < cgroups->count; i++) {
+         append_sample(body, "cmt_cgroup_memory_percent", "", "cgroup", cgroups->paths + cgroups->cgroups[i].path,
+                       cgroups->cgroups[i].memory_usage, 2);
+     }
+ }
+ 
+ /* Append fixed-width binary rows */
+ static void append_binary_rows(Body *body, const ProcessList *list, uint32_t flags) {
+     BinaryRow *rows = (BinaryRow*)body_reserve(body, (size_t)list->count * sizeof(BinaryRow));
+     if (rows == NULL) {
+         return;
+     }
+     memset(rows, 0, (size_t)list->count * sizeof(BinaryRow));
+     for (int i = 0; i < list->count; i++) {
+         rows[i].pid = list->pid[i];
+         rows[i].flags = flags;
+         rows[i].cpu_usage = (float)list->cpu_usage[i];
+         rows[i].memory_usage = (float)list->memory_usage[i];
+         size_t name_len = strlen(list->name[i]);
+         memcpy(rows[i].name, list->name[i], name_len < BINARY_NAME_SIZE ? name_len : BINARY_NAME_SIZE - 1);
+     }
+     body->length += (size_t)list->count * sizeof(BinaryRow);
+ }
+ 
+ /* Every live and exited process in the binary snapshot format */
+ static void build_snapshot(Body *body, const Snapshot *snapshot) {
+     BinaryHeader *header = (BinaryHeader*)body_reserve(body, sizeof(BinaryHeader));
+     if (header == NULL) {
+         return;
+     }
+     memset(header, 0, sizeof(BinaryHeader));
+     memcpy(header->magic, BINARY_MAGIC, 4);
+     header->version = BINARY_VERSION;
+     header->sequence = snapshot->sequence;
+     header->timestamp_ns = snapshot->timestamp_ns;
+     header->row_count = (uint32_t)snapshot->list.count;
+     header->exited_count = (uint32_t)snapshot->exited.count;
+     body->length += sizeof(BinaryHeader);
+     
+     append_binary_rows(body, &snapshot->list, 0);
+     append_binary_rows(body, &snapshot->exited, BINARY_ROW_EXITED);
+ }
+ #endif
@@ -0,0 +1,18 @@
+/**
+ * CPU and Memory Usage Tracker - metrics server
+ * 
+ * Serves the latest snapshot to local scrapers over HTTP, as Prometheus
+ * text on /metrics and in the binary snapshot format on /snapshot, on a
+ * Unix domain socket or a 127.0.0.1 port.
+ */
+
+ #ifndef SERVER_H
+ #define SERVER_H
+ 
+ int server_parse_option(const char *arg);
+ 
+ /* Lifecycle, driven by the sampler; the server runs on its own thread */
+ int server_start(void);
+ void server_stop(void);
+ 
+ #endif /* SERVER_H */
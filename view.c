@@ -0,0 +1,315 @@
+/**
+ * CPU and Memory Usage Tracker - view spec
+ * 
+ * The view hands the sampler a spec and the sampler publishes only the rows
+ * it selects, so the view's work follows the rows it shows rather than the
+ * number of processes. A row limit keeps the best rows in a bounded heap
+ * instead of sorting every process.
+ */
+
+ #include <pthread.h>
+ #include <stdlib.h>
+ #include <string.h>
+ 
+ #ifndef _WIN32
+ #include <pwd.h>
+ #include <regex.h>
+ #endif
+ 
+ #include "view.h"
+ 
+ /* Global variables */
+ static pthread_mutex_t spec_lock = PTHREAD_MUTEX_INITIALIZER;
+ static ViewSpec pending_spec = { VIEW_SORT_PID, 0, "", 0, -1, 0 };  // Set by the view, under spec_lock
+ static unsigned long pending_generation = 0;                        // Bumped on every change, under spec_lock
+ static ViewSpec spec = { VIEW_SORT_PID, 0, "", 0, -1, 0 };          // The sampler's copy for the current tick
+ static unsigned long spec_generation = 0;
+ static int spec_active = 0;                       // spec selects anything but all rows in PID order
+ #ifndef _WIN32
+ static regex_t filter_regex;
+ static int regex_compiled = 0;                    // 0 also when the pattern is invalid; it then matches as text
+ #endif
+ static const ProcessList *rows = NULL;            // The list being selected from
+ static int *heap = NULL;                          // Selected rows of it, the one that sorts last on top
+ static int heap_capacity = 0;
+ static const char *sort_key_names[VIEW_N_SORT_KEYS] = {
+     "pid", "name", "cpu", "memory", "pss", "io", "ctxsw", "faults"
+ };
+ 
+ /* Function prototypes */
+ static int row_matches(int row);
+ static float rate_at(const float *column, int row);
+ static unsigned long long pss_at(int row);
+ static int compare_rates(float a, float b);
+ static int compare_rows(int a, int b);
+ static int compare_row_indices(const void *a, const void *b);
+ static void heap_sift_up(int index);
+ static void heap_sift_down(int count, int index);
+ 
+ /* Replace the view spec; the sampler picks it up on its next tick */
+ void view_set_spec(const ViewSpec *new_spec) {
+     pthread_mutex_lock(&spec_lock);
+     pending_spec = *new_spec;
+     pending_spec.filter[VIEW_FILTER_SIZE - 1] = '\0';
+     pending_generation++;
+     pthread_mutex_unlock(&spec_lock);
+ }
+ 
+ /* Copy out the current view spec */
+ void view_get_spec(ViewSpec *out) {
+     pthread_mutex_lock(&spec_lock);
+     *out = pending_spec;
+     pthread_mutex_unlock(&spec_lock);
+ }
+ 
+ /* Command-line name of a sort key */
+ const char *view_sort_key_name(ViewSortKey key) {
+     return sort_key_names[key];
+ }
+ 
+ /* Apply one view command-line option; returns 0 if the option is not a view one */
+ int view_parse_option(const char *arg) {
+     ViewSpec changed;
+     view_get_spec(&changed);
+     
+     // --sort=KEY[:asc|:desc]: sort key, descending by default for the usage keys
+     if (strncmp(arg, "--sort=", 7) == 0) {
+         const char *key = arg + 7;
+         const char *direction = strchr(key, ':');
+         size_t key_len = direction != NULL ? (size_t)(direction - key) : strlen(key);
+         int found = 0;
+         for (int i = 0; i < VIEW_N_SORT_KEYS; i++) {
+             if (strlen(sort_key_names[i]) == key_len && strncmp(key, sort_key_names[i], key_len) == 0) {
+                 changed.sort_key = (ViewSortKey)i;
+                 changed.descending = i >= VIEW_SORT_CPU;
+                 found = 1;
+             }
+         }
+         if (!found) {
+             return 0;
+         }
+         if (direction != NULL) {
+             changed.descending = strcmp(direction, ":desc") == 0;
+         }
+     // --filter=TEXT: only processes whose name contains TEXT
+     } else if (strncmp(arg, "--filter=", 9) == 0) {
+         strncpy(changed.filter, arg + 9, VIEW_FILTER_SIZE - 1);
+         changed.filter_regex = 0;
+     // --filter-regex=RE: only processes whose name matches the extended regular expression RE
+     } else if (strncmp(arg, "--filter-regex=", 15) == 0) {
+         strncpy(changed.filter, arg + 15, VIEW_FILTER_SIZE - 1);
+         changed.filter_regex = 1;
+     // --user=NAME|UID: only processes of one user
+     } else if (strncmp(arg, "--user=", 7) == 0) {
+         const char *user = arg + 7;
+         char *end;
+         long uid = strtol(user, &end, 10);
+ #ifndef _WIN32
+         if (*end != '\0') {
+             struct passwd *entry = getpwnam(user);
+             uid = entry != NULL ? (long)entry->pw_uid : -1;
+         }
+ #endif
+         if (*user == '\0' || uid < 0) {
+             return 0;
+         }
+         changed.uid = (int)uid;
+     // --top=N: keep only the first N rows after sorting
+     } else if (strncmp(arg, "--top=", 6) == 0) {
+         changed.limit = atoi(arg + 6) > 0 ? atoi(arg + 6) : 0;
+     } else {
+         return 0;
+     }
+     
+     view_set_spec(&changed);
+     return 1;
+ }
+ 
+ /* Take the latest spec for this tick; returns whether it selects anything but all rows in PID order */
+ int view_begin_tick(void) {
+     pthread_mutex_lock(&spec_lock);
+     if (pending_generation == spec_generation) {
+         pthread_mutex_unlock(&spec_lock);
+         return spec_active;
+     }
+     spec = pending_spec;
+     spec_generation = pending_generation;
+     pthread_mutex_unlock(&spec_lock);
+     
+ #ifndef _WIN32
+     if (regex_compiled) {
+         regfree(&filter_regex);
+         regex_compiled = 0;
+     }
+     if (spec.filter_regex && spec.filter[0] != '\0') {
+         regex_compiled = regcomp(&filter_regex, spec.filter, REG_EXTENDED | REG_NOSUB) == 0;
+     }
+ #endif
+     spec_active = spec.sort_key != VIEW_SORT_PID || spec.descending || spec.filter[0] != '\0' ||
+                   spec.uid >= 0 || spec.limit > 0;
+     return spec_active;
+ }
+ 
+ /* Whether the rows need their owner for this tick's spec */
+ int view_needs_uid(void) {
+     return spec_active && spec.uid >= 0;
+ }
+ 
+ /* Whether a row passes the filters; rows of unknown owner never pass a user filter */
+ static int row_matches(int row) {
+     if (spec.uid >= 0 && rows->uid[row] != spec.uid) {
+         return 0;
+     }
+     if (spec.filter[0] == '\0') {
+         return 1;
+     }
+ #ifndef _WIN32
+     if (regex_compiled) {
+         return regexec(&filter_regex, rows->name[row], 0, NULL, 0) == 0;
+     }
+ #endif
+     return strstr(rows->name[row], spec.filter) != NULL;
+ }
+ 
+ /* A row's rate from a rate column, -1 (unknown) if the list has no such column */
+ static float rate_at(const float *column, int row) {
+     return column != NULL ? column[row] : -1;
+ }
+ 
+ /* A row's PSS, 0 if it has no memory breakdown */
+ static unsigned long long pss_at(int row) {
+     return rows->smaps[row] >= 0 ? rows->smaps_info[rows->smaps[row]].pss_kb : 0;
+ }
+ 
+ /* Order two rate sums; an unknown rate is negative and sorts below every known one */
+ static int compare_rates(float a, float b) {
+     return (a > b) - (a < b);
+ }
+ 
+ /* Order two rows by the spec; ties, and the PID key itself, go by PID */
+ static int compare_rows(int a, int b) {
+     int order = 0;
+     
+     switch (spec.sort_key) {
+     case VIEW_SORT_NAME:
+         order = strcmp(rows->name[a], rows->name[b]);
+         break;
+     case VIEW_SORT_CPU:
+         order = (rows->cpu_usage[a] > rows->cpu_usage[b]) - (rows->cpu_usage[a] < rows->cpu_usage[b]);
+         break;
+     case VIEW_SORT_MEMORY:
+         order = (rows->memory_usage[a] > rows->memory_usage[b]) - (rows->memory_usage[a] < rows->memory_usage[b]);
+         break;
+     case VIEW_SORT_PSS:
+         order = (pss_at(a) > pss_at(b)) - (pss_at(a) < pss_at(b));
+         break;
+     case VIEW_SORT_IO:
+         order = compare_rates(rate_at(rows->read_rate, a) + rate_at(rows->write_rate, a),
+                               rate_at(rows->read_rate, b) + rate_at(rows->write_rate, b));
+         break;
+     case VIEW_SORT_CTXSW:
+         order = compare_rates(rate_at(rows->voluntary_switch_rate, a) + rate_at(rows->involuntary_switch_rate, a),
+                               rate_at(rows->voluntary_switch_rate, b) + rate_at(rows->involuntary_switch_rate, b));
+         break;
+     case VIEW_SORT_FAULTS:
+         order = compare_rates(rate_at(rows->major_fault_rate, a), rate_at(rows->major_fault_rate, b));
+         break;
+     default:
+         break;
+     }
+     if (order == 0) {
+         order = (rows->pid[a] > rows->pid[b]) - (rows->pid[a] < rows->pid[b]);
+     }
+     return spec.descending ? -order : order;
+ }
+ 
+ static int compare_row_indices(const void *a, const void *b) {
+     return compare_rows(*(const int*)a, *(const int*)b);
+ }
+ 
+ /* Move a new heap entry up past the entries that sort before it */
+ static void heap_sift_up(int index) {
+     while (index > 0) {
+         int parent = (index - 1) / 2;
+         if (compare_rows(heap[index], heap[parent]) <= 0) {
+             break;
+         }
+         int swap = heap[index];
+         heap[index] = heap[parent];
+         heap[parent] = swap;
+         index = parent;
+     }
+ }
+ 
+ /* Move a replaced heap top down below the entries that sort after it */
+ static void heap_sift_down(int count, int index) {
+     for (;;) {
+         int last = index;
+         int left = 2 * index + 1;
+         int right = left + 1;
+         if (left < count && compare_rows(heap[left], heap[last]) > 0) {
+             last = left;
+         }
+         if (right < count && compare_rows(heap[right], heap[last]) > 0) {
+             last = right;
+         }
+         if (last == index) {
+             return;
+         }
+         int swap = heap[index];
+         heap[index] = heap[last];
+         heap[last] = swap;
+         index = last;
+     }
+ }
+ 
+ /*
+  * Fill `view` with the rows of `list` that pass the filters, in spec order.
+  * With a limit of N, each row is compared against the heap top, the worst
+  * of the N best so far, so selection is O(rows log N) and only N rows are
+  * sorted and gathered into the view's columns.
+  */
+ void view_select(const ProcessList *list, ProcessList *view) {
+     int limit = spec.limit > 0 && spec.limit < list->count ? spec.limit : list->count;
+     if (limit > heap_capacity) {
+         heap_capacity = limit * 2;
+         heap = (int*)realloc(heap, heap_capacity * sizeof(int));
+     }
+     
+     rows = list;
+     int count = 0;
+     for (int i = 0; i < list->count; i++) {
+         if (!row_matches(i)) {
+             continue;
+         }
+         if (count < limit) {
+             heap[count++] = i;
+             if (spec.limit > 0) {
+                 heap_sift_up(count - 1);
+             }
+         } else if (compare_rows(i, heap[0]) < 0) {
+             heap[0] = i;
+             heap_sift_down(count, 0);
+         }
+     }
+     qsort(heap, count, sizeof(int), compare_row_indices);
+     
+     process_list_clear(view);
+     process_list_gather(view, list, heap, count);
+     rows = NULL;
+ }
+ 
+ /* Free the selection buffers once the sampler has stopped */
+ void view_free(void) {
+     free(heap);
+     heap = NULL;
+     heap_capacity = 0;
+ #ifndef _WIN32
+     if (regex_compiled) {
+         regfree(&filter_regex);
+         regex_compiled = 0;
+     }
+ #endif
+     spec_generation = 0;
+     spec_active = 0;
+ }
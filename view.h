@@ -0,0 +1,49 @@
+/**
+ * CPU and Memory Usage Tracker - view spec
+ * 
+ * The rows the view wants, selected by the sampler: a name or user
+ * filter, a sort key and a row limit.
+ */
+
+ #ifndef VIEW_H
+ #define VIEW_H
+ 
+ #include "sampler.h"
+ 
+ #define VIEW_FILTER_SIZE 256
+ 
+ /* Sort keys */
+ typedef enum {
+     VIEW_SORT_PID,
+     VIEW_SORT_NAME,
+     VIEW_SORT_CPU,
+     VIEW_SORT_MEMORY,
+     VIEW_SORT_PSS,
+     VIEW_SORT_IO,                    // Read plus write rate
+     VIEW_SORT_CTXSW,                 // Voluntary plus involuntary context switch rate
+     VIEW_SORT_FAULTS,
+     VIEW_N_SORT_KEYS
+ } ViewSortKey;
+ 
+ typedef struct {
+     ViewSortKey sort_key;
+     int descending;
+     char filter[VIEW_FILTER_SIZE];   // Substring of the name, empty for all processes
+     int filter_regex;                // filter is an extended regular expression instead
+     int uid;                         // Only processes of this user, -1 for all
+     int limit;                       // Rows to keep after sorting, 0 for all
+ } ViewSpec;
+ 
+ /* Setting, from any thread */
+ void view_set_spec(const ViewSpec *spec);
+ void view_get_spec(ViewSpec *spec);
+ int view_parse_option(const char *arg);
+ const char *view_sort_key_name(ViewSortKey key);
+ 
+ /* Selection, from the sampler thread */
+ int view_begin_tick(void);
+ int view_needs_uid(void);
+ void view_select(const ProcessList *list, ProcessList *view);
+ void view_free(void);
+ 
+ #endif /* VIEW_H */
@@ -0,0 +1,403 @@
+/**
+ * CPU and Memory Usage Tracker - watchdog rules
+ * 
+ * Rules are matched against every row of a tick right after the scan, so a
+ * rule reacts within one sample interval and needs no front end. A process
+ * is tracked per rule only while its condition holds or a SIGKILL is due,
+ * in a list kept in PID order and merged with the PID-ordered rows.
+ */
+
+ #include <errno.h>
+ #include <stdio.h>
+ #include <stdlib.h>
+ #include <string.h>
+ #include <time.h>
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ #include <signal.h>
+ #endif
+ 
+ #include "profile.h"
+ #include "watchdog.h"
+ 
+ #define WATCHDOG_MAX_RULES 16
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ /* Measures a rule can watch */
+ typedef enum {
+     WATCH_CPU,        // CPU %
+     WATCH_MEM,        // Memory %
+     WATCH_RSS,        // Resident set size in kB
+     WATCH_PSS,        // From smaps_rollup, kB; only known for the --smaps-top processes
+     WATCH_SWAP,
+     WATCH_THREADS,
+     WATCH_N_METRICS
+ } WatchMetric;
+ 
+ /* What a rule does once its condition has held long enough */
+ typedef enum {
+     WATCH_TERM,
+     WATCH_KILL,
+     WATCH_STOP,
+     WATCH_RENICE
+ } WatchAction;
+ 
+ /* One --watch rule */
+ typedef struct {
+     const char *text;                // The rule as given, for the log
+     WatchMetric metric;
+     int above;                       // Matches above the threshold, or below it
+     double threshold;                // In the metric's unit
+     int samples;                     // Consecutive samples the condition must hold
+     unsigned long long duration_ns;  // And for how long, from the first of them
+     char name[16];                   // Only processes whose name contains this, if set
+     WatchAction action;
+     int nice;                        // For WATCH_RENICE
+     unsigned long long kill_after_ns;  // SIGKILL this long after the action if the process is still there, 0 never
+ } WatchRule;
+ 
+ /* A process for which a rule's condition holds, or whose SIGKILL is due */
+ typedef struct {
+     int pid;
+     unsigned long long start_time;   // Tells a reused PID apart
+     int rule;
+     int samples;                     // Consecutive samples the condition held
+     unsigned long long since_ns;     // Monotonic time of the first of them
+     unsigned long long acted_ns;     // When the action ran, 0 before
+     int escalated;                   // The SIGKILL after kill-after was sent
+ } WatchEntry;
+ #endif
+ 
+ /* Global variables */
+ int watchdog_rule_count = 0;
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ static WatchRule rules[WATCHDOG_MAX_RULES];
+ static int dry_run = 0;                // Log actions without taking them
+ static const char *log_path = NULL;    // --watch-log, stderr when not given
+ static FILE *log_file = NULL;
+ static WatchEntry *entries = NULL;     // Tracked processes, by PID then rule
+ static int entry_count = 0;
+ static WatchEntry *next_entries = NULL;  // Filled during a tick, then swapped with entries
+ static int next_count = 0;
+ static int entry_capacity = 0;
+ static const char *metric_names[WATCH_N_METRICS] = { "cpu", "mem", "rss", "pss", "swap", "threads" };
+ #endif
+ 
+ /* Function prototypes */
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ static int parse_condition(char *text, WatchRule *rule);
+ static int parse_rule(const char *text, WatchRule *rule);
+ static double metric_value(const WatchRule *rule, const ProcessList *list, int row, unsigned long long total_mem);
+ static void format_value(const WatchRule *rule, double value, char *buf, size_t size);
+ static void run_action(int index, WatchAction action, const ProcessList *list, int row, double value);
+ static WatchEntry *next_entry(void);
+ #endif
+ 
+ /* Apply one watchdog command-line option; returns 0 if the option is not a watchdog one or the rule is invalid */
+ int watchdog_parse_option(const char *arg) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     // --watch=RULE: add a rule, e.g. rss>8G,for=3,do=term,kill-after=5
+     if (strncmp(arg, "--watch=", 8) == 0) {
+         if (watchdog_rule_count >= WATCHDOG_MAX_RULES || !parse_rule(arg + 8, &rules[watchdog_rule_count])) {
+             return 0;
+         }
+         watchdog_rule_count++;
+         return 1;
+     }
+     // --watch-dry-run: log what the rules would do without doing it
+     if (strcmp(arg, "--watch-dry-run") == 0) {
+         dry_run = 1;
+         return 1;
+     }
+     // --watch-log=FILE: append the action log to FILE instead of stderr
+     if (strncmp(arg, "--watch-log=", 12) == 0) {
+         log_path = arg + 12;
+         return 1;
+     }
+ #else
+     (void)arg;  // Unused parameter
+ #endif
+     return 0;
+ }
+ 
+ #if !defined(_WIN32) && !defined(__APPLE__)
+ /* Parse METRIC>VALUE or METRIC<VALUE; sizes take a K, M, G or T suffix and are bytes without one */
+ static int parse_condition(char *text, WatchRule *rule) {
+     char *op = strpbrk(text, "<>");
+     if (op == NULL) {
+         return 0;
+     }
+     rule->above = *op == '>';
+     *op = '\0';
+     
+     int metric = -1;
+     for (int i = 0; i < WATCH_N_METRICS; i++) {
+         if (strcmp(text, metric_names[i]) == 0) {
+             metric = i;
+         }
+     }
+     char *end;
+     rule->threshold = strtod(op + 1, &end);
+     if (metric < 0 || end == op + 1) {
+         return 0;
+     }
+     rule->metric = (WatchMetric)metric;
+     
+     if (rule->metric == WATCH_RSS || rule->metric == WATCH_PSS || rule->metric == WATCH_SWAP) {
+         const char *units = "KMGT";
+         const char *unit = *end != '\0' ? strchr(units, *end) : NULL;
+         double scale = 1;
+         if (unit != NULL) {
+             for (int i = 0; i <= unit - units; i++) {
+                 scale *= 1024;
+             }
+             end++;
+         }
+         rule->threshold *= scale / 1024;  // Kept in kB
+     }
+     return *end == '\0';
+ }
+ 
+ /* Parse COND[,for=N|for=Ns][,name=TEXT],do=term|kill|stop|renice:N[,kill-after=S] */
+ static int parse_rule(const char *text, WatchRule *rule) {
+     char buf[256];
+     if (strlen(text) >= sizeof(buf)) {
+         return 0;
+     }
+     strcpy(buf, text);
+     memset(rule, 0, sizeof(*rule));
+     rule->text = text;
+     rule->samples = 1;
+     int has_action = 0;
+     
+     // The condition comes first
+     char *save;
+     char *token = strtok_r(buf, ",", &save);
+     if (token != buf || !parse_condition(token, rule)) {
+         return 0;
+     }
+     while ((token = strtok_r(NULL, ",", &save)) != NULL) {
+         char *end;
+         if (strncmp(token, "for=", 4) == 0) {
+             double value = strtod(token + 4, &end);
+             if (strcmp(end, "s") == 0 && value >= 0) {
+                 rule->duration_ns = (unsigned long long)(value * 1e9);
+             } else if (*end == '\0' && value >= 1) {
+                 rule->samples = (int)value;
+             } else {
+                 return 0;
+             }
+         } else if (strncmp(token, "name=", 5) == 0) {
+             strncpy(rule->name, token + 5, sizeof(rule->name) - 1);
+         } else if (strncmp(token, "kill-after=", 11) == 0) {
+             double value = strtod(token + 11, &end);
+             if ((*end != '\0' && strcmp(end, "s") != 0) || value <= 0) {
+                 return 0;
+             }
+             rule->kill_after_ns = (unsigned long long)(value * 1e9);
+         } else if (strcmp(token, "do=term") == 0) {
+             rule->action = WATCH_TERM;
+             has_action = 1;
+         } else if (strcmp(token, "do=kill") == 0) {
+             rule->action = WATCH_KILL;
+             has_action = 1;
+         } else if (strcmp(token, "do=stop") == 0) {
+             rule->action = WATCH_STOP;
+             has_action = 1;
+         } else if (strncmp(token, "do=renice:", 10) == 0) {
+             rule->action = WATCH_RENICE;
+             rule->nice = (int)strtol(token + 10, &end, 10);
+             if (end == token + 10 || *end != '\0') {
+                 return 0;
+             }
+             has_action = 1;
+         } else {
+             return 0;
+         }
+     }
+     return has_action;
+ }
+ 
+ /* A row's value of a rule's metric, or -1 where unknown */
+ static double metric_value(const WatchRule *rule, const ProcessList *list, int row, unsigned long long total_mem) {
+     switch (rule->metric) {
+     case WATCH_CPU:
+         return list->cpu_usage[row];
+     case WATCH_MEM:
+         return list->memory_usage[row];
+     case WATCH_RSS:
+         return list->memory_usage[row] / 100.0 * (double)(total_mem / 1024);
+     case WATCH_PSS:
+         return list->smaps[row] >= 0 ? (double)list->smaps_info[list->smaps[row]].pss_kb : -1;
+     case WATCH_SWAP:
+         return list->smaps[row] >= 0 ? (double)list->smaps_info[list->smaps[row]].swap_kb : -1;
+     case WATCH_THREADS:
+         return list->num_threads[row] > 0 ? list->num_threads[row] : -1;
+     default:
+         return -1;
+     }
+ }
+ 
+ /* Format a metric value for the log */
+ static void format_value(const WatchRule *rule, double value, char *buf, size_t size) {
+     if (rule->metric == WATCH_CPU || rule->metric == WATCH_MEM) {
+         snprintf(buf, size, "%s %.1f%%", metric_names[rule->metric], value);
+     } else if (rule->metric == WATCH_THREADS) {
+         snprintf(buf, size, "%s %.0f", metric_names[rule->metric], value);
+     } else {
+         snprintf(buf, size, "%s %.0f MiB", metric_names[rule->metric], value / 1024);
+     }
+ }
+ 
+ /* Take an action on a process, or only log it in a dry run */
+ static void run_action(int index, WatchAction action, const ProcessList *list, int row, double value) {
+     const WatchRule *rule = &rules[index];
+     char what[32];
+     int done = 1;
+     
+     switch (action) {
+     case WATCH_TERM:
+         strcpy(what, "SIGTERM");
+         done = dry_run || signal_process(list->pid[row], list->start_time[row], SIGTERM);
+         break;
+     case WATCH_KILL:
+         strcpy(what, "SIGKILL");
+         done = dry_run || signal_process(list->pid[row], list->start_time[row], SIGKILL);
+         break;
+     case WATCH_STOP:
+         strcpy(what, "SIGSTOP");
+         done = dry_run || signal_process(list->pid[row], list->start_time[row], SIGSTOP);
+         break;
+     case WATCH_RENICE:
+         snprintf(what, sizeof(what), "renice to %d", rule->nice);
+         done = dry_run || renice_process(list->pid[row], list->start_time[row], rule->nice);
+         break;
+     }
+     const char *result = dry_run ? "dry run" : done ? "done" : strerror(errno);
+     
+     char stamp[32];
+     char measured[48];
+     time_t now = time(NULL);
+     struct tm local;
+     localtime_r(&now, &local);
+     strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+     format_value(rule, value, measured, sizeof(measured));
+     fprintf(log_file != NULL ? log_file : stderr, "%s watchdog rule %d (%s): pid %d (%s) %s: %s, %s\n",
+             stamp, index + 1, rule->text, list->pid[row], list->name[row], measured, what, result);
+     fflush(log_file != NULL ? log_file : stderr);
+ }
+ 
+ /* Append a tracking entry for this tick */
+ static WatchEntry *next_entry(void) {
+     if (next_count >= entry_capacity) {
+         entry_capacity = entry_capacity > 0 ? entry_capacity * 2 : 64;
+         entries = (WatchEntry*)realloc(entries, entry_capacity * sizeof(WatchEntry));
+         next_entries = (WatchEntry*)realloc(next_entries, entry_capacity * sizeof(WatchEntry));
+     }
+     return &next_entries[next_count++];
+ }
+ #endif
+ 
+ /* Open the action log; outside the real /proc the rules only ever run dry, as the PIDs are not real */
+ void watchdog_init(int real_proc) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     if (watchdog_rule_count == 0) {
+         return;
+     }
+     if (!real_proc && !dry_run) {
+         fprintf(stderr, "Watchdog rules only act on the real /proc, running them dry\n");
+         dry_run = 1;
+     }
+     if (log_path != NULL && (log_file = fopen(log_path, "a")) == NULL) {
+         fprintf(stderr, "Cannot open watchdog log %s, logging to stderr\n", log_path);
+     }
+ #else
+     (void)real_proc;  // Unused parameter
+ #endif
+ }
+ 
+ /*
+  * Match the rules against one tick of PID-ordered rows. A rule acts in the
+  * tick its condition completes and once per streak; a process that stops
+  * matching starts over, except that a due SIGKILL is still sent.
+  */
+ void watchdog_tick(const ProcessList *list, unsigned long long total_mem) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     unsigned long long now = profile_now();
+     int old = 0;
+     next_count = 0;
+     
+     for (int i = 0; i < list->count; i++) {
+         while (old < entry_count && entries[old].pid < list->pid[i]) {
+             old++;  // The process is gone
+         }
+         for (int r = 0; r < watchdog_rule_count; r++) {
+             const WatchRule *rule = &rules[r];
+             const WatchEntry *prev = NULL;
+             if (old < entry_count && entries[old].pid == list->pid[i] && entries[old].rule == r) {
+                 prev = &entries[old++];
+                 if (prev->start_time != list->start_time[i]) {
+                     prev = NULL;  // A new process with a reused PID
+                 }
+             }
+             
+             double value = metric_value(rule, list, i, total_mem);
+             int match = value >= 0 && (rule->above ? value > rule->threshold : value < rule->threshold) &&
+                         (rule->name[0] == '\0' || strstr(list->name[i], rule->name) != NULL);
+             int kill_due = prev != NULL && prev->acted_ns != 0 && rule->kill_after_ns != 0 && !prev->escalated;
+             if (!match && !kill_due) {
+                 continue;
+             }
+             
+             WatchEntry *entry = next_entry();
+             if (prev != NULL) {
+                 *entry = entries[old - 1];
+             } else {
+                 memset(entry, 0, sizeof(*entry));
+                 entry->pid = list->pid[i];
+                 entry->start_time = list->start_time[i];
+                 entry->rule = r;
+                 entry->since_ns = now;
+             }
+             if (match && list->sampled[i]) {
+                 entry->samples++;  // A cold row repeated unread is not another sample
+             }
+             
+             if (entry->acted_ns == 0) {
+                 if (entry->samples >= rule->samples && now - entry->since_ns >= rule->duration_ns) {
+                     run_action(r, rule->action, list, i, value);
+                     entry->acted_ns = now;
+                 }
+             } else if (kill_due && now - entry->acted_ns >= rule->kill_after_ns) {
+                 run_action(r, WATCH_KILL, list, i, value);
+                 entry->escalated = 1;
+             }
+         }
+     }
+     
+     WatchEntry *swap = entries;
+     entries = next_entries;
+     next_entries = swap;
+     entry_count = next_count;
+ #else
+     (void)list;       // Unused parameter
+     (void)total_mem;  // Unused parameter
+ #endif
+ }
+ 
+ /* Free the tracking state and close the action log */
+ void watchdog_free(void) {
+ #if !defined(_WIN32) && !defined(__APPLE__)
+     free(entries);
+     free(next_entries);
+     entries = NULL;
+     next_entries = NULL;
+     entry_count = 0;
+     next_count = 0;
+     entry_capacity = 0;
+     if (log_file != NULL) {
+         fclose(log_file);
+         log_file = NULL;
+     }
+ #endif
+ }
@@ -0,0 +1,25 @@
+/**
+ * CPU and Memory Usage Tracker - watchdog rules
+ * 
+ * Declarative rules evaluated by the sampler on every tick, such as
+ * "RSS above 8 GiB for 3 samples: SIGTERM, then SIGKILL after 5 s".
+ * Actions are logged and reach processes through signal_process(), so a
+ * reused PID is never hit.
+ */
+
+ #ifndef WATCHDOG_H
+ #define WATCHDOG_H
+ 
+ #include "sampler.h"
+ 
+ /* Watchdog settings */
+ extern int watchdog_rule_count;  // Rules given with --watch, 0 leaves the watchdog idle
+ 
+ int watchdog_parse_option(const char *arg);
+ 
+ /* Evaluation, from the sampler thread */
+ void watchdog_init(int real_proc);
+ void watchdog_tick(const ProcessList *list, unsigned long long total_mem);
+ void watchdog_free(void);
+ 
+ #endif /* WATCHDOG_H */